@@ -57,17 +57,25 @@ function loaded(api) {
          * @param {number} value      A value
          * @param {number} [vcc=null] A voltage level
          * @param  {Function} [cb=null] A callback with an error parameter, called when done. Used for testing only.
+         * @param {number} [timestamp=null] A timestamp, for values read earlier
          */
-        setValue(value, vcc = null, cb = null) {
-            this.lastSensorValue = value;
-            this.lastSensorTimestamp = this.api.exported.DateUtils.class.timestamp();
+        setValue(value, vcc = null, cb = null, timestamp = null) {
+            if (!timestamp) {
+                timestamp = this.api.exported.DateUtils.class.timestamp();
+            }
+
+            // Backfilled values do not replace a newer one
+            if (!this.lastSensorTimestamp || timestamp >= this.lastSensorTimestamp) {
+                this.lastSensorValue = value;
+                this.lastSensorTimestamp = timestamp;
+            }
 
             if (value >= MIN_VALUE_FOR_RAIN) {
                 // it rains
-                super.setValue(this.api.exported.EspWeatherStation.constants().REFRESH_TIME, vcc, cb, this.lastSensorTimestamp);
+                super.setValue(this.api.exported.EspWeatherStation.constants().REFRESH_TIME, vcc, cb, timestamp);
             } else {
                 // no rains detected
-                super.setValue(0, vcc, cb, this.lastSensorTimestamp);
+                super.setValue(0, vcc, cb, timestamp);
             }
         }
 
@@ -5,13 +5,28 @@
 dht DHT;
 #define DHT_PIN 12
 
-String JSON_CONFIG = "%config%";
+// DHT22 needs this long after power on before its first read
+#define DHT_WARMUP 2000
+
 Smarties smarties = Smarties();
 
+int dhtStatus = DHTLIB_OK;
+
+void startDht() {
+    DHT.startRead(DHT_PIN);
+}
+
+boolean dhtReady() {
+    return DHT.readReady();
+}
+
+void finishDht() {
+    dhtStatus = DHT.finishRead();
+}
+
 void transmitSensor() {
-    delay(2000);
-    int chk = DHT.read22(DHT_PIN);
-    switch (chk)
+    smarties.acquire();
+    switch (dhtStatus)
     {
         case DHTLIB_OK:
             Serial.println("OK,\t");
@@ -40,7 +55,8 @@ void transmitSensor() {
 }
 
 void setup() {
-  smarties.setup(JSON_CONFIG);
+  smarties.setup();
+  smarties.addAcquisition(startDht, dhtReady, finishDht, DHT_WARMUP);
 }
 
 void loop() {
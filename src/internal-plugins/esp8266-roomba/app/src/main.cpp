@@ -1,93 +1,89 @@
 #include <Smarties.h>
 #include <string>
 #include <memory>
+#include "roomba_oi.h"
 
-String JSON_CONFIG = "%config%";
 Smarties smarties = Smarties();
 
 #define SERIAL_RX     D5  // pin for SoftwareSerial RX
 #define SERIAL_TX     D6  // pin for SoftwareSerial TX
 #define BRC_PIN 0
 
+RoombaOI roomba(Serial, BRC_PIN);
+
+// Last values pushed on the channel, -1 to push again
+long publishedChargingState = -1;
+long publishedBattery = -1;
+long publishedBumps = -1;
+
+// Commands are queued and played by roomba.poll(), handlers answer at once
+void queued(boolean accepted) {
+    if (accepted) {
+        smarties.getWebServer().send(200, "application/json", "{\"success\":true, \"pending\":" + String(roomba.pending()) + "}");
+    } else {
+        smarties.getWebServer().send(503, "application/json", "{\"success\":false, \"error\":\"Command queue full\"}");
+    }
+}
+
 void resetRoomba() {
-	digitalWrite(BRC_PIN, LOW);
-	delay(100);
-	digitalWrite(BRC_PIN, HIGH);
-
-    Serial.write(128);
-    delay(50);
-    Serial.write(129);
-    delay(50);
-    Serial.write(11);
-    delay(50);
-    Serial.write(7);
-    delay(50);
-
-	delay(500);
-	Serial.begin(115200);
-
-    Serial.write(128);
-    delay(50);
-    Serial.write(129);
-    delay(50);
-    Serial.write(11);
-    delay(50);
-    Serial.write(7);
-    delay(50);
-
-	digitalWrite(BRC_PIN, LOW);
-	delay(100);
-	digitalWrite(BRC_PIN, HIGH);
-	//timer.setTimeout(5000, StayAwake);
-}
-
-void awake() {
-    digitalWrite(BRC_PIN, LOW);
-    delay(500);
-    digitalWrite(BRC_PIN, HIGH);
-    delay(500);
+    queued(roomba.reset());
 }
 
 void startRoomba() {
-    awake();
-    Serial.write(131);
-    delay(50);
-    Serial.write(135);
-    delay(50);
-    Serial.write(128);
-    smarties.getWebServer().send(200, "application/json", "{\"success\":true}");
+    queued(roomba.command(OI_CLEAN));
 }
 
 void stopRoomba() {
-    awake();
-    Serial.write(131);
-    delay(50);
-    Serial.write(133);
-    delay(50);
-    Serial.write(128);
-    smarties.getWebServer().send(200, "application/json", "{\"success\":true}");
+    queued(roomba.command(OI_POWER));
 }
 
 void spotRoomba() {
-    awake();
-    Serial.write(131);
-    delay(25);
-    Serial.write(134);
-    delay(25);
-    Serial.write(128);
-    delay(25);
-    smarties.getWebServer().send(200, "application/json", "{\"success\":true}");
+    queued(roomba.command(OI_SPOT));
 }
 
 void dockRoomba() {
-    awake();
-    Serial.write(131);
-    delay(25);
-    Serial.write(143);
-    delay(25);
-    Serial.write(128);
-    delay(25);
-    smarties.getWebServer().send(200, "application/json", "{\"success\":true}");
+    queued(roomba.command(OI_SEEK_DOCK));
+}
+
+boolean startCommand(const char *args) {
+    return roomba.command(OI_CLEAN);
+}
+
+boolean stopCommand(const char *args) {
+    return roomba.command(OI_POWER);
+}
+
+boolean spotCommand(const char *args) {
+    return roomba.command(OI_SPOT);
+}
+
+boolean dockCommand(const char *args) {
+    return roomba.command(OI_SEEK_DOCK);
+}
+
+boolean resetCommand(const char *args) {
+    return roomba.reset();
+}
+
+void publishChange(const char *key, long value, long &published) {
+    if (value != published && smarties.publish(key, String(value))) {
+        published = value;
+    }
+}
+
+// Push the streamed sensors to the hub when they change, and again once the
+// channel is back
+void publishSensors() {
+    const roomba_sensors_t &sensors = roomba.sensors();
+    if (!smarties.channelConnected()) {
+        publishedChargingState = -1;
+        publishedBattery = -1;
+        publishedBumps = -1;
+    } else if (sensors.updated != 0) {
+        publishChange("chargingState", sensors.chargingState, publishedChargingState);
+        publishChange("battery", sensors.capacity > 0 ? (100UL * sensors.charge) / sensors.capacity : 0, publishedBattery);
+        publishChange("bumps", sensors.bumps & 0x03, publishedBumps);
+    }
 }
 
 void ping() {
@@ -95,79 +91,33 @@ void ping() {
     smarties.getWebServer().send(200, "application/json", "{\"success\":true}");
 }
 
+// Answered from the sensor stream cache, level is kept as the battery voltage
 void statusRoomba() {
-	byte data[2] = {0,0}; // array to store data from battery
-	byte i = 0;
-	Serial.write(142); // Send a packet of sensor data bytes
-	Serial.write(22);  // Get battery value
-	delay(200);
-	while (Serial.available()) {
-		data[i++] = Serial.read();
-	}
-	// highbyte is shifted left eight bits, lowbyte is added to highbyte
-	// encoder_count=highbyte<<8+lowbyte
-	word batteryValue = 0;
-	batteryValue = (data[0]<<8)+data[1];
-
-/*    char tmp[5];
-	char buffer[10];
-    int i = 0;
-
-    String status_log;
-    // Clean buffer
-	while (Serial.available() > 0) {
-		Serial.read();
-		i++;
-		delay(1);
-	}
-    if ( i > 0 ) {
-		status_log += "Dumped ";
-		status_log += i;
-		status_log += " bytes.\n";
-	}
-
-    // Serial.write(28);
-    // delay(25);
-    Serial.write(148);
-    delay(25);
-    Serial.write(1);
-    delay(25);
-    Serial.write(3);
-    delay(25);
-    delay(500);
-
-    i = 0;
-	status_log += "RX: ";
-	while ( Serial.available() > 0) {
-		buffer[i] = Serial.read();
-		status_log += String(buffer[i], DEC);
-		status_log += " ";
-		i++;
-		delay(5);
-	}
-	status_log += "\n";
-
-    if ( i == 0 ) {
-		status_log += "ERROR: No response\n";
-	}
-
-	// Handle an incomplete packet (too much or too little data)
-	if (i != 10) {
-		status_log += "ERROR: Incomplete packet recieved ";
-		status_log += i;
-		status_log += " bytes.\n";
-	}*/
-
-    smarties.getWebServer().send(200, "application/json", "{\"success\":true, \"level\":\"" + String(batteryValue) + "\"}");
+    roomba.watch();
+    const roomba_sensors_t &sensors = roomba.sensors();
+    String status = "{\"success\":true";
+    status += ", \"level\":\"" + String(sensors.voltage) + "\"";
+    status += ", \"voltage\":" + String(sensors.voltage);
+    status += ", \"current\":" + String(sensors.current);
+    status += ", \"charge\":" + String(sensors.charge);
+    status += ", \"capacity\":" + String(sensors.capacity);
+    status += ", \"battery\":" + String(sensors.capacity > 0 ? (100UL * sensors.charge) / sensors.capacity : 0);
+    status += ", \"chargingState\":" + String(sensors.chargingState);
+    status += ", \"docked\":" + String((sensors.chargingSources & 0x02) ? "true" : "false");
+    status += ", \"bumpRight\":" + String((sensors.bumps & 0x01) ? "true" : "false");
+    status += ", \"bumpLeft\":" + String((sensors.bumps & 0x02) ? "true" : "false");
+    status += ", \"age\":" + String(roomba.age());
+    status += ", \"frames\":" + String(sensors.frames);
+    status += ", \"errors\":" + String(sensors.errors);
+    status += "}";
+    smarties.getWebServer().send(200, "application/json", status);
 }
 
 
 void setup() {
-    smarties.setup(JSON_CONFIG);
+    smarties.setup();
 
-    pinMode(BRC_PIN, OUTPUT);
-    digitalWrite(BRC_PIN, HIGH);
-    delay(25);
+    roomba.begin();
 
     smarties.getWebServer().on("/reset", resetRoomba);
     smarties.getWebServer().on("/start", startRoomba);
@@ -176,8 +126,17 @@ void setup() {
     smarties.getWebServer().on("/dock", dockRoomba);
     smarties.getWebServer().on("/status", statusRoomba);
     smarties.getWebServer().on("/ping", ping);
+
+    smarties.onCommand("start", startCommand);
+    smarties.onCommand("stop", stopCommand);
+    smarties.onCommand("spot", spotCommand);
+    smarties.onCommand("dock", dockCommand);
+    smarties.onCommand("reset", resetCommand);
 }
 
 void loop() {
+    roomba.poll();
+    smarties.channel();
+    publishSensors();
     smarties.getWebServer().handleClient();
 }
@@ -0,0 +1,283 @@
+/*
+  Non blocking Roomba Open Interface engine
+
+  Commands are queued as steps (a byte, a BRC pin level or a pause) and each
+  step holds the queue for as long as the OI needs before the next one, so
+  HTTP handlers only enqueue and return. Sensors are read with the stream
+  command (148): the Roomba then sends a frame every 15 ms, parsed as bytes
+  come in to keep a cache that /status answers from.
+
+  The stream stops when the Roomba sleeps, and restarting it means waking the
+  robot with BRC, which keeps it from sleeping. So a quiet stream is only
+  requested again after a command or a watch() (a /status call), with an
+  exponential backoff between two requests that is reset by a valid frame or
+  a command. A running stream answers the request.
+
+  Stream frame : 19, n, [packet id, packet data]..., checksum
+  The low byte of the sum of all frame bytes, checksum included, is 0.
+*/
+#ifndef __roomba_oi_h__
+#define __roomba_oi_h__
+
+#include <Arduino.h>
+
+#define OI_QUEUE_SIZE 64            // Steps, power of two
+
+#define OI_START 128
+#define OI_BAUD 129
+#define OI_SAFE 131
+#define OI_POWER 133
+#define OI_SPOT 134
+#define OI_CLEAN 135
+#define OI_SEEK_DOCK 143
+#define OI_STREAM 148
+#define OI_RESET 7
+#define OI_BAUD_115200 11
+
+#define OI_MODE_DELAY 20            // In milliseconds, after a mode change
+#define OI_WAKE_PULSE 500           // In milliseconds, BRC low then high
+#define OI_STREAM_HEADER 19
+#define OI_STREAM_TIMEOUT 2000      // In milliseconds without a valid frame
+#define OI_STREAM_RETRY 10000       // In milliseconds, first delay between two stream requests
+#define OI_STREAM_RETRY_MAX 600000  // In milliseconds, longest delay between two stream requests
+
+// Streamed packets
+#define OI_PACKET_BUMPS 7           // Bumps and wheel drops, 1 byte
+#define OI_PACKET_CHARGING_STATE 21 // 1 byte
+#define OI_PACKET_VOLTAGE 22        // mV, 2 bytes
+#define OI_PACKET_CURRENT 23        // mA, 2 bytes signed
+#define OI_PACKET_CHARGE 25         // mAh, 2 bytes
+#define OI_PACKET_CAPACITY 26       // mAh, 2 bytes
+#define OI_PACKET_SOURCES 34        // Charging sources available, 1 byte
+
+#define OI_STEP_BYTE 0
+#define OI_STEP_PIN 1
+#define OI_STEP_WAIT 2
+
+typedef struct {
+  uint8_t bumps;
+  uint8_t chargingState;
+  uint16_t voltage;
+  int16_t current;
+  uint16_t charge;
+  uint16_t capacity;
+  uint8_t chargingSources;
+  unsigned long updated;            // millis() of the last valid frame, 0 if none
+  uint32_t frames;
+  uint32_t errors;                  // Bad checksums and unknown packets
+} roomba_sensors_t;
+
+class RoombaOI {
+public:
+  RoombaOI(Stream &serial, uint8_t brcPin)
+      : _serial(serial), _brcPin(brcPin), _head(0), _tail(0), _next(0), _streamRequested(0), _streamWanted(false), _streamAttempts(0), _frameState(0) {
+    memset(&_sensors, 0, sizeof(_sensors));
+  }
+
+  void begin() {
+    pinMode(_brcPin, OUTPUT);
+    digitalWrite(_brcPin, HIGH);
+    requestStream(millis());
+  }
+
+  size_t pending() const { return _head - _tail; }
+  const roomba_sensors_t &sensors() const { return _sensors; }
+
+  // Wake up, take control, run a command and hand the buttons back
+  bool command(uint8_t opcode) {
+    if (OI_QUEUE_SIZE - pending() < 5) {
+      return false;
+    }
+    wake();
+    push(OI_STEP_BYTE, OI_SAFE, OI_MODE_DELAY);
+    push(OI_STEP_BYTE, opcode, OI_MODE_DELAY);
+    push(OI_STEP_BYTE, OI_START, OI_MODE_DELAY);
+    // The robot is awake, the stream can be requested again at once, unless
+    // it was just turned off
+    _streamAttempts = 0;
+    _streamWanted = (opcode != OI_POWER);
+    return true;
+  }
+
+  // Ask for the stream to be restarted if it went quiet, within the backoff
+  void watch() {
+    _streamWanted = true;
+  }
+
+  // Back to 115200 bauds and OI reset, twice as the Roomba may miss the first
+  bool reset() {
+    if (OI_QUEUE_SIZE - pending() < 13) {
+      return false;
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+      push(OI_STEP_PIN, LOW, 100);
+      push(OI_STEP_PIN, HIGH, 0);
+      push(OI_STEP_BYTE, OI_START, 50);
+      push(OI_STEP_BYTE, OI_BAUD, 0);
+      push(OI_STEP_BYTE, OI_BAUD_115200, 50);
+      push(OI_STEP_BYTE, OI_RESET, (i == 0) ? 550 : 50);
+    }
+    _sensors.updated = 0;
+    _streamAttempts = 0;
+    _streamWanted = true;
+    return true;
+  }
+
+  // Run the steps that are due, parse incoming stream bytes and restart the
+  // stream when it went quiet and was asked for
+  void poll() {
+    unsigned long now = millis();
+
+    while (pending() > 0 && (long)(now - _next) >= 0) {
+      const step_t &step = _queue[_tail & (OI_QUEUE_SIZE - 1)];
+      if (step.type == OI_STEP_BYTE) {
+        _serial.write(step.value);
+      } else if (step.type == OI_STEP_PIN) {
+        digitalWrite(_brcPin, step.value);
+      }
+      _next = now + step.wait;
+      _tail++;
+    }
+
+    while (_serial.available() > 0) {
+      parse(_serial.read(), now);
+    }
+
+    if (_streamWanted && (_sensors.updated == 0 || now - _sensors.updated > OI_STREAM_TIMEOUT) && pending() == 0 &&
+        (_streamAttempts == 0 || now - _streamRequested > retryDelay())) {
+      requestStream(now);
+    }
+  }
+
+  // Milliseconds since the last frame, -1 if none was received
+  long age() const {
+    return (_sensors.updated == 0) ? -1 : (long)(millis() - _sensors.updated);
+  }
+
+private:
+  typedef struct {
+    uint8_t type;
+    uint8_t value;
+    uint16_t wait;
+  } step_t;
+
+  void push(uint8_t type, uint8_t value, uint16_t wait) {
+    step_t &step = _queue[_head & (OI_QUEUE_SIZE - 1)];
+    step.type = type;
+    step.value = value;
+    step.wait = wait;
+    _head++;
+  }
+
+  void wake() {
+    push(OI_STEP_PIN, LOW, OI_WAKE_PULSE);
+    push(OI_STEP_PIN, HIGH, OI_WAKE_PULSE);
+  }
+
+  unsigned long retryDelay() const {
+    unsigned long delay = OI_STREAM_RETRY;
+    for (uint8_t i = 1; i < _streamAttempts && delay < OI_STREAM_RETRY_MAX; i++) {
+      delay *= 2;
+    }
+    return (delay < OI_STREAM_RETRY_MAX) ? delay : OI_STREAM_RETRY_MAX;
+  }
+
+  void requestStream(unsigned long now) {
+    static const uint8_t packets[] = {OI_PACKET_BUMPS, OI_PACKET_CHARGING_STATE, OI_PACKET_VOLTAGE, OI_PACKET_CURRENT, OI_PACKET_CHARGE, OI_PACKET_CAPACITY, OI_PACKET_SOURCES};
+    if (OI_QUEUE_SIZE - pending() < 5 + sizeof(packets)) {
+      return;
+    }
+    _streamRequested = now ? now : 1;
+    _streamWanted = false;
+    if (_streamAttempts < 255) {
+      _streamAttempts++;
+    }
+    wake();
+    push(OI_STEP_BYTE, OI_START, OI_MODE_DELAY);
+    push(OI_STEP_BYTE, OI_STREAM, 0);
+    push(OI_STEP_BYTE, sizeof(packets), 0);
+    for (uint8_t i = 0; i < sizeof(packets); i++) {
+      push(OI_STEP_BYTE, packets[i], 0);
+    }
+  }
+
+  void parse(uint8_t byte, unsigned long now) {
+    switch (_frameState) {
+      case 0: // Header
+        if (byte == OI_STREAM_HEADER) {
+          _frameSum = byte;
+          _frameState = 1;
+        }
+        break;
+      case 1: // Length
+        _frameLength = byte;
+        _frameIndex = 0;
+        _frameSum += byte;
+        _frameState = (byte > 0 && byte <= sizeof(_frame)) ? 2 : 0;
+        break;
+      case 2: // Packets
+        _frame[_frameIndex++] = byte;
+        _frameSum += byte;
+        if (_frameIndex == _frameLength) {
+          _frameState = 3;
+        }
+        break;
+      default: // Checksum
+        _frameState = 0;
+        if ((uint8_t)(_frameSum + byte) == 0 && decode(now)) {
+          _sensors.frames++;
+        } else {
+          _sensors.errors++;
+        }
+        break;
+    }
+  }
+
+  bool decode(unsigned long now) {
+    roomba_sensors_t sensors = _sensors;
+    uint8_t i = 0;
+    while (i < _frameLength) {
+      uint8_t id = _frame[i++];
+      uint8_t size = (id == OI_PACKET_BUMPS || id == OI_PACKET_CHARGING_STATE || id == OI_PACKET_SOURCES) ? 1 : 2;
+      if (i + size > _frameLength) {
+        return false;
+      }
+      uint16_t value = (size == 1) ? _frame[i] : (uint16_t)((_frame[i] << 8) | _frame[i + 1]);
+      i += size;
+      switch (id) {
+        case OI_PACKET_BUMPS: sensors.bumps = value; break;
+        case OI_PACKET_CHARGING_STATE: sensors.chargingState = value; break;
+        case OI_PACKET_VOLTAGE: sensors.voltage = value; break;
+        case OI_PACKET_CURRENT: sensors.current = (int16_t)value; break;
+        case OI_PACKET_CHARGE: sensors.charge = value; break;
+        case OI_PACKET_CAPACITY: sensors.capacity = value; break;
+        case OI_PACKET_SOURCES: sensors.chargingSources = value; break;
+        default: return false;
+      }
+    }
+    sensors.updated = now ? now : 1;
+    _sensors = sensors;
+    _streamAttempts = 0;
+    _streamWanted = false;
+    return true;
+  }
+
+  Stream &_serial;
+  uint8_t _brcPin;
+  step_t _queue[OI_QUEUE_SIZE];
+  size_t _head;
+  size_t _tail;
+  unsigned long _next;
+  unsigned long _streamRequested;
+  bool _streamWanted;
+  uint8_t _streamAttempts;
+  roomba_sensors_t _sensors;
+
+  uint8_t _frameState;
+  uint8_t _frameLength;
+  uint8_t _frameIndex;
+  uint8_t _frameSum;
+  uint8_t _frame[32];
+};
+
+#endif
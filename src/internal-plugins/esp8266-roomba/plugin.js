@@ -1,6 +1,5 @@
 "use strict";
 
-const request = require("request");
 const fs = require("fs-extra");
 const WS_ESP8266_ROOMBA_BASE_ROUTE = ":/esp8266-roomba/";
 const ROOMBA_START = "start";
@@ -128,7 +127,7 @@ function loaded(api) {
             wiringSchema.right["TX"].push("Roomba RX pin");
             wiringSchema.left["GND-2"].push("mp1584en Out-");
             wiringSchema.left["VIN"].push("mp1584en Out+");
-            this.api.iotAPI.registerApp("app", "esp8266-roomba", "Nodemcu Roomba", 5, api.iotAPI.constants().PLATFORMS.ESP8266, api.iotAPI.constants().BOARDS.NODEMCU, api.iotAPI.constants().FRAMEWORKS.ARDUINO, ["esp8266"], espPlugin.generateOptions(espPlugin.constants().MODE_ALWAYS_POWERED, 0), wiringSchema);
+            this.api.iotAPI.registerApp("app", "esp8266-roomba", "Nodemcu Roomba", 6, api.iotAPI.constants().PLATFORMS.ESP8266, api.iotAPI.constants().BOARDS.NODEMCU, api.iotAPI.constants().FRAMEWORKS.ARDUINO, ["esp8266"], espPlugin.generateOptions(espPlugin.constants().MODE_ALWAYS_POWERED, 0), wiringSchema);
             this.api.iotAPI.addIngredientForReceipe("esp8266-roomba", "Roomba iRobot", "500 or 600 Roomba series", 1, true);
             this.api.iotAPI.addIngredientForReceipe("esp8266-roomba", "mp1584en", "Voltage regulator. In+ goes on Roomba Vpwr, In- pin goes on Roomba GND", 1, true);
             this.roombas = {};
@@ -233,8 +232,8 @@ function loaded(api) {
             const roomba = this.roombas[parseInt(id)];
             if (roomba) {
                 if (command == ROOMBA_START || command == ROOMBA_CLEAN ||command == ROOMBA_STOP ||command == ROOMBA_SPOT ||command == ROOMBA_DOCK) {
-                    this.api.exported.Logger.info("Trigger " + "http://" + roomba.ip + "/" + command);
-                    request("http://" + roomba.ip + "/" + command, { }, (err) => {
+                    this.api.exported.Logger.info("Trigger " + command + " on roomba " + id);
+                    this.api.getPluginInstance("esp8266").sendCommand(id, command, (err) => {
                         if (err) {
                             reject(this.api.webAPI.APIResponse(false, {}, 7142042425, err.message));
                         } else {
@@ -0,0 +1,229 @@
+//
+//    FILE: dht.cpp
+//  AUTHOR: Rob Tillaart
+// VERSION: 0.1.14
+// PURPOSE: DHT Temperature & Humidity Sensor library for Arduino
+//     URL: http://arduino.cc/playground/Main/DHTLib
+//
+// HISTORY:
+// 0.1.14 interrupt driven capture of the pulses, retry on errors
+// 0.1.13 fix negative temperature
+// 0.1.12 support DHT33 and DHT44 initial version
+// 0.1.11 renamed DHTLIB_TIMEOUT
+// 0.1.10 optimized faster WAKEUP + TIMEOUT
+// 0.1.09 optimize size: timeout check + use of mask
+// 0.1.08 added formula for timeout based upon clockspeed
+// 0.1.07 added support for DHT21
+// 0.1.06 minimize footprint (2012-12-27)
+// 0.1.05 fixed negative temperature bug (thanks to Roseman)
+// 0.1.04 improved readability of code using DHTLIB_OK in code
+// 0.1.03 added error values for temp and humidity when read failed
+// 0.1.02 added error codes
+// 0.1.01 added support for Arduino 1.0, fixed typos (31/12/2011)
+// 0.1.0 by Rob Tillaart (01/04/2011)
+//
+// inspired by DHT11 library
+//
+// Released to the public domain
+//
+
+#include "dht.h"
+
+/////////////////////////////////////////////////////
+//
+// PUBLIC
+//
+
+volatile uint8_t dht::_capturePin;
+volatile uint8_t dht::_pulses;
+volatile uint8_t dht::_pulseWidth[DHTLIB_PULSES];
+volatile bool dht::_high;
+volatile uint32_t dht::_riseTime;
+
+// return values:
+// DHTLIB_OK
+// DHTLIB_ERROR_CHECKSUM
+// DHTLIB_ERROR_TIMEOUT
+int dht::read11(uint8_t pin)
+{
+    int rv = DHTLIB_OK;
+    for (uint8_t attempt = 0; attempt <= DHTLIB_RETRIES; attempt++)
+    {
+        if (attempt > 0) delay(DHTLIB_DHT11_RETRY_DELAY);
+
+        // READ VALUES
+        rv = _readSensor(pin, DHTLIB_DHT11_WAKEUP);
+        if (rv != DHTLIB_OK) continue;
+
+        // CONVERT AND STORE
+        humidity    = bits[0];  // bits[1] == 0;
+        temperature = bits[2];  // bits[3] == 0;
+
+        // TEST CHECKSUM
+        // bits[1] && bits[3] both 0
+        uint8_t sum = bits[0] + bits[2];
+        if (bits[4] != sum)
+        {
+            rv = DHTLIB_ERROR_CHECKSUM;
+            continue;
+        }
+
+        return DHTLIB_OK;
+    }
+    return rv;
+}
+
+
+// return values:
+// DHTLIB_OK
+// DHTLIB_ERROR_CHECKSUM
+// DHTLIB_ERROR_TIMEOUT
+int dht::read(uint8_t pin)
+{
+    int rv = DHTLIB_OK;
+    for (uint8_t attempt = 0; attempt <= DHTLIB_RETRIES; attempt++)
+    {
+        if (attempt > 0) delay(DHTLIB_DHT_RETRY_DELAY);
+
+        rv = _readSensor(pin, DHTLIB_DHT_WAKEUP);
+        if (rv == DHTLIB_OK) rv = _convert();
+        if (rv == DHTLIB_OK) break;
+    }
+    return rv;
+}
+
+void dht::startRead(uint8_t pin)
+{
+    _startCapture(pin, DHTLIB_DHT_WAKEUP);
+}
+
+bool dht::readReady()
+{
+    return (_pulses >= DHTLIB_PULSES) || (millis() - _captureStart >= DHTLIB_TIMEOUT);
+}
+
+// return values:
+// DHTLIB_OK
+// DHTLIB_ERROR_CHECKSUM
+// DHTLIB_ERROR_TIMEOUT
+int dht::finishRead()
+{
+    int rv = _finishCapture();
+    if (rv != DHTLIB_OK) return rv;
+    return _convert();
+}
+
+/////////////////////////////////////////////////////
+//
+// PRIVATE
+//
+
+// return values:
+// DHTLIB_OK
+// DHTLIB_ERROR_CHECKSUM
+int dht::_convert()
+{
+    // CONVERT AND STORE
+    humidity = word(bits[0], bits[1]) * 0.1;
+    temperature = word(bits[2] & 0x7F, bits[3]) * 0.1;
+    if (bits[2] & 0x80)  // negative temperature
+    {
+        temperature = -temperature;
+    }
+
+    // TEST CHECKSUM
+    uint8_t sum = bits[0] + bits[1] + bits[2] + bits[3];
+    if (bits[4] != sum)
+    {
+        return DHTLIB_ERROR_CHECKSUM;
+    }
+    return DHTLIB_OK;
+}
+
+// return values:
+// DHTLIB_OK
+// DHTLIB_ERROR_TIMEOUT
+int dht::_readSensor(uint8_t pin, uint8_t wakeupDelay)
+{
+    _startCapture(pin, wakeupDelay);
+    return _finishCapture();
+}
+
+void dht::_startCapture(uint8_t pin, uint8_t wakeupDelay)
+{
+    _pin = pin;
+
+    // REQUEST SAMPLE
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+    delay(wakeupDelay);
+    digitalWrite(pin, HIGH);
+    delayMicroseconds(40);
+    pinMode(pin, INPUT);
+
+    // TIME THE HIGH PULSES FROM NOW ON
+    _capturePin = pin;
+    _pulses = 0;
+    _high = false;
+    _captureStart = millis();
+    attachInterrupt(digitalPinToInterrupt(pin), _edge, CHANGE);
+}
+
+// return values:
+// DHTLIB_OK
+// DHTLIB_ERROR_TIMEOUT
+int dht::_finishCapture()
+{
+    // the sensor answers within about 5 msec, leave the CPU to other tasks
+    while (!readReady()) yield();
+
+    detachInterrupt(digitalPinToInterrupt(_pin));
+    pinMode(_pin, OUTPUT);
+    digitalWrite(_pin, HIGH);
+
+    // EMPTY BUFFER
+    for (uint8_t i = 0; i < 5; i++) bits[i] = 0;
+
+    // the acknowledge may be missed when the sensor answers early, the
+    // data is always the last 40 pulses
+    if (_pulses < 40)
+    {
+        humidity    = DHTLIB_INVALID_VALUE;  // invalid value, or is NaN prefered?
+        temperature = DHTLIB_INVALID_VALUE;  // invalid value
+        return DHTLIB_ERROR_TIMEOUT;
+    }
+
+    // DECODE THE OUTPUT - 40 BITS => 5 BYTES
+    uint8_t first = _pulses - 40;
+    for (uint8_t i = 0; i < 40; i++)
+    {
+        if (_pulseWidth[first + i] > DHTLIB_ONE_THRESHOLD)
+        {
+            bits[i >> 3] |= 128 >> (i & 7);
+        }
+    }
+
+    return DHTLIB_OK;
+}
+
+void ICACHE_RAM_ATTR dht::_edge()
+{
+    uint32_t now = micros();
+    if (digitalRead(_capturePin) == HIGH)
+    {
+        _riseTime = now;
+        _high = true;
+    }
+    else if (_high)
+    {
+        _high = false;
+        if (_pulses < DHTLIB_PULSES)
+        {
+            uint32_t width = now - _riseTime;
+            _pulseWidth[_pulses++] = (width > 255) ? 255 : width;
+        }
+    }
+}
+//
+// END OF FILE
+//
\ No newline at end of file
@@ -0,0 +1,96 @@
+//
+//    FILE: dht.h
+//  AUTHOR: Rob Tillaart
+// VERSION: 0.1.14
+// PURPOSE: DHT Temperature & Humidity Sensor library for Arduino
+//     URL: http://arduino.cc/playground/Main/DHTLib
+//
+// HISTORY:
+// see dht.cpp file
+//
+
+#ifndef dht_h
+#define dht_h
+
+#if ARDUINO < 100
+#include <WProgram.h>
+#else
+#include <Arduino.h>
+#endif
+
+#define DHT_LIB_VERSION "0.1.14"
+
+#define DHTLIB_OK                0
+#define DHTLIB_ERROR_CHECKSUM   -1
+#define DHTLIB_ERROR_TIMEOUT    -2
+#define DHTLIB_INVALID_VALUE    -999
+
+#define DHTLIB_DHT11_WAKEUP     18
+#define DHTLIB_DHT_WAKEUP       1
+
+// A transmission is an 80 usec acknowledge then 40 bits of about 120 usec,
+// so a capture that has not completed in 10 msec has failed
+#define DHTLIB_TIMEOUT          10
+
+// high pulses captured: acknowledge + 40 bits
+#define DHTLIB_PULSES           41
+// a high pulse longer than this (usec) is a one
+#define DHTLIB_ONE_THRESHOLD    40
+
+// extra reads after a checksum or timeout error, and the pause the sensor
+// needs between two reads (msec)
+#define DHTLIB_RETRIES          2
+#define DHTLIB_DHT11_RETRY_DELAY 1000
+#define DHTLIB_DHT_RETRY_DELAY  2000
+
+#ifndef ICACHE_RAM_ATTR
+#define ICACHE_RAM_ATTR
+#endif
+
+class dht
+{
+public:
+    // return values:
+    // DHTLIB_OK
+    // DHTLIB_ERROR_CHECKSUM
+    // DHTLIB_ERROR_TIMEOUT
+    int read11(uint8_t pin);
+    int read(uint8_t pin);
+
+    // non blocking read of a DHT21/22/33/44: startRead() wakes the sensor
+    // up and captures its answer on pin change interrupts, finishRead()
+    // decodes it once readReady(). No retry.
+    void startRead(uint8_t pin);
+    bool readReady();
+    int finishRead();
+
+    inline int read21(uint8_t pin) { return read(pin); };
+    inline int read22(uint8_t pin) { return read(pin); };
+    inline int read33(uint8_t pin) { return read(pin); };
+    inline int read44(uint8_t pin) { return read(pin); };
+
+    double humidity;
+    double temperature;
+
+private:
+    uint8_t bits[5];  // buffer to receive data
+    int _readSensor(uint8_t pin, uint8_t wakeupDelay);
+    void _startCapture(uint8_t pin, uint8_t wakeupDelay);
+    int _finishCapture();
+    int _convert();
+
+    uint8_t _pin;
+    uint32_t _captureStart;
+
+    // capture state shared with the interrupt handler, one sensor at a time
+    static void _edge();
+    static volatile uint8_t _capturePin;
+    static volatile uint8_t _pulses;
+    static volatile uint8_t _pulseWidth[DHTLIB_PULSES];
+    static volatile bool _high;
+    static volatile uint32_t _riseTime;
+};
+#endif
+//
+// END OF FILE
+//
\ No newline at end of file
@@ -0,0 +1,20 @@
+"use strict";
+/**
+ * Loaded function
+ *
+ * @param  {PluginAPI} api The api
+ */
+function loaded(api) {
+    api.init();
+    // Sensor drivers shared by the ESP8266 apps
+    api.iotAPI.registerLib("app", "esp8266-sensors", 1);
+}
+
+module.exports.attributes = {
+    loadedCallback: loaded,
+    name: "esp8266-sensors",
+    version: "0.0.0",
+    category: "iot",
+    description: "ESP8266 sensor drivers",
+    dependencies:["esp8266"]
+};
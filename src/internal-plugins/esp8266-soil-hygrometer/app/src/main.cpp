@@ -6,24 +6,40 @@
 dht DHT;
 #define DHT_PIN 12
 
-String JSON_CONFIG = "%config%";
+// DHT22 needs this long after power on before its first read
+#define DHT_WARMUP 2000
+
 Smarties smarties = Smarties();
 
+int dhtStatus = DHTLIB_OK;
+float soilMoistureValue = 0;
+
+// The A0 burst locks interrupts, so it runs before the DHT capture
+void readSoilMoisture() {
+    soilMoistureValue = ((1000 - smarties.readAnalog()) / 10.0); // In percent
+}
+
+void startDht() {
+    DHT.startRead(DHT_PIN);
+}
+
+boolean dhtReady() {
+    return DHT.readReady();
+}
+
+void finishDht() {
+    dhtStatus = DHT.finishRead();
+}
+
 void transmitSensor() {
-    float soilMoistureValue = 0;
-    delay(2000);
-    for (int i = 0; i < 100; i++) {
-        soilMoistureValue = soilMoistureValue + analogRead(SOIL_MOISTURE_SENSOR_PIN);
-    }
-    soilMoistureValue = ((1000 - (soilMoistureValue / 100.0)) / 10.0); // In percent
+    smarties.acquire();
     if (soilMoistureValue < 0) {
         soilMoistureValue = 0.0;
     }
 
     smarties.postSensorValue("PLANT-SENSOR", soilMoistureValue);
 
-    int chk = DHT.read22(DHT_PIN);
-    switch (chk)
+    switch (dhtStatus)
     {
         case DHTLIB_OK:
             Serial.println("OK,\t");
@@ -51,7 +67,10 @@ void transmitSensor() {
 }
 
 void setup() {
-  smarties.setup(JSON_CONFIG);
+  smarties.setup();
+  pinMode(SOIL_MOISTURE_SENSOR_PIN, INPUT);
+  smarties.addAcquisition(readSoilMoisture);
+  smarties.addAcquisition(startDht, dhtReady, finishDht, DHT_WARMUP);
 }
 
 void loop() {
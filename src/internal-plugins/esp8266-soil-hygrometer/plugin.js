@@ -17,7 +17,7 @@ function loaded(api) {
     wiringSchema.right["D6"].push("DHT22 pin #2");
     wiringSchema.left["SD3"].push("DHT22 pin #1");
     wiringSchema.left["GND-1"].push("DHT22 pin #4");
-    api.iotAPI.registerApp("app", "esp8266-soil-hygrometer", "Nodemcu soil hygrometer for plants", 14, api.iotAPI.constants().PLATFORMS.ESP8266, api.iotAPI.constants().BOARDS.NODEMCU, api.iotAPI.constants().FRAMEWORKS.ARDUINO, ["esp8266"], espPlugin.generateOptions(espPlugin.constants().MODE_DEEP_SLEEP, 6 * 60 * 60), wiringSchema);
+    api.iotAPI.registerApp("app", "esp8266-soil-hygrometer", "Nodemcu soil hygrometer for plants", 15, api.iotAPI.constants().PLATFORMS.ESP8266, api.iotAPI.constants().BOARDS.NODEMCU, api.iotAPI.constants().FRAMEWORKS.ARDUINO, ["esp8266", "esp8266-sensors"], espPlugin.generateOptions(espPlugin.constants().MODE_DEEP_SLEEP, 6 * 60 * 60), wiringSchema);
     api.iotAPI.addIngredientForReceipe("esp8266-soil-hygrometer", "Soil moisture", "A soil moisture sensor or soil hygrometer humidity", 1, true);
     api.iotAPI.addIngredientForReceipe("esp8266-soil-hygrometer", "DHT22", "DHT 22 humidity and temperature sensor", 1, false);
 }
@@ -28,5 +28,5 @@ module.exports.attributes = {
     version: "0.0.0",
     category: "iot",
     description: "ESP Soil hygrometer, temperature and humidity",
-    dependencies:["esp8266"]
+    dependencies:["esp8266", "esp8266-sensors"]
 };
@@ -16,8 +16,25 @@
  ****************************************************/
 
 #include "Adafruit_BMP085.h"
+#include "bmp085_fixed.h"
+
+typedef struct {
+  uint32_t magic;
+  uint8_t calibration[BMP085_CAL_SIZE];
+  uint8_t reserved[2];
+  uint32_t checksum;
+} bmp085_rtc_calibration_t;
+
+static uint32_t calibrationChecksum(const uint8_t *raw) {
+  uint32_t hash = BMP085_RTC_MAGIC;
+  for (uint8_t i = 0; i < BMP085_CAL_SIZE; i++) {
+    hash = (hash << 5) + hash + raw[i];
+  }
+  return hash;
+}
 
 Adafruit_BMP085::Adafruit_BMP085() {
+  _phase = BMP085_IDLE;
 }
 
 
@@ -30,20 +47,14 @@ boolean Adafruit_BMP085::begin(uint8_t mode) {
 
   if (read8(0xD0) != 0x55) return false;
 
-  /* read calibration data */
-  ac1 = read16(BMP085_CAL_AC1);
-  ac2 = read16(BMP085_CAL_AC2);
-  ac3 = read16(BMP085_CAL_AC3);
-  ac4 = read16(BMP085_CAL_AC4);
-  ac5 = read16(BMP085_CAL_AC5);
-  ac6 = read16(BMP085_CAL_AC6);
-
-  b1 = read16(BMP085_CAL_B1);
-  b2 = read16(BMP085_CAL_B2);
-
-  mb = read16(BMP085_CAL_MB);
-  mc = read16(BMP085_CAL_MC);
-  md = read16(BMP085_CAL_MD);
+  /* read calibration data, unless it survived deep sleep in RTC memory */
+  uint8_t raw[BMP085_CAL_SIZE];
+  if (!loadCalibration(raw)) {
+    // AC1 to MD are contiguous, the address auto-increments
+    if (!readBlock(BMP085_CAL_AC1, raw, BMP085_CAL_SIZE)) return false;
+    storeCalibration(raw);
+  }
+  setCalibration(raw);
 #if (BMP085_DEBUG == 1)
   Serial.print("ac1 = "); Serial.println(ac1, DEC);
   Serial.print("ac2 = "); Serial.println(ac2, DEC);
@@ -63,39 +74,101 @@ boolean Adafruit_BMP085::begin(uint8_t mode) {
   return true;
 }
 
+void Adafruit_BMP085::setCalibration(const uint8_t *raw) {
+  ac1 = (raw[0] << 8) | raw[1];
+  ac2 = (raw[2] << 8) | raw[3];
+  ac3 = (raw[4] << 8) | raw[5];
+  ac4 = (raw[6] << 8) | raw[7];
+  ac5 = (raw[8] << 8) | raw[9];
+  ac6 = (raw[10] << 8) | raw[11];
+
+  b1 = (raw[12] << 8) | raw[13];
+  b2 = (raw[14] << 8) | raw[15];
+
+  mb = (raw[16] << 8) | raw[17];
+  mc = (raw[18] << 8) | raw[19];
+  md = (raw[20] << 8) | raw[21];
+}
+
+boolean Adafruit_BMP085::loadCalibration(uint8_t *raw) {
+#ifdef ESP8266
+  bmp085_rtc_calibration_t cache;
+  if (!ESP.rtcUserMemoryRead(BMP085_RTC_OFFSET, (uint32_t *)&cache, sizeof(cache))) return false;
+  if (cache.magic != BMP085_RTC_MAGIC) return false;
+  if (cache.checksum != calibrationChecksum(cache.calibration)) return false;
+  memcpy(raw, cache.calibration, BMP085_CAL_SIZE);
+  return true;
+#else
+  (void)raw;
+  return false;
+#endif
+}
+
+void Adafruit_BMP085::storeCalibration(const uint8_t *raw) {
+#ifdef ESP8266
+  bmp085_rtc_calibration_t cache;
+  memset(&cache, 0, sizeof(cache));
+  cache.magic = BMP085_RTC_MAGIC;
+  memcpy(cache.calibration, raw, BMP085_CAL_SIZE);
+  cache.checksum = calibrationChecksum(raw);
+  ESP.rtcUserMemoryWrite(BMP085_RTC_OFFSET, (uint32_t *)&cache, sizeof(cache));
+#else
+  (void)raw;
+#endif
+}
+
 int32_t Adafruit_BMP085::computeB5(int32_t UT) {
   int32_t X1 = (UT - (int32_t)ac6) * ((int32_t)ac5) >> 15;
   int32_t X2 = ((int32_t)mc << 11) / (X1+(int32_t)md);
   return X1 + X2;
 }
 
+// Worst case pressure conversion time in ms for the oversampling setting
+uint16_t Adafruit_BMP085::pressureConversionTime(void) {
+  if (oversampling == BMP085_ULTRALOWPOWER) 
+    return 5;
+  else if (oversampling == BMP085_STANDARD) 
+    return 8;
+  else if (oversampling == BMP085_HIGHRES) 
+    return 14;
+  else 
+    return 26;
+}
+
 uint16_t Adafruit_BMP085::readRawTemperature(void) {
+  uint16_t raw = 0;
+
+  readRawTemperature(raw);
+  return raw;
+}
+
+boolean Adafruit_BMP085::readRawTemperature(uint16_t &raw) {
   write8(BMP085_CONTROL, BMP085_READTEMPCMD);
   delay(5);
+  if (!read16(BMP085_TEMPDATA, raw)) return false;
 #if BMP085_DEBUG == 1
-  Serial.print("Raw temp: "); Serial.println(read16(BMP085_TEMPDATA));
+  Serial.print("Raw temp: "); Serial.println(raw);
 #endif
-  return read16(BMP085_TEMPDATA);
+  return true;
 }
 
 uint32_t Adafruit_BMP085::readRawPressure(void) {
-  uint32_t raw;
+  uint32_t raw = 0;
 
-  write8(BMP085_CONTROL, BMP085_READPRESSURECMD + (oversampling << 6));
+  readRawPressure(raw);
+  return raw;
+}
 
-  if (oversampling == BMP085_ULTRALOWPOWER) 
-    delay(5);
-  else if (oversampling == BMP085_STANDARD) 
-    delay(8);
-  else if (oversampling == BMP085_HIGHRES) 
-    delay(14);
-  else 
-    delay(26);
+boolean Adafruit_BMP085::readRawPressure(uint32_t &raw) {
+  uint8_t data[3] = { 0, 0, 0 };
 
-  raw = read16(BMP085_PRESSUREDATA);
+  write8(BMP085_CONTROL, BMP085_READPRESSURECMD + (oversampling << 6));
+
+  delay(pressureConversionTime());
 
-  raw <<= 8;
-  raw |= read8(BMP085_PRESSUREDATA+2);
+  // MSB, LSB and XLSB in one transfer
+  if (!readBlock(BMP085_PRESSUREDATA, data, 3)) return false;
+  raw = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
   raw >>= (8 - oversampling);
 
  /* this pull broke stuff, look at it later?
@@ -109,17 +182,23 @@ uint32_t Adafruit_BMP085::readRawPressure(void) {
 #if BMP085_DEBUG == 1
   Serial.print("Raw pressure: "); Serial.println(raw);
 #endif
-  return raw;
+  return true;
 }
 
 
 int32_t Adafruit_BMP085::readPressure(void) {
-  int32_t UT, UP, B3, B5, B6, X1, X2, X3, p;
-  uint32_t B4, B7;
+  int32_t UT, UP;
 
   UT = readRawTemperature();
   UP = readRawPressure();
 
+  return computePressure(UT, UP);
+}
+
+int32_t Adafruit_BMP085::computePressure(int32_t UT, int32_t UP) {
+  int32_t B3, B5, B6, X1, X2, X3, p;
+  uint32_t B4, B7;
+
 #if BMP085_DEBUG == 1
   // use datasheet numbers!
   UT = 27898;
@@ -195,8 +274,8 @@ int32_t Adafruit_BMP085::readPressure(void) {
 }
 
 int32_t Adafruit_BMP085::readSealevelPressure(float altitude_meters) {
-  float pressure = readPressure();
-  return (int32_t)(pressure / pow(1.0-altitude_meters/44330, 5.255));
+  int32_t pressure = readPressure();
+  return bmp085_sealevel_pressure(pressure, (int32_t)(altitude_meters * 100));
 }
 
 float Adafruit_BMP085::readTemperature(void) {
@@ -221,12 +300,82 @@ float Adafruit_BMP085::readTemperature(void) {
   return temp;
 }
 
+boolean Adafruit_BMP085::readAll(bmp085_measurement_t &measurement, float sealevelPressure) {
+  uint16_t UT;
+  uint32_t UP;
+  int32_t B5;
+
+  // Nothing answered on the bus
+  if (!readRawTemperature(UT) || !readRawPressure(UP)) return false;
+
+  B5 = computeB5(UT);
+  measurement.temperature = ((B5+8) >> 4) / 10.0f;
+  measurement.pressure = computePressure(UT, UP);
+  measurement.altitude = bmp085_altitude_mm(measurement.pressure, (int32_t)sealevelPressure) / 1000.0f;
+
+  return true;
+}
+
+void Adafruit_BMP085::startMeasurement(void) {
+  write8(BMP085_CONTROL, BMP085_READTEMPCMD);
+  _phase = BMP085_CONVERTING_TEMPERATURE;
+  _phaseStart = millis();
+}
+
+boolean Adafruit_BMP085::measurementReady(void) {
+  // A conversion started in the middle of a millisecond tick may end up to
+  // 1 ms after the nominal time, hence the strict comparisons
+  if (_phase == BMP085_CONVERTING_TEMPERATURE) {
+    if (millis() - _phaseStart <= 5) return false;
+
+    if (!read16(BMP085_TEMPDATA, _UT)) {
+      _phase = BMP085_FAILED;  // nothing answered on the bus
+      return true;
+    }
+
+    write8(BMP085_CONTROL, BMP085_READPRESSURECMD + (oversampling << 6));
+    _phase = BMP085_CONVERTING_PRESSURE;
+    _phaseStart = millis();
+    return false;
+  }
+
+  if (_phase == BMP085_CONVERTING_PRESSURE) {
+    return millis() - _phaseStart > pressureConversionTime();
+  }
+
+  return true;
+}
+
+boolean Adafruit_BMP085::finishMeasurement(bmp085_measurement_t &measurement, float sealevelPressure) {
+  uint8_t data[3] = { 0, 0, 0 };
+  int32_t UP, B5;
+
+  while (!measurementReady()) {
+    yield();
+  }
+  if (_phase != BMP085_CONVERTING_PRESSURE) {
+    _phase = BMP085_IDLE;
+    return false;
+  }
+  _phase = BMP085_IDLE;
+
+  if (!readBlock(BMP085_PRESSUREDATA, data, 3)) return false;
+  UP = (((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2]) >> (8 - oversampling);
+
+  B5 = computeB5(_UT);
+  measurement.temperature = ((B5+8) >> 4) / 10.0f;
+  measurement.pressure = computePressure(_UT, UP);
+  measurement.altitude = bmp085_altitude_mm(measurement.pressure, (int32_t)sealevelPressure) / 1000.0f;
+
+  return true;
+}
+
 float Adafruit_BMP085::readAltitude(float sealevelPressure) {
   float altitude;
 
-  float pressure = readPressure();
+  int32_t pressure = readPressure();
 
-  altitude = 44330 * (1.0 - pow(pressure /sealevelPressure,0.1903));
+  altitude = bmp085_altitude_mm(pressure, (int32_t)sealevelPressure) / 1000.0f;
 
   return altitude;
 }
@@ -235,53 +384,51 @@ float Adafruit_BMP085::readAltitude(float sealevelPressure) {
 /*********************************************************************/
 
 uint8_t Adafruit_BMP085::read8(uint8_t a) {
-  uint8_t ret;
+  uint8_t ret = 0;
 
-  Wire.beginTransmission(BMP085_I2CADDR); // start transmission to device 
-#if (ARDUINO >= 100)
-  Wire.write(a); // sends register address to read from
-#else
-  Wire.send(a); // sends register address to read from
-#endif
-  Wire.endTransmission(); // end transmission
-  
-  Wire.beginTransmission(BMP085_I2CADDR); // start transmission to device 
-  Wire.requestFrom(BMP085_I2CADDR, 1);// send data n-bytes read
-#if (ARDUINO >= 100)
-  ret = Wire.read(); // receive DATA
-#else
-  ret = Wire.receive(); // receive DATA
-#endif
-  Wire.endTransmission(); // end transmission
+  readBlock(a, &ret, 1);
 
   return ret;
 }
 
 uint16_t Adafruit_BMP085::read16(uint8_t a) {
-  uint16_t ret;
+  uint16_t ret = 0;
+
+  read16(a, ret);
+
+  return ret;
+}
+
+boolean Adafruit_BMP085::read16(uint8_t a, uint16_t &value) {
+  uint8_t data[2] = { 0, 0 };
 
+  if (!readBlock(a, data, 2)) return false;
+  value = ((uint16_t)data[0] << 8) | data[1];
+
+  return true;
+}
+
+// One register address write followed by one read of length bytes, the
+// BMP085 increments the register address after each byte
+boolean Adafruit_BMP085::readBlock(uint8_t a, uint8_t *buffer, uint8_t length) {
   Wire.beginTransmission(BMP085_I2CADDR); // start transmission to device 
 #if (ARDUINO >= 100)
   Wire.write(a); // sends register address to read from
 #else
   Wire.send(a); // sends register address to read from
 #endif
-  Wire.endTransmission(); // end transmission
-  
-  Wire.beginTransmission(BMP085_I2CADDR); // start transmission to device 
-  Wire.requestFrom(BMP085_I2CADDR, 2);// send data n-bytes read
+  if (Wire.endTransmission() != 0) return false; // end transmission
+
+  if (Wire.requestFrom((uint8_t)BMP085_I2CADDR, length) != length) return false;// send data n-bytes read
+  for (uint8_t i = 0; i < length; i++) {
 #if (ARDUINO >= 100)
-  ret = Wire.read(); // receive DATA
-  ret <<= 8;
-  ret |= Wire.read(); // receive DATA
+    buffer[i] = Wire.read(); // receive DATA
 #else
-  ret = Wire.receive(); // receive DATA
-  ret <<= 8;
-  ret |= Wire.receive(); // receive DATA
+    buffer[i] = Wire.receive(); // receive DATA
 #endif
-  Wire.endTransmission(); // end transmission
+  }
 
-  return ret;
+  return true;
 }
 
 void Adafruit_BMP085::write8(uint8_t a, uint8_t d) {
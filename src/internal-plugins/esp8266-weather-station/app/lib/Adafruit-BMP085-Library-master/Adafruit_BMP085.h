@@ -51,6 +51,29 @@
 #define BMP085_READTEMPCMD          0x2E
 #define BMP085_READPRESSURECMD            0x34
 
+// Conversion state of startMeasurement() / measurementReady()
+#define BMP085_IDLE                    0
+#define BMP085_CONVERTING_TEMPERATURE  1
+#define BMP085_CONVERTING_PRESSURE     2
+#define BMP085_FAILED                  3
+
+#define BMP085_CAL_SIZE          22    // AC1 to MD, big endian
+
+// Calibration is kept in RTC user memory across deep sleep, 32 bytes at
+// this block offset (4 bytes per block, blocks 0 to 127)
+#ifndef BMP085_RTC_OFFSET
+#define BMP085_RTC_OFFSET        120
+#endif
+#define BMP085_RTC_MAGIC         0x42503835
+
+// Temperature, pressure and altitude computed from one temperature and one
+// pressure conversion
+typedef struct {
+  float temperature;    // *C
+  int32_t pressure;     // Pa
+  float altitude;       // meters
+} bmp085_measurement_t;
+
 
 class Adafruit_BMP085 {
  public:
@@ -60,17 +83,39 @@ class Adafruit_BMP085 {
   int32_t readPressure(void);
   int32_t readSealevelPressure(float altitude_meters = 0);
   float readAltitude(float sealevelPressure = 101325); // std atmosphere
+  boolean readAll(bmp085_measurement_t &measurement, float sealevelPressure = 101325);
+  // Same measurement as readAll() without blocking: startMeasurement()
+  // starts the temperature conversion, measurementReady() chains the pressure
+  // conversion and returns true once it is done (or failed), then
+  // finishMeasurement() reads and computes the result
+  void startMeasurement(void);
+  boolean measurementReady(void);
+  boolean finishMeasurement(bmp085_measurement_t &measurement, float sealevelPressure = 101325);
   uint16_t readRawTemperature(void);
   uint32_t readRawPressure(void);
   
  private:
+  uint16_t pressureConversionTime(void);
   int32_t computeB5(int32_t UT);
+  int32_t computePressure(int32_t UT, int32_t UP);
+  void setCalibration(const uint8_t *raw);
+  boolean loadCalibration(uint8_t *raw);
+  // Same as the public reads, false when the sensor did not answer
+  boolean readRawTemperature(uint16_t &raw);
+  boolean readRawPressure(uint32_t &raw);
+  void storeCalibration(const uint8_t *raw);
   uint8_t read8(uint8_t addr);
   uint16_t read16(uint8_t addr);
+  boolean read16(uint8_t addr, uint16_t &value);
+  boolean readBlock(uint8_t addr, uint8_t *buffer, uint8_t length);
   void write8(uint8_t addr, uint8_t data);
 
   uint8_t oversampling;
 
+  uint8_t _phase;
+  uint32_t _phaseStart;
+  uint16_t _UT;
+
   int16_t ac1, ac2, ac3, b1, b2, mb, mc, md;
   uint16_t ac4, ac5, ac6;
 };
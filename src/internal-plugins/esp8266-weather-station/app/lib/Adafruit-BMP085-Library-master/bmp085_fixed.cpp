@@ -0,0 +1,168 @@
+/***************************************************
+  Barometric formula for the BMP085 in fixed point, see bmp085_fixed.h
+ ****************************************************/
+
+#include "bmp085_fixed.h"
+
+#if defined(ARDUINO)
+ #include "Arduino.h"
+#else
+ #define PROGMEM
+ #define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#endif
+
+#define BMP085_FIXED_SHIFT    24
+#define BMP085_TABLE_BITS     8
+
+#define BMP085_EXPONENT       3192704L    // 1 / 5.255 with 24 fractional bits
+#define BMP085_EXPONENT_INV   88164270L   // 5.255 with 24 fractional bits
+#define BMP085_ALTITUDE_MM    44330000L   // 44330 m
+#define BMP085_ALTITUDE_CM    4433000L
+
+// log2(1 + i / 256) with 24 fractional bits
+static const uint32_t LOG2_TABLE[] PROGMEM = {
+  0x00000000UL, 0x0001709CUL, 0x0002DFCAUL, 0x00044D8CUL, 0x0005B9E6UL, 0x000724D9UL,
+  0x00088E69UL, 0x0009F698UL, 0x000B5D6AUL, 0x000CC2E0UL, 0x000E26FDUL, 0x000F89C5UL,
+  0x0010EB39UL, 0x00124B5BUL, 0x0013AA30UL, 0x001507B8UL, 0x001663F7UL, 0x0017BEEFUL,
+  0x001918A1UL, 0x001A7112UL, 0x001BC842UL, 0x001D1E35UL, 0x001E72ECUL, 0x001FC66AUL,
+  0x002118B1UL, 0x002269C3UL, 0x0023B9A3UL, 0x00250853UL, 0x002655D4UL, 0x0027A229UL,
+  0x0028ED54UL, 0x002A3757UL, 0x002B8034UL, 0x002CC7EEUL, 0x002E0E86UL, 0x002F53FEUL,
+  0x00309858UL, 0x0031DB96UL, 0x00331DBAUL, 0x00345EC6UL, 0x00359EBCUL, 0x0036DD9EUL,
+  0x00381B6EUL, 0x0039582CUL, 0x003A93DDUL, 0x003BCE80UL, 0x003D0818UL, 0x003E40A6UL,
+  0x003F782DUL, 0x0040AEAFUL, 0x0041E42BUL, 0x004318A6UL, 0x00444C1FUL, 0x00457E9AUL,
+  0x0046B017UL, 0x0047E098UL, 0x0049101FUL, 0x004A3EADUL, 0x004B6C44UL, 0x004C98E6UL,
+  0x004DC493UL, 0x004EEF4FUL, 0x00501919UL, 0x005141F4UL, 0x005269E1UL, 0x005390E2UL,
+  0x0054B6F8UL, 0x0055DC24UL, 0x00570069UL, 0x005823C7UL, 0x00594640UL, 0x005A67D5UL,
+  0x005B8887UL, 0x005CA859UL, 0x005DC74BUL, 0x005EE55FUL, 0x00600296UL, 0x00611EF1UL,
+  0x00623A72UL, 0x0063551AUL, 0x00646EEAUL, 0x006587E4UL, 0x0066A009UL, 0x0067B75AUL,
+  0x0068CDD8UL, 0x0069E385UL, 0x006AF862UL, 0x006C0C70UL, 0x006D1FB0UL, 0x006E3223UL,
+  0x006F43CCUL, 0x007054AAUL, 0x007164BFUL, 0x0072740CUL, 0x00738292UL, 0x00749053UL,
+  0x00759D50UL, 0x0076A989UL, 0x0077B4FFUL, 0x0078BFB5UL, 0x0079C9ABUL, 0x007AD2E1UL,
+  0x007BDB5AUL, 0x007CE316UL, 0x007DEA16UL, 0x007EF05BUL, 0x007FF5E6UL, 0x0080FAB9UL,
+  0x0081FED4UL, 0x00830239UL, 0x008404E8UL, 0x008506E2UL, 0x00860828UL, 0x008708BCUL,
+  0x0088089EUL, 0x008907CFUL, 0x008A0650UL, 0x008B0422UL, 0x008C0146UL, 0x008CFDBEUL,
+  0x008DF989UL, 0x008EF4A9UL, 0x008FEF1FUL, 0x0090E8EBUL, 0x0091E20FUL, 0x0092DA8BUL,
+  0x0093D260UL, 0x0094C990UL, 0x0095C01AUL, 0x0096B601UL, 0x0097AB44UL, 0x00989FE4UL,
+  0x009993E3UL, 0x009A8742UL, 0x009B7A00UL, 0x009C6C1FUL, 0x009D5DA0UL, 0x009E4E83UL,
+  0x009F3ECAUL, 0x00A02E74UL, 0x00A11D84UL, 0x00A20BF9UL, 0x00A2F9D5UL, 0x00A3E718UL,
+  0x00A4D3C2UL, 0x00A5BFD6UL, 0x00A6AB53UL, 0x00A7963AUL, 0x00A8808CUL, 0x00A96A4AUL,
+  0x00AA5374UL, 0x00AB3C0CUL, 0x00AC2411UL, 0x00AD0B85UL, 0x00ADF268UL, 0x00AED8BCUL,
+  0x00AFBE80UL, 0x00B0A3B5UL, 0x00B1885CUL, 0x00B26C77UL, 0x00B35004UL, 0x00B43306UL,
+  0x00B5157DUL, 0x00B5F769UL, 0x00B6D8CBUL, 0x00B7B9A4UL, 0x00B899F5UL, 0x00B979BDUL,
+  0x00BA58FFUL, 0x00BB37B9UL, 0x00BC15EEUL, 0x00BCF39DUL, 0x00BDD0C8UL, 0x00BEAD6EUL,
+  0x00BF8991UL, 0x00C06531UL, 0x00C1404FUL, 0x00C21AEBUL, 0x00C2F506UL, 0x00C3CEA0UL,
+  0x00C4A7BAUL, 0x00C58055UL, 0x00C65872UL, 0x00C73010UL, 0x00C80731UL, 0x00C8DDD4UL,
+  0x00C9B3FBUL, 0x00CA89A7UL, 0x00CB5ED7UL, 0x00CC338CUL, 0x00CD07C7UL, 0x00CDDB88UL,
+  0x00CEAED0UL, 0x00CF819FUL, 0x00D053F7UL, 0x00D125D7UL, 0x00D1F740UL, 0x00D2C832UL,
+  0x00D398AFUL, 0x00D468B6UL, 0x00D53848UL, 0x00D60765UL, 0x00D6D60FUL, 0x00D7A446UL,
+  0x00D87209UL, 0x00D93F5AUL, 0x00DA0C3AUL, 0x00DAD8A8UL, 0x00DBA4A4UL, 0x00DC7031UL,
+  0x00DD3B4EUL, 0x00DE05FBUL, 0x00DED039UL, 0x00DF9A09UL, 0x00E0636AUL, 0x00E12C5EUL,
+  0x00E1F4E5UL, 0x00E2BCFFUL, 0x00E384ADUL, 0x00E44BF0UL, 0x00E512C7UL, 0x00E5D933UL,
+  0x00E69F35UL, 0x00E764CDUL, 0x00E829FBUL, 0x00E8EEC1UL, 0x00E9B31EUL, 0x00EA7712UL,
+  0x00EB3A9FUL, 0x00EBFDC5UL, 0x00ECC083UL, 0x00ED82DBUL, 0x00EE44CDUL, 0x00EF065AUL,
+  0x00EFC781UL, 0x00F08843UL, 0x00F148A1UL, 0x00F2089BUL, 0x00F2C832UL, 0x00F38765UL,
+  0x00F44636UL, 0x00F504A4UL, 0x00F5C2B0UL, 0x00F6805AUL, 0x00F73DA4UL, 0x00F7FA8CUL,
+  0x00F8B714UL, 0x00F9733CUL, 0x00FA2F04UL, 0x00FAEA6DUL, 0x00FBA578UL, 0x00FC6023UL,
+  0x00FD1A71UL, 0x00FDD460UL, 0x00FE8DF2UL, 0x00FF4728UL, 0x01000000UL
+};
+
+// 2 ^ (i / 256) with 30 fractional bits
+static const uint32_t EXP2_TABLE[] PROGMEM = {
+  0x40000000UL, 0x402C6BE9UL, 0x4058F6A8UL, 0x4085A051UL, 0x40B268FAUL, 0x40DF50B8UL,
+  0x410C57A2UL, 0x41397DCCUL, 0x4166C34CUL, 0x41942839UL, 0x41C1ACA7UL, 0x41EF50AEUL,
+  0x421D1462UL, 0x424AF7DAUL, 0x4278FB2BUL, 0x42A71E6CUL, 0x42D561B4UL, 0x4303C518UL,
+  0x433248AEUL, 0x4360EC8DUL, 0x438FB0CBUL, 0x43BE957FUL, 0x43ED9AC0UL, 0x441CC0A3UL,
+  0x444C0740UL, 0x447B6EADUL, 0x44AAF702UL, 0x44DAA054UL, 0x450A6ABBUL, 0x453A564DUL,
+  0x456A6323UL, 0x459A9152UL, 0x45CAE0F2UL, 0x45FB521AUL, 0x462BE4E2UL, 0x465C9961UL,
+  0x468D6FAEUL, 0x46BE67E0UL, 0x46EF8210UL, 0x4720BE55UL, 0x47521CC6UL, 0x47839D7BUL,
+  0x47B5408CUL, 0x47E70611UL, 0x4818EE22UL, 0x484AF8D6UL, 0x487D2646UL, 0x48AF768AUL,
+  0x48E1E9BAUL, 0x49147FEEUL, 0x4947393FUL, 0x497A15C4UL, 0x49AD1598UL, 0x49E038D0UL,
+  0x4A137F88UL, 0x4A46E9D6UL, 0x4A7A77D4UL, 0x4AAE299BUL, 0x4AE1FF43UL, 0x4B15F8E6UL,
+  0x4B4A169CUL, 0x4B7E587EUL, 0x4BB2BEA5UL, 0x4BE7492BUL, 0x4C1BF829UL, 0x4C50CBB8UL,
+  0x4C85C3F1UL, 0x4CBAE0EFUL, 0x4CF022CAUL, 0x4D25899CUL, 0x4D5B157EUL, 0x4D90C68BUL,
+  0x4DC69CDDUL, 0x4DFC988CUL, 0x4E32B9B4UL, 0x4E69006EUL, 0x4E9F6CD4UL, 0x4ED5FF00UL,
+  0x4F0CB70CUL, 0x4F439514UL, 0x4F7A9930UL, 0x4FB1C37CUL, 0x4FE91413UL, 0x50208B0EUL,
+  0x50582888UL, 0x508FEC9CUL, 0x50C7D765UL, 0x50FFE8FEUL, 0x51382182UL, 0x5170810BUL,
+  0x51A907B4UL, 0x51E1B59AUL, 0x521A8AD7UL, 0x52538786UL, 0x528CABC3UL, 0x52C5F7AAUL,
+  0x52FF6B55UL, 0x533906E0UL, 0x5372CA68UL, 0x53ACB607UL, 0x53E6C9DAUL, 0x542105FDUL,
+  0x545B6A8BUL, 0x5495F7A1UL, 0x54D0AD5AUL, 0x550B8BD4UL, 0x55469329UL, 0x5581C378UL,
+  0x55BD1CDBUL, 0x55F89F70UL, 0x56344B52UL, 0x567020A0UL, 0x56AC1F75UL, 0x56E847EFUL,
+  0x57249A29UL, 0x57611642UL, 0x579DBC57UL, 0x57DA8C83UL, 0x581786E6UL, 0x5854AB9BUL,
+  0x5891FAC1UL, 0x58CF7474UL, 0x590D18D3UL, 0x594AE7FBUL, 0x5988E209UL, 0x59C7071CUL,
+  0x5A055751UL, 0x5A43D2C6UL, 0x5A82799AUL, 0x5AC14BEAUL, 0x5B0049D4UL, 0x5B3F7377UL,
+  0x5B7EC8F2UL, 0x5BBE4A61UL, 0x5BFDF7E5UL, 0x5C3DD19CUL, 0x5C7DD7A4UL, 0x5CBE0A1CUL,
+  0x5CFE6923UL, 0x5D3EF4D7UL, 0x5D7FAD59UL, 0x5DC092C7UL, 0x5E01A53FUL, 0x5E42E4E3UL,
+  0x5E8451D0UL, 0x5EC5EC26UL, 0x5F07B405UL, 0x5F49A98CUL, 0x5F8BCCDBUL, 0x5FCE1E12UL,
+  0x60109D51UL, 0x60534AB7UL, 0x60962665UL, 0x60D9307BUL, 0x611C6919UL, 0x615FD05EUL,
+  0x61A3666DUL, 0x61E72B65UL, 0x622B1F66UL, 0x626F4292UL, 0x62B39509UL, 0x62F816EBUL,
+  0x633CC85BUL, 0x6381A978UL, 0x63C6BA64UL, 0x640BFB41UL, 0x64516C2EUL, 0x64970D4FUL,
+  0x64DCDEC3UL, 0x6522E0ADUL, 0x6569132FUL, 0x65AF766AUL, 0x65F60A7FUL, 0x663CCF92UL,
+  0x6683C5C3UL, 0x66CAED35UL, 0x6712460BUL, 0x6759D065UL, 0x67A18C68UL, 0x67E97A34UL,
+  0x683199EDUL, 0x6879EBB6UL, 0x68C26FB1UL, 0x690B2601UL, 0x69540EC9UL, 0x699D2A2CUL,
+  0x69E6784DUL, 0x6A2FF94FUL, 0x6A79AD56UL, 0x6AC39485UL, 0x6B0DAEFFUL, 0x6B57FCE9UL,
+  0x6BA27E65UL, 0x6BED3399UL, 0x6C381CA6UL, 0x6C8339B2UL, 0x6CCE8AE1UL, 0x6D1A1057UL,
+  0x6D65CA38UL, 0x6DB1B8A8UL, 0x6DFDDBCCUL, 0x6E4A33C9UL, 0x6E96C0C3UL, 0x6EE382DEUL,
+  0x6F307A41UL, 0x6F7DA710UL, 0x6FCB096FUL, 0x7018A185UL, 0x70666F76UL, 0x70B47368UL,
+  0x7102AD80UL, 0x71511DE4UL, 0x719FC4B9UL, 0x71EEA226UL, 0x723DB650UL, 0x728D015DUL,
+  0x72DC8374UL, 0x732C3CBAUL, 0x737C2D55UL, 0x73CC556DUL, 0x741CB528UL, 0x746D4CACUL,
+  0x74BE1C20UL, 0x750F23ABUL, 0x75606374UL, 0x75B1DBA2UL, 0x76038C5BUL, 0x765575C8UL,
+  0x76A7980FUL, 0x76F9F359UL, 0x774C87CCUL, 0x779F5590UL, 0x77F25CCEUL, 0x78459DACUL,
+  0x78991854UL, 0x78ECCCECUL, 0x7940BB9EUL, 0x7994E492UL, 0x79E947EFUL, 0x7A3DE5DFUL,
+  0x7A92BE8BUL, 0x7AE7D21AUL, 0x7B3D20B6UL, 0x7B92AA88UL, 0x7BE86FBAUL, 0x7C3E7073UL,
+  0x7C94ACDEUL, 0x7CEB2523UL, 0x7D41D96EUL, 0x7D98C9E6UL, 0x7DEFF6B6UL, 0x7E476009UL,
+  0x7E9F0606UL, 0x7EF6E8DAUL, 0x7F4F08AEUL, 0x7FA765ADUL, 0x80000000UL
+};
+
+int32_t bmp085_log2(uint32_t x) {
+  if (x == 0) return INT32_MIN;
+
+  // Leading one moved to bit 31
+  int32_t exponent = 31 - __builtin_clz(x);
+  x <<= 31 - exponent;
+
+  // 31 fraction bits below the leading one, the top ones pick the segment
+  uint32_t fraction = x & 0x7FFFFFFFUL;
+  uint32_t index = fraction >> (31 - BMP085_TABLE_BITS);
+  uint32_t rest = fraction & ((1UL << (31 - BMP085_TABLE_BITS)) - 1);
+  uint32_t low = pgm_read_dword(&LOG2_TABLE[index]);
+  uint32_t high = pgm_read_dword(&LOG2_TABLE[index + 1]);
+
+  return ((int32_t)exponent << BMP085_FIXED_SHIFT) + low + (uint32_t)(((uint64_t)(high - low) * rest) >> (31 - BMP085_TABLE_BITS));
+}
+
+uint32_t bmp085_exp2(int32_t x) {
+  if (x < 0) return 0;
+  int32_t exponent = x >> BMP085_FIXED_SHIFT;
+  if (exponent > 31) return UINT32_MAX;
+
+  uint32_t fraction = x & ((1UL << BMP085_FIXED_SHIFT) - 1);
+  uint32_t index = fraction >> (BMP085_FIXED_SHIFT - BMP085_TABLE_BITS);
+  uint32_t rest = fraction & ((1UL << (BMP085_FIXED_SHIFT - BMP085_TABLE_BITS)) - 1);
+  uint32_t low = pgm_read_dword(&EXP2_TABLE[index]);
+  uint32_t high = pgm_read_dword(&EXP2_TABLE[index + 1]);
+  uint64_t mantissa = low + (((uint64_t)(high - low) * rest) >> (BMP085_FIXED_SHIFT - BMP085_TABLE_BITS));
+
+  // Mantissa has 30 fractional bits, round to an integer
+  return (uint32_t)(((mantissa << exponent) + (1UL << 29)) >> 30);
+}
+
+int32_t bmp085_altitude_mm(int32_t pressure, int32_t sealevelPressure) {
+  if (pressure <= 0 || sealevelPressure <= 0) return 0;
+
+  // (p / p0) ^ (1 / 5.255) scaled by 2 ^ 30
+  int32_t ratio = bmp085_log2(pressure) - bmp085_log2(sealevelPressure);
+  int32_t scaled = (int32_t)(((int64_t)ratio * BMP085_EXPONENT) >> BMP085_FIXED_SHIFT);
+  int64_t power = bmp085_exp2(scaled + (30L << BMP085_FIXED_SHIFT));
+
+  return (int32_t)(((int64_t)BMP085_ALTITUDE_MM * ((1LL << 30) - power)) >> 30);
+}
+
+int32_t bmp085_sealevel_pressure(int32_t pressure, int32_t altitude_cm) {
+  if (pressure <= 0 || altitude_cm >= BMP085_ALTITUDE_CM) return 0;
+
+  // p * (1 - h / 44330) ^ -5.255
+  int32_t ratio = bmp085_log2(BMP085_ALTITUDE_CM - altitude_cm) - bmp085_log2(BMP085_ALTITUDE_CM);
+  int32_t scaled = (int32_t)(((int64_t)ratio * BMP085_EXPONENT_INV) >> BMP085_FIXED_SHIFT);
+
+  return (int32_t)bmp085_exp2(bmp085_log2(pressure) - scaled);
+}
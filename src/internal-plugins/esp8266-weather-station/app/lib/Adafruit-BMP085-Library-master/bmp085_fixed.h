@@ -0,0 +1,29 @@
+/***************************************************
+  Barometric formula for the BMP085 in fixed point
+
+  altitude = 44330 * (1 - (p / p0) ^ (1 / 5.255))
+  p0 = p / (1 - altitude / 44330) ^ 5.255
+
+  x ^ a is evaluated as 2 ^ (a * log2(x)) with 256 segment tables for
+  log2 and 2 ^ x and linear interpolation, so no libm pow() is needed on
+  FPU-less targets. test/ checks the error against the double precision
+  formula on the host.
+ ****************************************************/
+
+#ifndef BMP085_FIXED_H
+#define BMP085_FIXED_H
+
+#include <stdint.h>
+
+// Altitude in millimeters for a pressure and a sea level pressure in Pa
+int32_t bmp085_altitude_mm(int32_t pressure, int32_t sealevelPressure);
+
+// Sea level pressure in Pa for a pressure in Pa measured at an altitude
+// in centimeters
+int32_t bmp085_sealevel_pressure(int32_t pressure, int32_t altitude_cm);
+
+// log2(x) and 2 ^ x with 24 fractional bits, exposed for the tests
+int32_t bmp085_log2(uint32_t x);
+uint32_t bmp085_exp2(int32_t x);
+
+#endif //  BMP085_FIXED_H
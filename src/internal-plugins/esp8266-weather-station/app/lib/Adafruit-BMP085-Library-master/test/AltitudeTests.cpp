@@ -0,0 +1,149 @@
+// Fixed-point barometric formula against the float formula the driver used
+// before, over the range a BMP085 can measure (300 to 1100 hPa)
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "bmp085_fixed.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                 \
+  do {                                                                   \
+    if (!(condition)) {                                                  \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                        \
+    }                                                                    \
+  } while (0)
+
+// Worst case errors accepted
+#define MAX_ALTITUDE_ERROR_M      0.1
+#define MAX_SEALEVEL_ERROR_PA     2.0
+
+static double referenceAltitude(double pressure, double sealevelPressure)
+{
+  return 44330 * (1.0 - pow(pressure / sealevelPressure, 0.1903));
+}
+
+static double referenceSealevel(double pressure, double altitude)
+{
+  return pressure / pow(1.0 - altitude / 44330, 5.255);
+}
+
+static double seconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void log2AndExp2()
+{
+  double worstLog = 0;
+  for (uint32_t x = 1; x < 0x7FFFFFFFUL; x += x / 2 + 1) {
+    double error = fabs(bmp085_log2(x) / 16777216.0 - log2((double)x));
+    worstLog = fmax(worstLog, error);
+  }
+  double worstExp = 0;
+  for (int32_t x = 0; x < (30L << 24); x += 77777) {
+    double expected = exp2(x / 16777216.0);
+    double error = fabs(bmp085_exp2(x) - expected) / expected;
+    // Results are rounded to integers
+    if (expected > 1e6) {
+      worstExp = fmax(worstExp, error);
+    }
+  }
+  printf("  log2 max error %.2e, exp2 max relative error %.2e\n", worstLog, worstExp);
+  CHECK(worstLog < 2e-5);
+  CHECK(worstExp < 2e-5);
+  CHECK(bmp085_exp2(16L << 24) == 65536);
+  CHECK(bmp085_log2(1024) == (10L << 24));
+}
+
+static void altitudeAccuracy()
+{
+  double worst = 0;
+  int32_t worstPressure = 0;
+  int32_t worstSealevel = 0;
+  for (int32_t sealevel = 95000; sealevel <= 105000; sealevel += 1250) {
+    for (int32_t pressure = 30000; pressure <= 110000; pressure += 37) {
+      double error = fabs(bmp085_altitude_mm(pressure, sealevel) / 1000.0 - referenceAltitude(pressure, sealevel));
+      if (error > worst) {
+        worst = error;
+        worstPressure = pressure;
+        worstSealevel = sealevel;
+      }
+    }
+  }
+  printf("  altitude max error %.3f m (p=%d, p0=%d)\n", worst, worstPressure, worstSealevel);
+  CHECK(worst < MAX_ALTITUDE_ERROR_M);
+  CHECK(bmp085_altitude_mm(101325, 101325) == 0);
+}
+
+static void sealevelAccuracy()
+{
+  double worst = 0;
+  int32_t worstPressure = 0;
+  int32_t worstAltitude = 0;
+  for (int32_t altitude = -40000; altitude <= 900000; altitude += 1111) {
+    for (int32_t pressure = 30000; pressure <= 110000; pressure += 997) {
+      double expected = referenceSealevel(pressure, altitude / 100.0);
+      if (expected > 120000) {
+        continue;
+      }
+      double error = fabs(bmp085_sealevel_pressure(pressure, altitude) - expected);
+      if (error > worst) {
+        worst = error;
+        worstPressure = pressure;
+        worstAltitude = altitude;
+      }
+    }
+  }
+  printf("  sea level max error %.2f Pa (p=%d, h=%d cm)\n", worst, worstPressure, worstAltitude);
+  CHECK(worst < MAX_SEALEVEL_ERROR_PA);
+}
+
+static void speed()
+{
+  const int iterations = 2000000;
+  volatile float sinkFloat = 0;
+  volatile int32_t sinkFixed = 0;
+
+  double start = seconds();
+  for (int i = 0; i < iterations; i++) {
+    float pressure = 90000 + (i & 0x3FFF);
+    sinkFloat = 44330 * (1.0 - pow(pressure / 101325.0f, 0.1903));
+  }
+  double floatTime = seconds() - start;
+
+  start = seconds();
+  for (int i = 0; i < iterations; i++) {
+    sinkFixed = bmp085_altitude_mm(90000 + (i & 0x3FFF), 101325);
+  }
+  double fixedTime = seconds() - start;
+
+  // Informative only, the host has an FPU the ESP8266 lacks
+  printf("  altitude: pow() %.1f ns/call, fixed point %.1f ns/call\n",
+         floatTime * 1e9 / iterations, fixedTime * 1e9 / iterations);
+  (void)sinkFloat;
+  (void)sinkFixed;
+}
+
+int main()
+{
+  printf("== log2AndExp2\n");
+  log2AndExp2();
+  printf("== altitudeAccuracy\n");
+  altitudeAccuracy();
+  printf("== sealevelAccuracy\n");
+  sealevelAccuracy();
+  printf("== speed\n");
+  speed();
+
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -17,14 +17,55 @@ Adafruit_BMP085 bmp;
 
 
 
-String JSON_CONFIG = "%config%";
+// DHT22 needs this long after power on before its first read
+#define DHT_WARMUP 2000
+
 Smarties smarties = Smarties();
 
+int dhtStatus = DHTLIB_OK;
+float rainValue = 0;
+boolean bmpDetected = false;
+bmp085_measurement_t measurement;
+
+// Acquisition steps, registered in setup(). The BMP converts while the A0
+// burst runs, the burst locks interrupts so it is done before the DHT capture.
+void startBmp() {
+    bmpDetected = bmp.begin();
+    if (bmpDetected) {
+        bmp.startMeasurement();
+    }
+}
+
+boolean bmpReady() {
+    return !bmpDetected || bmp.measurementReady();
+}
+
+void finishBmp() {
+    bmpDetected = bmpDetected && bmp.finishMeasurement(measurement);
+}
+
+void readRain() {
+    Serial.println("Request rain sensor");
+    rainValue = smarties.readAnalog();
+}
+
+void startDht() {
+    DHT.startRead(DHT_PIN);
+}
+
+boolean dhtReady() {
+    return DHT.readReady();
+}
+
+void finishDht() {
+    dhtStatus = DHT.finishRead();
+}
+
 void transmitSensor() {
+    smarties.acquire();
+
     // DHT
-    delay(2000);
-    int chk = DHT.read22(DHT_PIN);
-    switch (chk)
+    switch (dhtStatus)
     {
         case DHTLIB_OK:
             Serial.println("OK,\t");
@@ -45,18 +86,7 @@ void transmitSensor() {
     Serial.println("DHT Temperature: " + String(tDHT));
     Serial.println("DHT Humidity: " + String(hDHT));
 
-    // Pressure
-    Wire.begin(PRESSURE_PIN_1, PRESSURE_PIN_2);
-    bmp.begin();
-
     // Water sensor
-    pinMode(WATER_SENSOR_PIN, INPUT);
-    Serial.println("Request rain sensor");
-    float rainValue = 0;
-    for (int i = 0; i < 100; i++) {
-        rainValue = rainValue + analogRead(WATER_SENSOR_PIN);
-    }
-    rainValue = rainValue  / 100.0;
     Serial.println("Rain: " + String(rainValue));
 
     // Pressure sensor
@@ -64,12 +94,12 @@ void transmitSensor() {
     float aBMP = 0;
     float pBMP = 0;
     // float sBMP = 0;
-    if(!bmp.begin()) {
+    if(!bmpDetected) {
         Serial.println("No bmp detected");
     } else {
-        tBMP = bmp.readTemperature();
-        aBMP = bmp.readAltitude();
-        pBMP = bmp.readPressure();
+        tBMP = measurement.temperature;
+        aBMP = measurement.altitude;
+        pBMP = measurement.pressure;
         // sBMP = bmp.readSealevelPressure();
         Serial.println("BMP Temperature: " + String(tBMP));
         Serial.println("BMP Altitude: " + String(aBMP));
@@ -94,7 +124,16 @@ void transmitSensor() {
 }
 
 void setup() {
-  smarties.setup(JSON_CONFIG);
+  smarties.setup();
+
+  // Pressure
+  Wire.begin(PRESSURE_PIN_1, PRESSURE_PIN_2);
+  // Water sensor
+  pinMode(WATER_SENSOR_PIN, INPUT);
+
+  smarties.addAcquisition(startBmp, bmpReady, finishBmp);
+  smarties.addAcquisition(readRain);
+  smarties.addAcquisition(startDht, dhtReady, finishDht, DHT_WARMUP);
 }
 
 void loop() {
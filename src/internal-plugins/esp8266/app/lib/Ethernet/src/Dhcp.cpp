@@ -8,6 +8,9 @@
 #include "Dhcp.h"
 #include "Arduino.h"
 #include "utility/util.h"
+#if defined(ESP8266)
+#include <EEPROM.h>
+#endif
 
 int DhcpClass::beginWithDHCP(uint8_t *mac, unsigned long timeout, unsigned long responseTimeout)
 {
@@ -24,9 +27,82 @@ int DhcpClass::beginWithDHCP(uint8_t *mac, unsigned long timeout, unsigned long
 
     memcpy((void*)_dhcpMacAddr, (void*)mac, 6);
     _dhcp_state = STATE_DHCP_START;
+    if (load_DHCP_lease())
+    {
+        // Ask straight for the address we had before power off,
+        // a full discovery is only done if the server refuses it
+        _dhcp_state = STATE_DHCP_REBOOT;
+    }
     return request_DHCP_lease();
 }
 
+//return:1 if a lease for our MAC address was restored from non-volatile storage
+int DhcpClass::load_DHCP_lease(){
+#if defined(ESP8266)
+    DHCP_STORED_LEASE lease;
+    EEPROM.begin(DHCP_LEASE_EEPROM_SIZE);
+    EEPROM.get(DHCP_LEASE_EEPROM_OFFSET, lease);
+    EEPROM.end();
+
+    if (lease.magic != DHCP_LEASE_MAGIC || memcmp(lease.mac, _dhcpMacAddr, 6) != 0 ||
+        lease.checksum != lease_checksum(lease))
+    {
+        return 0;
+    }
+
+    memcpy(_dhcpLocalIp, lease.localIp, 4);
+    memcpy(_dhcpSubnetMask, lease.subnetMask, 4);
+    memcpy(_dhcpGatewayIp, lease.gatewayIp, 4);
+    memcpy(_dhcpDnsServerIp, lease.dnsServerIp, 4);
+    // The server identifier must not be sent in INIT-REBOOT, it is learnt again from the ACK
+    memset(_dhcpDhcpServerIp, 0, 4);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void DhcpClass::save_DHCP_lease(){
+#if defined(ESP8266)
+    DHCP_STORED_LEASE lease;
+    memset(&lease, 0, sizeof(lease));
+    lease.magic = DHCP_LEASE_MAGIC;
+    memcpy(lease.mac, _dhcpMacAddr, 6);
+    memcpy(lease.localIp, _dhcpLocalIp, 4);
+    memcpy(lease.subnetMask, _dhcpSubnetMask, 4);
+    memcpy(lease.gatewayIp, _dhcpGatewayIp, 4);
+    memcpy(lease.dhcpServerIp, _dhcpDhcpServerIp, 4);
+    memcpy(lease.dnsServerIp, _dhcpDnsServerIp, 4);
+    lease.leaseTime = _dhcpLeaseTime;
+    lease.t1 = _dhcpT1;
+    lease.t2 = _dhcpT2;
+    lease.checksum = lease_checksum(lease);
+
+    DHCP_STORED_LEASE stored;
+    EEPROM.begin(DHCP_LEASE_EEPROM_SIZE);
+    EEPROM.get(DHCP_LEASE_EEPROM_OFFSET, stored);
+    // Spare the flash when the server handed out the same lease again
+    if (memcmp(&stored, &lease, sizeof(lease)) != 0)
+    {
+        EEPROM.put(DHCP_LEASE_EEPROM_OFFSET, lease);
+        EEPROM.commit();
+    }
+    EEPROM.end();
+#endif
+}
+
+uint32_t DhcpClass::lease_checksum(const DHCP_STORED_LEASE& lease){
+    // Fletcher-32 over everything but the checksum itself
+    const uint8_t* data = (const uint8_t*)&lease;
+    uint32_t sum1 = 0xFFFF, sum2 = 0xFFFF;
+    for (size_t i = 0; i < offsetof(DHCP_STORED_LEASE, checksum); i++)
+    {
+        sum1 = (sum1 + data[i]) % 0xFFFF;
+        sum2 = (sum2 + sum1) % 0xFFFF;
+    }
+    return (sum2 << 16) | sum1;
+}
+
 void DhcpClass::reset_DHCP_lease(){
     // zero out _dhcpSubnetMask, _dhcpGatewayIp, _dhcpLocalIp, _dhcpDhcpServerIp, _dhcpDnsServerIp
     memset(_dhcpLocalIp, 0, 20);
@@ -70,6 +146,11 @@ int DhcpClass::request_DHCP_lease(){
             send_DHCP_MESSAGE(DHCP_REQUEST, ((millis() - startTime)/1000));
             _dhcp_state = STATE_DHCP_REQUEST;
         }
+        else if(_dhcp_state == STATE_DHCP_REBOOT){
+            _dhcpTransactionId++;
+            send_DHCP_MESSAGE(DHCP_REQUEST, ((millis() - startTime)/1000));
+            _dhcp_state = STATE_DHCP_REBOOTING;
+        }
         else if(_dhcp_state == STATE_DHCP_DISCOVER)
         {
             uint32_t respId;
@@ -83,7 +164,7 @@ int DhcpClass::request_DHCP_lease(){
                 _dhcp_state = STATE_DHCP_REQUEST;
             }
         }
-        else if(_dhcp_state == STATE_DHCP_REQUEST)
+        else if(_dhcp_state == STATE_DHCP_REQUEST || _dhcp_state == STATE_DHCP_REBOOTING)
         {
             uint32_t respId;
             messageType = parseDHCPResponse(_responseTimeout, respId);
@@ -106,9 +187,20 @@ int DhcpClass::request_DHCP_lease(){
                 }
                 _renewInSec = _dhcpT1;
                 _rebindInSec = _dhcpT2;
+                save_DHCP_lease();
             }
             else if(messageType == DHCP_NAK)
                 _dhcp_state = STATE_DHCP_START;
+            else if(_dhcp_state == STATE_DHCP_REBOOTING)
+            {
+                // No answer to our stored lease, fall back to a full discovery
+                _dhcp_state = STATE_DHCP_START;
+            }
+
+            if(_dhcp_state == STATE_DHCP_START)
+            {
+                reset_DHCP_lease();
+            }
         }
         
         if(messageType == 255)
@@ -231,7 +323,8 @@ void DhcpClass::send_DHCP_MESSAGE(uint8_t messageType, uint16_t secondsElapsed)
         buffer[11] = _dhcpDhcpServerIp[3];
 
         //put data in W5100 transmit buffer
-        _dhcpUdpSocket.write(buffer, 12);
+        //INIT-REBOOT requests go without the server identifier (RFC 2131, 4.3.2)
+        _dhcpUdpSocket.write(buffer, (_dhcp_state == STATE_DHCP_REBOOT) ? 6 : 12);
     }
     
     buffer[0] = dhcpParamRequest;
@@ -254,10 +347,13 @@ uint8_t DhcpClass::parseDHCPResponse(unsigned long responseTimeout, uint32_t& tr
 {
     uint8_t type = 0;
     uint8_t opt_len = 0;
+    uint8_t packet[DHCP_MAX_PACKET_SIZE];
+    int size;
      
     unsigned long startTime = millis();
 
-    while(_dhcpUdpSocket.parsePacket() <= 0)
+    // Pull the whole reply out of the W5100 in one go
+    while((size = _dhcpUdpSocket.receivePacket(packet, sizeof(packet))) <= 0)
     {
         if((millis() - startTime) > responseTimeout)
         {
@@ -265,120 +361,128 @@ uint8_t DhcpClass::parseDHCPResponse(unsigned long responseTimeout, uint32_t& tr
         }
         delay(50);
     }
-    // start reading in the packet
+    if (size > (int)sizeof(packet))
+    {
+        // Options past our buffer have been dropped, parse what we've got
+        size = sizeof(packet);
+    }
+    if (size < (int)sizeof(RIP_MSG_FIXED))
+    {
+        return 0;
+    }
+
     RIP_MSG_FIXED fixedMsg;
-    _dhcpUdpSocket.read((uint8_t*)&fixedMsg, sizeof(RIP_MSG_FIXED));
+    memcpy(&fixedMsg, packet, sizeof(RIP_MSG_FIXED));
   
     if(fixedMsg.op == DHCP_BOOTREPLY && _dhcpUdpSocket.remotePort() == DHCP_SERVER_PORT)
     {
         transactionId = ntohl(fixedMsg.xid);
         if(memcmp(fixedMsg.chaddr, _dhcpMacAddr, 6) != 0 || (transactionId < _dhcpInitialTransactionId) || (transactionId > _dhcpTransactionId))
         {
-            // Need to read the rest of the packet here regardless
-            _dhcpUdpSocket.flush();
             return 0;
         }
 
         memcpy(_dhcpLocalIp, fixedMsg.yiaddr, 4);
 
         // Skip to the option part
-        // Doing this a byte at a time so we don't have to put a big buffer
-        // on the stack (as we don't have lots of memory lying around)
-        for (int i =0; i < (240 - (int)sizeof(RIP_MSG_FIXED)); i++)
-        {
-            _dhcpUdpSocket.read(); // we don't care about the returned byte
-        }
+        int pos = 240;
 
-        while (_dhcpUdpSocket.available() > 0) 
+        while (pos < size) 
         {
-            switch (_dhcpUdpSocket.read()) 
+            uint8_t option = packet[pos++];
+            if (option == endOption)
+            {
+                // Anything after the end option is padding
+                break;
+            }
+            if (option == padOption)
+            {
+                continue;
+            }
+            if (pos >= size)
+            {
+                break;
+            }
+            opt_len = packet[pos++];
+            if (pos + opt_len > size)
+            {
+                // Option runs past the end of the packet
+                break;
+            }
+
+            switch (option) 
             {
-                case endOption :
-                    break;
-                    
-                case padOption :
-                    break;
-                
                 case dhcpMessageType :
-                    opt_len = _dhcpUdpSocket.read();
-                    type = _dhcpUdpSocket.read();
+                    if (opt_len >= 1)
+                    {
+                        type = packet[pos];
+                    }
                     break;
                 
                 case subnetMask :
-                    opt_len = _dhcpUdpSocket.read();
-                    _dhcpUdpSocket.read(_dhcpSubnetMask, 4);
+                    if (opt_len >= 4)
+                    {
+                        memcpy(_dhcpSubnetMask, packet + pos, 4);
+                    }
                     break;
                 
                 case routersOnSubnet :
-                    opt_len = _dhcpUdpSocket.read();
-                    _dhcpUdpSocket.read(_dhcpGatewayIp, 4);
-                    for (int i = 0; i < opt_len-4; i++)
+                    if (opt_len >= 4)
                     {
-                        _dhcpUdpSocket.read();
+                        memcpy(_dhcpGatewayIp, packet + pos, 4);
                     }
                     break;
                 
                 case dns :
-                    opt_len = _dhcpUdpSocket.read();
-                    _dhcpUdpSocket.read(_dhcpDnsServerIp, 4);
-                    for (int i = 0; i < opt_len-4; i++)
+                    if (opt_len >= 4)
                     {
-                        _dhcpUdpSocket.read();
+                        memcpy(_dhcpDnsServerIp, packet + pos, 4);
                     }
                     break;
                 
                 case dhcpServerIdentifier :
-                    opt_len = _dhcpUdpSocket.read();
-                    if ((_dhcpDhcpServerIp[0] == 0 && _dhcpDhcpServerIp[1] == 0 &&
-                         _dhcpDhcpServerIp[2] == 0 && _dhcpDhcpServerIp[3] == 0) ||
-                        IPAddress(_dhcpDhcpServerIp) == _dhcpUdpSocket.remoteIP())
+                    if ((opt_len >= 4) &&
+                        ((_dhcpDhcpServerIp[0] == 0 && _dhcpDhcpServerIp[1] == 0 &&
+                          _dhcpDhcpServerIp[2] == 0 && _dhcpDhcpServerIp[3] == 0) ||
+                         IPAddress(_dhcpDhcpServerIp) == _dhcpUdpSocket.remoteIP()))
                     {
-                        _dhcpUdpSocket.read(_dhcpDhcpServerIp, sizeof(_dhcpDhcpServerIp));
-                    }
-                    else
-                    {
-                        // Skip over the rest of this option
-                        while (opt_len--)
-                        {
-                            _dhcpUdpSocket.read();
-                        }
+                        memcpy(_dhcpDhcpServerIp, packet + pos, sizeof(_dhcpDhcpServerIp));
                     }
                     break;
 
                 case dhcpT1value : 
-                    opt_len = _dhcpUdpSocket.read();
-                    _dhcpUdpSocket.read((uint8_t*)&_dhcpT1, sizeof(_dhcpT1));
-                    _dhcpT1 = ntohl(_dhcpT1);
+                    if (opt_len >= 4)
+                    {
+                        memcpy(&_dhcpT1, packet + pos, sizeof(_dhcpT1));
+                        _dhcpT1 = ntohl(_dhcpT1);
+                    }
                     break;
 
                 case dhcpT2value : 
-                    opt_len = _dhcpUdpSocket.read();
-                    _dhcpUdpSocket.read((uint8_t*)&_dhcpT2, sizeof(_dhcpT2));
-                    _dhcpT2 = ntohl(_dhcpT2);
+                    if (opt_len >= 4)
+                    {
+                        memcpy(&_dhcpT2, packet + pos, sizeof(_dhcpT2));
+                        _dhcpT2 = ntohl(_dhcpT2);
+                    }
                     break;
 
                 case dhcpIPaddrLeaseTime :
-                    opt_len = _dhcpUdpSocket.read();
-                    _dhcpUdpSocket.read((uint8_t*)&_dhcpLeaseTime, sizeof(_dhcpLeaseTime));
-                    _dhcpLeaseTime = ntohl(_dhcpLeaseTime);
-                    _renewInSec = _dhcpLeaseTime;
+                    if (opt_len >= 4)
+                    {
+                        memcpy(&_dhcpLeaseTime, packet + pos, sizeof(_dhcpLeaseTime));
+                        _dhcpLeaseTime = ntohl(_dhcpLeaseTime);
+                        _renewInSec = _dhcpLeaseTime;
+                    }
                     break;
 
                 default :
-                    opt_len = _dhcpUdpSocket.read();
                     // Skip over the rest of this option
-                    while (opt_len--)
-                    {
-                        _dhcpUdpSocket.read();
-                    }
                     break;
             }
+            pos += opt_len;
         }
     }
 
-    // Need to skip to end of the packet regardless here
-    _dhcpUdpSocket.flush();
-
     return type;
 }
 
@@ -13,6 +13,8 @@
 #define	STATE_DHCP_LEASED	3
 #define	STATE_DHCP_REREQUEST	4
 #define	STATE_DHCP_RELEASE	5
+#define	STATE_DHCP_REBOOT	6
+#define	STATE_DHCP_REBOOTING	7
 
 #define DHCP_FLAGSBROADCAST	0x8000
 
@@ -43,10 +45,18 @@
 
 #define MAGIC_COOKIE		0x63825363
 #define MAX_DHCP_OPT	16
+#define DHCP_MAX_PACKET_SIZE	548 /* 576 bytes minimum datagram less IP and UDP headers */
 
 #define HOST_NAME "WIZnet"
 #define DEFAULT_LEASE	(900) //default lease time in seconds
 
+/* Lease persisted across power cycles (ESP8266 EEPROM), kept clear of the Smarties counters */
+#ifndef DHCP_LEASE_EEPROM_OFFSET
+#define DHCP_LEASE_EEPROM_OFFSET	64
+#endif
+#define DHCP_LEASE_EEPROM_SIZE	512
+#define DHCP_LEASE_MAGIC	0x44484350 /* "DHCP" */
+
 #define DHCP_CHECK_NONE         (0)
 #define DHCP_CHECK_RENEW_FAIL   (1)
 #define DHCP_CHECK_RENEW_OK     (2)
@@ -136,6 +146,21 @@ typedef struct __attribute__((packed)) _RIP_MSG_FIXED
 	uint8_t  chaddr[6];
 }RIP_MSG_FIXED;
 
+typedef struct _DHCP_STORED_LEASE
+{
+	uint32_t magic;
+	uint8_t  mac[6];
+	uint8_t  localIp[4];
+	uint8_t  subnetMask[4];
+	uint8_t  gatewayIp[4];
+	uint8_t  dhcpServerIp[4];
+	uint8_t  dnsServerIp[4];
+	uint32_t leaseTime;
+	uint32_t t1;
+	uint32_t t2;
+	uint32_t checksum;
+}DHCP_STORED_LEASE;
+
 class DhcpClass {
 private:
   uint32_t _dhcpInitialTransactionId;
@@ -159,6 +184,9 @@ private:
   
   int request_DHCP_lease();
   void reset_DHCP_lease();
+  int load_DHCP_lease();
+  void save_DHCP_lease();
+  static uint32_t lease_checksum(const DHCP_STORED_LEASE&);
   void presend_DHCP();
   void send_DHCP_MESSAGE(uint8_t, uint16_t);
   void printByte(char *, uint8_t);
@@ -38,6 +38,8 @@
 #define TYPE_A                   (0x0001)
 #define CLASS_IN                 (0x0001)
 #define LABEL_COMPRESSION_MASK   (0xC0)
+// Largest response we expect over UDP (RFC1035)
+#define DNS_MAX_PACKET_SIZE      512
 // Port number that DNS servers listen on
 #define DNS_PORT        53
 
@@ -48,9 +50,12 @@
 #define TRUNCATED        -3
 #define INVALID_RESPONSE -4
 
+DNSClient::DNSCacheEntry DNSClient::iCache[DNS_CACHE_SIZE];
+
 void DNSClient::begin(const IPAddress& aDNSServer)
 {
     iDNSServer = aDNSServer;
+    iFirstRequestId = 0;
     iRequestId = 0;
 }
 
@@ -126,6 +131,15 @@ int DNSClient::getHostByName(const char* aHostname, IPAddress& aResult)
         return 1;
     }
 
+    // Answer from the cache while the record is fresh enough, a record
+    // close to its expiry is resolved again ahead of time
+    DNSCacheEntry* cached = lookupCache(aHostname);
+    if (cached && ((int32_t)(cached->expiry - millis()) > DNS_CACHE_PREFETCH_WINDOW))
+    {
+        aResult = cached->address;
+        return 1;
+    }
+
     // Check we've got a valid DNS server to use
     if (iDNSServer == INADDR_NONE)
     {
@@ -135,10 +149,17 @@ int DNSClient::getHostByName(const char* aHostname, IPAddress& aResult)
     // Find a socket to use
     if (iUdp.begin(1024+(millis() & 0xF)) == 1)
     {
-        // Try up to three times
+        uint32_t ttl = 0;
+        iFirstRequestId = millis(); // generate a random ID
+        iRequestId = iFirstRequestId - 1;
+
+        // Send the query again with a new ID on every retry, an answer
+        // to any of the queries already sent is accepted
         int retries = 0;
-//        while ((retries < 3) && (ret <= 0))
+        ret = TIMED_OUT;
+        while ((retries < DNS_MAX_RETRIES) && (ret != SUCCESS))
         {
+            iRequestId++;
             // Send DNS request
             ret = iUdp.beginPacket(iDNSServer, DNS_PORT);
             if (ret != 0)
@@ -151,14 +172,14 @@ int DNSClient::getHostByName(const char* aHostname, IPAddress& aResult)
                     ret = iUdp.endPacket();
                     if (ret != 0)
                     {
-                        // Now wait for a response
-                        int wait_retries = 0;
-                        ret = TIMED_OUT;
-                        while ((wait_retries < 3) && (ret == TIMED_OUT))
+                        // Now wait for a response, skipping stray packets
+                        uint32_t startTime = millis();
+                        uint32_t elapsed = 0;
+                        do
                         {
-                            ret = ProcessResponse(5000, aResult);
-                            wait_retries++;
-                        }
+                            ret = ProcessResponse(DNS_RETRY_INTERVAL - elapsed, aResult, ttl);
+                            elapsed = millis() - startTime;
+                        } while ((ret == INVALID_SERVER || ret == INVALID_RESPONSE) && (elapsed < DNS_RETRY_INTERVAL));
                     }
                 }
             }
@@ -167,11 +188,80 @@ int DNSClient::getHostByName(const char* aHostname, IPAddress& aResult)
 
         // We're done with the socket now
         iUdp.stop();
+
+        if (ret == SUCCESS)
+        {
+            storeCache(aHostname, aResult, ttl);
+        }
+    }
+
+    if ((ret != SUCCESS) && cached && ((int32_t)(cached->expiry - millis()) > 0))
+    {
+        // The refresh failed but the record hasn't expired yet
+        aResult = cached->address;
+        return 1;
     }
 
     return ret;
 }
 
+DNSClient::DNSCacheEntry* DNSClient::lookupCache(const char* aHostname)
+{
+    for (int i = 0; i < DNS_CACHE_SIZE; i++)
+    {
+        DNSCacheEntry* entry = &iCache[i];
+        if (entry->name[0] && (strcmp(entry->name, aHostname) == 0))
+        {
+            if ((int32_t)(entry->expiry - millis()) > 0)
+            {
+                return entry;
+            }
+            // Expired, free the slot
+            entry->name[0] = 0;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+void DNSClient::storeCache(const char* aHostname, const IPAddress& aAddress, uint32_t aTtl)
+{
+    if ((aTtl == 0) || (strlen(aHostname) >= DNS_CACHE_NAME_SIZE))
+    {
+        // Not meant to be cached, or too long to fit
+        return;
+    }
+    if (aTtl > DNS_CACHE_MAX_TTL)
+    {
+        aTtl = DNS_CACHE_MAX_TTL;
+    }
+
+    uint32_t now = millis();
+    // Reuse the entry for this name, else a free slot, else the one closest to expiry
+    DNSCacheEntry* slot = &iCache[0];
+    for (int i = 0; i < DNS_CACHE_SIZE; i++)
+    {
+        DNSCacheEntry* entry = &iCache[i];
+        if (entry->name[0] && (strcmp(entry->name, aHostname) == 0))
+        {
+            slot = entry;
+            break;
+        }
+        if (!entry->name[0] || ((int32_t)(entry->expiry - now) <= 0))
+        {
+            slot = entry;
+        }
+        else if (slot->name[0] && ((int32_t)(entry->expiry - slot->expiry) < 0))
+        {
+            slot = entry;
+        }
+    }
+
+    strcpy(slot->name, aHostname);
+    slot->address = aAddress;
+    slot->expiry = now + aTtl * 1000UL;
+}
+
 uint16_t DNSClient::BuildRequest(const char* aName)
 {
     // Build header
@@ -192,7 +282,6 @@ uint16_t DNSClient::BuildRequest(const char* aName)
     //    +--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+
     // As we only support one request at a time at present, we can simplify
     // some of this header
-    iRequestId = millis(); // generate a random ID
     uint16_t twoByteBuffer;
 
     // FIXME We should also check that there's enough space available to write to, rather
@@ -252,12 +341,41 @@ uint16_t DNSClient::BuildRequest(const char* aName)
 }
 
 
-uint16_t DNSClient::ProcessResponse(uint16_t aTimeout, IPAddress& aAddress)
+// Skip over the (possibly compressed) name starting at aPos in aPacket
+// Returns the offset just past the name, or 0 if the name runs beyond aSize
+static uint16_t skipName(const uint8_t* aPacket, uint16_t aSize, uint16_t aPos)
+{
+    while (aPos < aSize)
+    {
+        uint8_t len = aPacket[aPos];
+        if ((len & LABEL_COMPRESSION_MASK) == LABEL_COMPRESSION_MASK)
+        {
+            // This is a pointer to a somewhere else in the message for the
+            // rest of the name.  We don't care about the name, and RFC1035
+            // says that a name is either a sequence of labels ended with a
+            // 0 length octet or a pointer or a sequence of labels ending in
+            // a pointer.  Either way, when we get here we're at the end of
+            // the name
+            aPos += 2;
+            return (aPos <= aSize) ? aPos : 0;
+        }
+        aPos += 1 + len;
+        if (len == 0)
+        {
+            return aPos;
+        }
+    }
+    return 0;
+}
+
+int DNSClient::ProcessResponse(uint16_t aTimeout, IPAddress& aAddress, uint32_t& aTtl)
 {
     uint32_t startTime = millis();
+    uint8_t packet[DNS_MAX_PACKET_SIZE];
+    int size;
 
-    // Wait for a response packet
-    while(iUdp.parsePacket() <= 0)
+    // Wait for a response packet, pulled out of the W5100 in one go
+    while((size = iUdp.receivePacket(packet, sizeof(packet))) <= 0)
     {
         if((millis() - startTime) > aTimeout)
             return TIMED_OUT;
@@ -265,8 +383,6 @@ uint16_t DNSClient::ProcessResponse(uint16_t aTimeout, IPAddress& aAddress)
     }
 
     // We've had a reply!
-    // Read the UDP header
-    uint8_t header[DNS_HEADER_SIZE]; // Enough space to reuse for the DNS header
     // Check that it's a response from the right server and the right port
     if ( (iDNSServer != iUdp.remoteIP()) || 
         (iUdp.remotePort() != DNS_PORT) )
@@ -275,64 +391,50 @@ uint16_t DNSClient::ProcessResponse(uint16_t aTimeout, IPAddress& aAddress)
         return INVALID_SERVER;
     }
 
-    // Read through the rest of the response
-    if (iUdp.available() < DNS_HEADER_SIZE)
+    if (size > (int)sizeof(packet))
+    {
+        // Anything past our buffer has been dropped, parse what we've got
+        size = sizeof(packet);
+    }
+    if (size < DNS_HEADER_SIZE)
     {
         return TRUNCATED;
     }
-    iUdp.read(header, DNS_HEADER_SIZE);
 
-    uint16_t header_flags = htons(*((uint16_t*)&header[2]));
-    // Check that it's a response to this request
-    if ( ( iRequestId != (*((uint16_t*)&header[0])) ) ||
+    uint16_t header_flags = htons(*((uint16_t*)&packet[2]));
+    // Check that it's a response to one of the requests we've sent
+    uint16_t responseId = *((uint16_t*)&packet[0]);
+    if ( ( (uint16_t)(responseId - iFirstRequestId) > (uint16_t)(iRequestId - iFirstRequestId) ) ||
         ((header_flags & QUERY_RESPONSE_MASK) != (uint16_t)RESPONSE_FLAG) )
     {
-        // Mark the entire packet as read
-        iUdp.flush();
         return INVALID_RESPONSE;
     }
     // Check for any errors in the response (or in our request)
     // although we don't do anything to get round these
     if ( (header_flags & TRUNCATION_FLAG) || (header_flags & RESP_MASK) )
     {
-        // Mark the entire packet as read
-        iUdp.flush();
         return -5; //INVALID_RESPONSE;
     }
 
     // And make sure we've got (at least) one answer
-    uint16_t answerCount = htons(*((uint16_t*)&header[6]));
+    uint16_t answerCount = htons(*((uint16_t*)&packet[6]));
     if (answerCount == 0 )
     {
-        // Mark the entire packet as read
-        iUdp.flush();
         return -6; //INVALID_RESPONSE;
     }
 
+    uint16_t pos = DNS_HEADER_SIZE;
+
     // Skip over any questions
-    for (uint16_t i =0; i < htons(*((uint16_t*)&header[4])); i++)
+    for (uint16_t i =0; i < htons(*((uint16_t*)&packet[4])); i++)
     {
-        // Skip over the name
-        uint8_t len;
-        do
-        {
-            iUdp.read(&len, sizeof(len));
-            if (len > 0)
-            {
-                // Don't need to actually read the data out for the string, just
-                // advance ptr to beyond it
-                while(len--)
-                {
-                    iUdp.read(); // we don't care about the returned byte
-                }
-            }
-        } while (len != 0);
-
-        // Now jump over the type and class
-        for (int i =0; i < 4; i++)
+        // Skip over the name, then jump over the type and class
+        pos = skipName(packet, size, pos);
+        if (pos == 0)
         {
-            iUdp.read(); // we don't care about the returned byte
+            return TRUNCATED;
         }
+        pos += 4;
     }
 
     // Now we're up to the bit we're interested in, the answer
@@ -343,81 +445,46 @@ uint16_t DNSClient::ProcessResponse(uint16_t aTimeout, IPAddress& aAddress)
     for (uint16_t i =0; i < answerCount; i++)
     {
         // Skip the name
-        uint8_t len;
-        do
+        pos = skipName(packet, size, pos);
+        // Type, class, Time-To-Live and data length must all be there
+        if ((pos == 0) || (pos + 10 > size))
         {
-            iUdp.read(&len, sizeof(len));
-            if ((len & LABEL_COMPRESSION_MASK) == 0)
-            {
-                // It's just a normal label
-                if (len > 0)
-                {
-                    // And it's got a length
-                    // Don't need to actually read the data out for the string,
-                    // just advance ptr to beyond it
-                    while(len--)
-                    {
-                        iUdp.read(); // we don't care about the returned byte
-                    }
-                }
-            }
-            else
-            {
-                // This is a pointer to a somewhere else in the message for the
-                // rest of the name.  We don't care about the name, and RFC1035
-                // says that a name is either a sequence of labels ended with a
-                // 0 length octet or a pointer or a sequence of labels ending in
-                // a pointer.  Either way, when we get here we're at the end of
-                // the name
-                // Skip over the pointer
-                iUdp.read(); // we don't care about the returned byte
-                // And set len so that we drop out of the name loop
-                len = 0;
-            }
-        } while (len != 0);
+            return TRUNCATED;
+        }
 
         // Check the type and class
-        uint16_t answerType;
-        uint16_t answerClass;
-        iUdp.read((uint8_t*)&answerType, sizeof(answerType));
-        iUdp.read((uint8_t*)&answerClass, sizeof(answerClass));
+        uint16_t answerType = (packet[pos] << 8) | packet[pos + 1];
+        uint16_t answerClass = (packet[pos + 2] << 8) | packet[pos + 3];
 
-        // Ignore the Time-To-Live as we don't do any caching
-        for (int i =0; i < TTL_SIZE; i++)
-        {
-            iUdp.read(); // we don't care about the returned byte
-        }
+        // Keep the Time-To-Live for the cache
+        uint32_t ttl = ((uint32_t)packet[pos + 4] << 24) | ((uint32_t)packet[pos + 5] << 16) |
+                       ((uint32_t)packet[pos + 6] << 8) | packet[pos + 7];
+        pos += 4 + TTL_SIZE;
 
         // And read out the length of this answer
-        // Don't need header_flags anymore, so we can reuse it here
-        iUdp.read((uint8_t*)&header_flags, sizeof(header_flags));
+        uint16_t dataLength = (packet[pos] << 8) | packet[pos + 1];
+        pos += 2;
+        if (pos + dataLength > size)
+        {
+            return TRUNCATED;
+        }
 
-        if ( (htons(answerType) == TYPE_A) && (htons(answerClass) == CLASS_IN) )
+        if ( (answerType == TYPE_A) && (answerClass == CLASS_IN) )
         {
-            if (htons(header_flags) != 4)
+            if (dataLength != 4)
             {
                 // It's a weird size
-                // Mark the entire packet as read
-                iUdp.flush();
                 return -9;//INVALID_RESPONSE;
             }
-            iUdp.read(aAddress.raw_address(), 4);
+            memcpy(aAddress.raw_address(), packet + pos, 4);
+            aTtl = ttl;
             return SUCCESS;
         }
-        else
-        {
-            // This isn't an answer type we're after, move onto the next one
-            for (uint16_t i =0; i < htons(header_flags); i++)
-            {
-                iUdp.read(); // we don't care about the returned byte
-            }
-        }
-    }
 
-    // Mark the entire packet as read
-    iUdp.flush();
+        // This isn't an answer type we're after, move onto the next one
+        pos += dataLength;
+    }
 
     // If we get here then we haven't found an answer
     return -10;//INVALID_RESPONSE;
 }
-
@@ -7,6 +7,18 @@
 
 #include <EthernetUdp.h>
 
+// Number of hostnames kept in the resolver cache
+#define DNS_CACHE_SIZE            4
+// Longest hostname (including terminator) that can be cached
+#define DNS_CACHE_NAME_SIZE       40
+// Upper bound on how long a record is kept, in seconds
+#define DNS_CACHE_MAX_TTL         86400UL
+// Records expiring within this many milliseconds are resolved again
+#define DNS_CACHE_PREFETCH_WINDOW 30000L
+// Number of queries sent before giving up, and time waited for each
+#define DNS_MAX_RETRIES           3
+#define DNS_RETRY_INTERVAL        1000
+
 class DNSClient
 {
 public:
@@ -30,12 +42,24 @@ public:
     int getHostByName(const char* aHostname, IPAddress& aResult);
 
 protected:
+    struct DNSCacheEntry
+    {
+        char name[DNS_CACHE_NAME_SIZE];
+        IPAddress address;
+        uint32_t expiry;
+    };
+
     uint16_t BuildRequest(const char* aName);
-    uint16_t ProcessResponse(uint16_t aTimeout, IPAddress& aAddress);
+    int ProcessResponse(uint16_t aTimeout, IPAddress& aAddress, uint32_t& aTtl);
+    DNSCacheEntry* lookupCache(const char* aHostname);
+    void storeCache(const char* aHostname, const IPAddress& aAddress, uint32_t aTtl);
 
     IPAddress iDNSServer;
+    uint16_t iFirstRequestId;
     uint16_t iRequestId;
     EthernetUDP iUdp;
+    // Shared by every client, a new DNSClient is created for each connection
+    static DNSCacheEntry iCache[DNS_CACHE_SIZE];
 };
 
 #endif
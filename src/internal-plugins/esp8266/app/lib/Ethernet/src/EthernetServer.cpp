@@ -8,12 +8,23 @@ extern "C" {
 #include "EthernetClient.h"
 #include "EthernetServer.h"
 
-EthernetServer::EthernetServer(uint16_t port)
+EthernetServer::EthernetServer(uint16_t port, uint8_t listeners)
 {
   _port = port;
+  _listeners = (listeners == 0) ? 1 : listeners;
+  _queued = 0;
 }
 
 void EthernetServer::begin()
+{
+  for (uint8_t i = 0; i < _listeners; i++) {
+    if (!listenOnFreeSocket()) {
+      break;
+    }
+  }
+}
+
+bool EthernetServer::listenOnFreeSocket()
 {
   for (int sock = 0; sock < MAX_SOCK_NUM; sock++) {
     EthernetClient client(sock);
@@ -21,30 +32,71 @@ void EthernetServer::begin()
       socket(sock, SnMR::TCP, _port, 0);
       listen(sock);
       EthernetClass::_server_port[sock] = _port;
-      break;
+      return true;
     }
-  }  
+  }
+  return false;
+}
+
+uint8_t EthernetServer::queuePosition(uint8_t sock)
+{
+  for (uint8_t i = 0; i < _queued; i++) {
+    if (_queue[i] == sock) {
+      return i;
+    }
+  }
+  return MAX_SOCK_NUM;
+}
+
+void EthernetServer::dequeue(uint8_t index)
+{
+  _queued--;
+  for (uint8_t i = index; i < _queued; i++) {
+    _queue[i] = _queue[i + 1];
+  }
 }
 
 void EthernetServer::accept()
 {
-  int listening = 0;
+  uint8_t listening = 0;
+
+  // Forget connections that were closed or handed to someone else
+  for (uint8_t i = 0; i < _queued;) {
+    uint8_t sock = _queue[i];
+    uint8_t s = EthernetClient(sock).status();
+    if (EthernetClass::_server_port[sock] != _port ||
+        (s != SnSR::ESTABLISHED && s != SnSR::CLOSE_WAIT)) {
+      dequeue(i);
+    }
+    else {
+      i++;
+    }
+  }
 
   for (int sock = 0; sock < MAX_SOCK_NUM; sock++) {
     EthernetClient client(sock);
 
     if (EthernetClass::_server_port[sock] == _port) {
-      if (client.status() == SnSR::LISTEN) {
-        listening = 1;
+      uint8_t s = client.status();
+      if (s == SnSR::LISTEN) {
+        listening++;
       } 
-      else if (client.status() == SnSR::CLOSE_WAIT && !client.available()) {
+      else if (s == SnSR::CLOSE_WAIT && !client.available()) {
+        uint8_t position = queuePosition(sock);
+        if (position != MAX_SOCK_NUM) {
+          dequeue(position);
+        }
         client.stop();
       }
+      else if ((s == SnSR::ESTABLISHED || s == SnSR::CLOSE_WAIT) && queuePosition(sock) == MAX_SOCK_NUM) {
+        _queue[_queued++] = sock;
+      }
     } 
   }
 
-  if (!listening) {
-    begin();
+  // Re-arm the sockets that became connections
+  while (listening < _listeners && listenOnFreeSocket()) {
+    listening++;
   }
 }
 
@@ -52,22 +104,27 @@ EthernetClient EthernetServer::available()
 {
   accept();
 
-  for (int sock = 0; sock < MAX_SOCK_NUM; sock++) {
+  // Oldest connection with pending data first, then it goes to the back of
+  // the queue so one talkative client cannot starve the others
+  for (uint8_t i = 0; i < _queued; i++) {
+    uint8_t sock = _queue[i];
     EthernetClient client(sock);
-    if (EthernetClass::_server_port[sock] == _port) {
-      uint8_t s = client.status();
-      if (s == SnSR::ESTABLISHED || s == SnSR::CLOSE_WAIT) {
-        if (client.available()) {
-          // XXX: don't always pick the lowest numbered socket.
-          return client;
-        }
-      }
+    if (client.available()) {
+      dequeue(i);
+      _queue[_queued++] = sock;
+      return client;
     }
   }
 
   return EthernetClient(MAX_SOCK_NUM);
 }
 
+uint8_t EthernetServer::acceptQueueDepth()
+{
+  accept();
+  return _queued;
+}
+
 size_t EthernetServer::write(uint8_t b) 
 {
   return write(&b, 1);
@@ -2,6 +2,7 @@
 #define ethernetserver_h
 
 #include "Server.h"
+#include "utility/w5100.h"
 
 class EthernetClient;
 
@@ -9,10 +10,24 @@ class EthernetServer :
 public Server {
 private:
   uint16_t _port;
+  // Number of sockets kept listening on _port
+  uint8_t _listeners;
+  // Connected sockets in the order they were accepted, the head is the
+  // next client handed out by available()
+  uint8_t _queue[MAX_SOCK_NUM];
+  uint8_t _queued;
   void accept();
+  bool listenOnFreeSocket();
+  // Index of sock in _queue, MAX_SOCK_NUM if not queued
+  uint8_t queuePosition(uint8_t sock);
+  void dequeue(uint8_t index);
 public:
-  EthernetServer(uint16_t);
+  // listeners > 1 keeps that many sockets armed so several clients can
+  // connect at once; they share the W5100 sockets with UDP and clients
+  EthernetServer(uint16_t, uint8_t listeners = 1);
   EthernetClient available();
+  // Connections accepted on this server and not closed yet
+  uint8_t acceptQueueDepth();
   virtual void begin();
   virtual size_t write(uint8_t);
   virtual size_t write(const uint8_t *buf, size_t size);
@@ -144,6 +144,20 @@ int EthernetUDP::parsePacket()
   return 0;
 }
 
+int EthernetUDP::receivePacket(uint8_t* buffer, size_t len)
+{
+  // discard any remaining bytes in the last packet
+  flush();
+
+  if (recvAvailable(_sock) > 0)
+  {
+    uint16_t size = recvfrom(_sock, buffer, (len > 0xFFFF) ? 0xFFFF : len, rawIPAddress(_remoteIP), &_remotePort);
+    return size;
+  }
+  // There aren't any packets available
+  return 0;
+}
+
 int EthernetUDP::read()
 {
   uint8_t byte;
@@ -89,6 +89,9 @@ public:
   // Return the next byte from the current packet without moving on to the next byte
   virtual int peek();
   virtual void flush();	// Finish reading the current packet
+  // Read the next available packet as a whole into buffer, with a single ring read and one Sock_RECV
+  // Bytes beyond len are discarded. Returns the size of the packet, or 0 if no packets are available
+  int receivePacket(uint8_t* buffer, size_t len);
 
   // Return the IP address of the host who sent the current incoming packet
   virtual IPAddress remoteIP() { return _remoteIP; };
@@ -288,6 +288,8 @@ uint16_t sendto(SOCKET s, const uint8_t *buf, uint16_t len, uint8_t *addr, uint1
 /**
  * @brief	This function is an application I/F function which is used to receive the data in other then
  * 	TCP mode. This function is used to receive UDP, IP_RAW and MAC_RAW mode, and handle the header as well. 
+ * 	The whole datagram is released with a single Sock_RECV. In UDP mode at most len bytes are copied to buf,
+ * 	the rest of the datagram is dropped.
  * 	
  * @return	This function return received data size for success else -1.
  */
@@ -316,7 +318,7 @@ uint16_t recvfrom(SOCKET s, uint8_t *buf, uint16_t len, uint8_t *addr, uint16_t
       data_len = head[6];
       data_len = (data_len << 8) + head[7];
 
-      W5100.read_data(s, ptr, buf, data_len); // data copy.
+      W5100.read_data(s, ptr, buf, (data_len > len) ? len : data_len); // data copy.
       ptr += data_len;
 
       W5100.writeSnRX_RD(s, ptr);
@@ -0,0 +1,166 @@
+// Ethernet.begin() against a fake DHCP server on the host side of the
+// simulated W5100: full discovery on first boot, INIT-REBOOT afterwards
+
+#include "Ethernet.h"
+#include "EEPROM.h"
+
+#include <atomic>
+#include <thread>
+
+#include "Loopback.h"
+
+class FakeDhcpServer {
+public:
+  explicit FakeDhcpServer(bool nakReboot) : _nakReboot(nakReboot), _discovers(0), _requests(0), _rebootRequests(0), _running(true) {
+    _fd = hostUdpSocket(DHCP_SERVER_PORT);
+    struct timeval timeout = { 0, 50000 };
+    setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    _thread = std::thread(&FakeDhcpServer::serve, this);
+  }
+
+  ~FakeDhcpServer() {
+    _running = false;
+    _thread.join();
+    close(_fd);
+  }
+
+  int discovers() const { return _discovers; }
+  int requests() const { return _requests; }
+  int rebootRequests() const { return _rebootRequests; }
+
+private:
+  void serve() {
+    uint8_t packet[DHCP_MAX_PACKET_SIZE];
+    while (_running) {
+      ssize_t size = recv(_fd, packet, sizeof(packet), 0);
+      if (size < 240) {
+        continue;
+      }
+
+      uint8_t type = 0;
+      bool serverIdentifier = false;
+      for (ssize_t pos = 240; pos + 1 < size && packet[pos] != endOption; pos += 2 + packet[pos + 1]) {
+        if (packet[pos] == dhcpMessageType) {
+          type = packet[pos + 2];
+        } else if (packet[pos] == dhcpServerIdentifier) {
+          serverIdentifier = true;
+        }
+      }
+
+      uint8_t reply = 0;
+      if (type == DHCP_DISCOVER) {
+        _discovers++;
+        reply = DHCP_OFFER;
+      } else if (type == DHCP_REQUEST && serverIdentifier) {
+        _requests++;
+        reply = DHCP_ACK;
+      } else if (type == DHCP_REQUEST) {
+        _rebootRequests++;
+        reply = _nakReboot ? DHCP_NAK : DHCP_ACK;
+      }
+      if (reply) {
+        answer(packet, reply);
+      }
+    }
+  }
+
+  void answer(const uint8_t* request, uint8_t type) {
+    uint8_t packet[300];
+    memset(packet, 0, sizeof(packet));
+    packet[0] = DHCP_BOOTREPLY;
+    packet[1] = DHCP_HTYPE10MB;
+    packet[2] = DHCP_HLENETHERNET;
+    memcpy(packet + 4, request + 4, 4);   // xid
+    memcpy(packet + 28, request + 28, 6); // chaddr
+    if (type != DHCP_NAK) {
+      uint8_t yiaddr[] = { 10, 0, 0, 50 };
+      memcpy(packet + 16, yiaddr, 4);
+    }
+    uint8_t options[] = {
+      0x63, 0x82, 0x53, 0x63,
+      dhcpMessageType, 1, type,
+      dhcpServerIdentifier, 4, 127, 0, 0, 1,
+      subnetMask, 4, 255, 255, 255, 0,
+      routersOnSubnet, 4, 10, 0, 0, 1,
+      dns, 4, 10, 0, 0, 1,
+      dhcpIPaddrLeaseTime, 4, 0, 0, 0x0E, 0x10,
+      endOption
+    };
+    memcpy(packet + 236, options, sizeof(options));
+    hostSendTo(_fd, DHCP_CLIENT_PORT, packet, 236 + sizeof(options));
+  }
+
+  bool _nakReboot;
+  std::atomic<int> _discovers;
+  std::atomic<int> _requests;
+  std::atomic<int> _rebootRequests;
+  std::atomic<bool> _running;
+  int _fd;
+  std::thread _thread;
+};
+
+static uint8_t mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED };
+
+static void firstBootDiscovers()
+{
+  EEPROM.clear();
+  FakeDhcpServer server(false);
+
+  unsigned commits = EEPROM.commits();
+  unsigned long start = millis();
+  CHECK(Ethernet.begin(mac) == 1);
+  printf("  leased in %lu ms\n", millis() - start);
+  printCounters("DISCOVER/OFFER/REQUEST/ACK");
+  CHECK(Ethernet.localIP() == IPAddress(10, 0, 0, 50));
+  CHECK(Ethernet.gatewayIP() == IPAddress(10, 0, 0, 1));
+  CHECK(server.discovers() == 1);
+  CHECK(server.requests() == 1);
+  CHECK(server.rebootRequests() == 0);
+  CHECK(EEPROM.commits() == commits + 1);
+}
+
+static void rebootRequestsStoredLease()
+{
+  FakeDhcpServer server(false);
+
+  unsigned commits = EEPROM.commits();
+  unsigned long start = millis();
+  CHECK(Ethernet.begin(mac) == 1);
+  printf("  leased in %lu ms\n", millis() - start);
+  printCounters("INIT-REBOOT REQUEST/ACK");
+  CHECK(Ethernet.localIP() == IPAddress(10, 0, 0, 50));
+  CHECK(server.discovers() == 0);
+  CHECK(server.rebootRequests() == 1);
+  // Same lease handed out again, nothing to write
+  CHECK(EEPROM.commits() == commits);
+}
+
+static void refusedRebootFallsBack()
+{
+  FakeDhcpServer server(true);
+
+  CHECK(Ethernet.begin(mac) == 1);
+  CHECK(Ethernet.localIP() == IPAddress(10, 0, 0, 50));
+  CHECK(server.rebootRequests() == 1);
+  CHECK(server.discovers() == 1);
+  CHECK(server.requests() == 1);
+}
+
+static void otherMacDiscovers()
+{
+  FakeDhcpServer server(false);
+  uint8_t otherMac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xEE };
+
+  CHECK(Ethernet.begin(otherMac) == 1);
+  CHECK(server.rebootRequests() == 0);
+  CHECK(server.discovers() == 1);
+}
+
+int main()
+{
+  RUN(firstBootDiscovers);
+  RUN(rebootRequestsStoredLease);
+  RUN(refusedRebootFallsBack);
+  RUN(otherMacDiscovers);
+  return loopbackResult();
+}
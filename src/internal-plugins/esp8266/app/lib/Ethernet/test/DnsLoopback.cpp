@@ -0,0 +1,125 @@
+// DNSClient against a fake DNS server on the host side of the simulated W5100
+
+#include "Dns.h"
+#include "utility/w5100.h"
+
+#include <atomic>
+#include <thread>
+
+#include "Loopback.h"
+
+#define DNS_PORT 53
+
+class FakeDnsServer {
+public:
+  FakeDnsServer(uint32_t ttl, int dropQueries) : _ttl(ttl), _drop(dropQueries), _queries(0), _running(true) {
+    _fd = hostUdpSocket(DNS_PORT);
+    struct timeval timeout = { 0, 50000 };
+    setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    _thread = std::thread(&FakeDnsServer::serve, this);
+  }
+
+  ~FakeDnsServer() {
+    _running = false;
+    _thread.join();
+    close(_fd);
+  }
+
+  int queries() const { return _queries; }
+
+private:
+  void serve() {
+    uint8_t packet[512];
+    while (_running) {
+      struct sockaddr_in from;
+      socklen_t fromLength = sizeof(from);
+      ssize_t size = recvfrom(_fd, packet, sizeof(packet) - 16, 0, (struct sockaddr*)&from, &fromLength);
+      if (size < 12) {
+        continue;
+      }
+      if (_queries++ < _drop) {
+        continue;
+      }
+      // Answer with the question followed by one A record pointing at it
+      packet[2] = 0x81;
+      packet[3] = 0x80;
+      packet[6] = 0;
+      packet[7] = 1;
+      uint8_t answer[] = {
+        0xC0, 0x0C, 0x00, 0x01, 0x00, 0x01,
+        (uint8_t)(_ttl >> 24), (uint8_t)(_ttl >> 16), (uint8_t)(_ttl >> 8), (uint8_t)_ttl,
+        0x00, 0x04, 10, 0, 0, 42
+      };
+      memcpy(packet + size, answer, sizeof(answer));
+      sendto(_fd, packet, size + sizeof(answer), 0, (struct sockaddr*)&from, fromLength);
+    }
+  }
+
+  uint32_t _ttl;
+  int _drop;
+  std::atomic<int> _queries;
+  std::atomic<bool> _running;
+  int _fd;
+  std::thread _thread;
+};
+
+static void resolveAndCache()
+{
+  W5100.init();
+  FakeDnsServer server(300, 0);
+  DNSClient dns;
+  dns.begin(IPAddress(127, 0, 0, 1));
+
+  IPAddress address;
+  W5100Sim::instance().resetCounters();
+  CHECK(dns.getHostByName("hub.smarties.local", address) == 1);
+  printCounters("getHostByName (query)");
+  CHECK(address == IPAddress(10, 0, 0, 42));
+  CHECK(server.queries() == 1);
+
+  W5100Sim::instance().resetCounters();
+  address = IPAddress(0, 0, 0, 0);
+  CHECK(dns.getHostByName("hub.smarties.local", address) == 1);
+  printCounters("getHostByName (cached)");
+  CHECK(address == IPAddress(10, 0, 0, 42));
+  CHECK(server.queries() == 1);
+  CHECK(W5100Sim::instance().counters().spiBytes == 0);
+}
+
+static void retryWithNewQuery()
+{
+  W5100.init();
+  FakeDnsServer server(300, 1);
+  DNSClient dns;
+  dns.begin(IPAddress(127, 0, 0, 1));
+
+  IPAddress address;
+  unsigned long start = millis();
+  CHECK(dns.getHostByName("retry.smarties.local", address) == 1);
+  unsigned long elapsed = millis() - start;
+  printf("  resolved after a lost query in %lu ms\n", elapsed);
+  CHECK(address == IPAddress(10, 0, 0, 42));
+  CHECK(server.queries() == 2);
+  CHECK(elapsed < 2 * DNS_RETRY_INTERVAL);
+}
+
+static void zeroTtlIsNotCached()
+{
+  W5100.init();
+  FakeDnsServer server(0, 0);
+  DNSClient dns;
+  dns.begin(IPAddress(127, 0, 0, 1));
+
+  IPAddress address;
+  CHECK(dns.getHostByName("nocache.smarties.local", address) == 1);
+  CHECK(dns.getHostByName("nocache.smarties.local", address) == 1);
+  CHECK(server.queries() == 2);
+}
+
+int main()
+{
+  RUN(resolveAndCache);
+  RUN(retryWithNewQuery);
+  RUN(zeroTtlIsNotCached);
+  return loopbackResult();
+}
@@ -0,0 +1,80 @@
+// Helpers shared by the host loopback tests: a tiny test runner, peers on
+// the host side of the simulated W5100, and SPI cost reporting
+
+#ifndef LOOPBACK_H_INCLUDED
+#define LOOPBACK_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "W5100Sim.h"
+
+static int loopbackFailures = 0;
+
+#define CHECK(condition)                                                 \
+  do {                                                                   \
+    if (!(condition)) {                                                  \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      loopbackFailures++;                                                \
+    }                                                                    \
+  } while (0)
+
+#define RUN(test)                                                        \
+  do {                                                                   \
+    printf("== %s\n", #test);                                            \
+    W5100Sim::instance().reset();                                        \
+    test();                                                              \
+  } while (0)
+
+static inline int loopbackResult()
+{
+  if (loopbackFailures) {
+    fprintf(stderr, "%d check(s) failed\n", loopbackFailures);
+    return 1;
+  }
+  return 0;
+}
+
+static inline void printCounters(const char* label)
+{
+  const W5100Sim::Counters& c = W5100Sim::instance().counters();
+  printf("  %-28s spi=%-7u cs=%-6u rd=%-6u wr=%-6u cmd=%-4u wait=%-4u recv=%-4u send=%u\n",
+         label, c.spiBytes, c.chipSelects, c.readFrames, c.writeFrames,
+         c.commands, c.commandWaits, c.recvCommands, c.sendCommands);
+}
+
+static inline struct sockaddr_in loopbackEndpoint(uint16_t port)
+{
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  return addr;
+}
+
+// UDP socket on the host, bound to the host side of a device port (0 for any)
+static inline int hostUdpSocket(uint16_t devicePort)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr = loopbackEndpoint(devicePort ? W5100Sim::hostPort(devicePort) : 0);
+  bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+  struct timeval timeout = { 5, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+static inline void hostSendTo(int fd, uint16_t devicePort, const void* data, size_t length)
+{
+  struct sockaddr_in addr = loopbackEndpoint(W5100Sim::hostPort(devicePort));
+  sendto(fd, data, length, 0, (struct sockaddr*)&addr, sizeof(addr));
+}
+
+#endif
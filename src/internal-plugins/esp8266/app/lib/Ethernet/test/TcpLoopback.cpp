@@ -0,0 +1,176 @@
+// EthernetClient and EthernetServer against TCP peers on the host side of
+// the simulated W5100
+
+#include "Ethernet.h"
+#include "utility/w5100.h"
+
+#include <thread>
+
+#include "Loopback.h"
+
+#define ECHO_PORT   5555
+#define SERVER_PORT 8080
+
+static int hostListen(uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr = loopbackEndpoint(port);
+  bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+  listen(fd, 4);
+  return fd;
+}
+
+static int hostConnect(uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = loopbackEndpoint(port);
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  struct timeval timeout = { 5, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+static void clientEcho()
+{
+  W5100.init();
+  int listener = hostListen(ECHO_PORT);
+  std::thread echo([listener]() {
+    int fd = accept(listener, NULL, NULL);
+    char buffer[1024];
+    ssize_t size;
+    while ((size = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+      send(fd, buffer, size, 0);
+    }
+    close(fd);
+  });
+
+  EthernetClient client;
+  CHECK(client.connect(IPAddress(127, 0, 0, 1), ECHO_PORT) == 1);
+
+  uint8_t sent[1000];
+  for (size_t i = 0; i < sizeof(sent); i++) {
+    sent[i] = (uint8_t)i;
+  }
+  W5100Sim::instance().resetCounters();
+  CHECK(client.write(sent, sizeof(sent)) == sizeof(sent));
+  printCounters("write(1000)");
+
+  uint8_t received[1000];
+  size_t length = 0;
+  unsigned long start = millis();
+  W5100Sim::instance().resetCounters();
+  while (length < sizeof(received) && millis() - start < 5000) {
+    int size = client.read(received + length, sizeof(received) - length);
+    if (size > 0) {
+      length += size;
+    }
+  }
+  printCounters("read(1000)");
+  CHECK(length == sizeof(sent));
+  CHECK(memcmp(sent, received, sizeof(sent)) == 0);
+
+  client.stop();
+  echo.join();
+  close(listener);
+}
+
+static void serverAnswers()
+{
+  W5100.init();
+  EthernetServer server(SERVER_PORT);
+  server.begin();
+
+  int peer = hostConnect(SERVER_PORT);
+  CHECK(peer >= 0);
+  send(peer, "ping", 4, 0);
+
+  EthernetClient client;
+  unsigned long start = millis();
+  while (!client && millis() - start < 5000) {
+    client = server.available();
+  }
+  CHECK(client);
+  char request[4];
+  CHECK(client.read((uint8_t*)request, sizeof(request)) == 4);
+  CHECK(memcmp(request, "ping", 4) == 0);
+  client.write((const uint8_t*)"pong", 4);
+
+  char answer[4];
+  CHECK(recv(peer, answer, sizeof(answer), 0) == 4);
+  CHECK(memcmp(answer, "pong", 4) == 0);
+
+  client.stop();
+  close(peer);
+}
+
+static EthernetClient waitForClient(EthernetServer& server)
+{
+  EthernetClient client;
+  unsigned long start = millis();
+  while (!client && millis() - start < 5000) {
+    client = server.available();
+  }
+  return client;
+}
+
+static void serverSharesClients()
+{
+  W5100.init();
+  EthernetServer server(SERVER_PORT, 2);
+  server.begin();
+
+  int first = hostConnect(SERVER_PORT);
+  int second = hostConnect(SERVER_PORT);
+  CHECK(first >= 0);
+  CHECK(second >= 0);
+  send(first, "a1", 2, 0);
+  send(second, "b1", 2, 0);
+
+  unsigned long start = millis();
+  while (server.acceptQueueDepth() < 2 && millis() - start < 5000) {
+  }
+  CHECK(server.acceptQueueDepth() == 2);
+
+  // A client left unread goes behind the other one
+  EthernetClient a = waitForClient(server);
+  EthernetClient b = waitForClient(server);
+  CHECK(a);
+  CHECK(b);
+  CHECK(!(a == b));
+  char request[2];
+  CHECK(a.read((uint8_t*)request, sizeof(request)) == 2);
+  CHECK(memcmp(request, "a1", 2) == 0);
+  CHECK(b.read((uint8_t*)request, sizeof(request)) == 2);
+  CHECK(memcmp(request, "b1", 2) == 0);
+
+  // A third client still gets a listening socket
+  int third = hostConnect(SERVER_PORT);
+  CHECK(third >= 0);
+  send(third, "c1", 2, 0);
+  EthernetClient c = waitForClient(server);
+  CHECK(c);
+  CHECK(c.read((uint8_t*)request, sizeof(request)) == 2);
+  CHECK(memcmp(request, "c1", 2) == 0);
+  CHECK(server.acceptQueueDepth() == 3);
+
+  a.stop();
+  b.stop();
+  c.stop();
+  CHECK(server.acceptQueueDepth() == 0);
+  close(first);
+  close(second);
+  close(third);
+}
+
+int main()
+{
+  RUN(clientEcho);
+  RUN(serverAnswers);
+  RUN(serverSharesClients);
+  return loopbackResult();
+}
@@ -0,0 +1,129 @@
+// EthernetUDP against the simulated W5100: byte-wise and single-pass reads
+// of the same datagram, and a datagram sent back to the host
+
+#include "Ethernet.h"
+#include "EthernetUdp.h"
+#include "utility/w5100.h"
+
+#include "Loopback.h"
+
+#define LOCAL_PORT 8888
+
+static void fill(uint8_t* buffer, size_t length)
+{
+  for (size_t i = 0; i < length; i++) {
+    buffer[i] = (uint8_t)(i * 7 + 3);
+  }
+}
+
+static void readByteByByte()
+{
+  W5100.init();
+  EthernetUDP udp;
+  CHECK(udp.begin(LOCAL_PORT) == 1);
+
+  uint8_t sent[300];
+  fill(sent, sizeof(sent));
+  int host = hostUdpSocket(0);
+  hostSendTo(host, LOCAL_PORT, sent, sizeof(sent));
+  delay(10);
+
+  W5100Sim::instance().resetCounters();
+  CHECK(udp.parsePacket() == (int)sizeof(sent));
+  CHECK(udp.remotePort() != 0);
+  uint8_t received[300];
+  for (size_t i = 0; i < sizeof(received); i++) {
+    received[i] = udp.read();
+  }
+  printCounters("parsePacket + read()");
+  CHECK(memcmp(sent, received, sizeof(sent)) == 0);
+  CHECK(W5100Sim::instance().counters().recvCommands == 1 + sizeof(sent));
+
+  udp.stop();
+  close(host);
+}
+
+static void readWholeDatagram()
+{
+  W5100.init();
+  EthernetUDP udp;
+  CHECK(udp.begin(LOCAL_PORT) == 1);
+
+  uint8_t sent[300];
+  fill(sent, sizeof(sent));
+  int host = hostUdpSocket(0);
+  hostSendTo(host, LOCAL_PORT, sent, sizeof(sent));
+  delay(10);
+
+  W5100Sim::instance().resetCounters();
+  uint8_t received[512];
+  CHECK(udp.receivePacket(received, sizeof(received)) == (int)sizeof(sent));
+  printCounters("receivePacket()");
+  CHECK(memcmp(sent, received, sizeof(sent)) == 0);
+  CHECK(udp.remoteIP() == IPAddress(127, 0, 0, 1));
+  CHECK(W5100Sim::instance().counters().recvCommands == 1);
+  CHECK(udp.receivePacket(received, sizeof(received)) == 0);
+
+  udp.stop();
+  close(host);
+}
+
+static void truncateOversizedDatagram()
+{
+  W5100.init();
+  EthernetUDP udp;
+  CHECK(udp.begin(LOCAL_PORT) == 1);
+
+  uint8_t sent[100];
+  fill(sent, sizeof(sent));
+  int host = hostUdpSocket(0);
+  hostSendTo(host, LOCAL_PORT, sent, sizeof(sent));
+  hostSendTo(host, LOCAL_PORT, "next", 4);
+  delay(10);
+
+  uint8_t received[16];
+  memset(received, 0, sizeof(received));
+  CHECK(udp.receivePacket(received, 10) == (int)sizeof(sent));
+  CHECK(memcmp(sent, received, 10) == 0);
+  CHECK(received[10] == 0);
+  // The dropped tail must not leak into the next datagram
+  CHECK(udp.receivePacket(received, sizeof(received)) == 4);
+  CHECK(memcmp(received, "next", 4) == 0);
+
+  udp.stop();
+  close(host);
+}
+
+static void sendToHost()
+{
+  W5100.init();
+  EthernetUDP udp;
+  CHECK(udp.begin(LOCAL_PORT) == 1);
+
+  int host = hostUdpSocket(0);
+  struct sockaddr_in addr;
+  socklen_t length = sizeof(addr);
+  getsockname(host, (struct sockaddr*)&addr, &length);
+
+  W5100Sim::instance().resetCounters();
+  CHECK(udp.beginPacket(IPAddress(127, 0, 0, 1), ntohs(addr.sin_port)) == 1);
+  udp.write((const uint8_t*)"hello hub", 9);
+  CHECK(udp.endPacket() == 1);
+  printCounters("beginPacket/write/endPacket");
+
+  char received[32];
+  CHECK(recv(host, received, sizeof(received), 0) == 9);
+  CHECK(memcmp(received, "hello hub", 9) == 0);
+
+  udp.stop();
+  close(host);
+}
+
+int main()
+{
+  RUN(readByteByByte);
+  RUN(readWholeDatagram);
+  RUN(truncateOversizedDatagram);
+  RUN(sendToHost);
+  return loopbackResult();
+}
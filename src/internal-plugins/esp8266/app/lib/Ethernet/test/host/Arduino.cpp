@@ -0,0 +1,67 @@
+#include "Arduino.h"
+#include "SPI.h"
+#include "EEPROM.h"
+#include "W5100Sim.h"
+
+#include <time.h>
+
+SPIClass SPI;
+EEPROMClass EEPROM;
+GpioOutputRegister GPOC(false);
+GpioOutputRegister GPOS(true);
+
+static unsigned long long monotonicMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+static const unsigned long long bootTime = monotonicMicros();
+
+unsigned long millis()
+{
+  return (unsigned long)((monotonicMicros() - bootTime) / 1000);
+}
+
+unsigned long micros()
+{
+  return (unsigned long)(monotonicMicros() - bootTime);
+}
+
+void delay(unsigned long ms)
+{
+  struct timespec duration;
+  duration.tv_sec = ms / 1000;
+  duration.tv_nsec = (ms % 1000) * 1000000L;
+  nanosleep(&duration, NULL);
+}
+
+void yield()
+{
+}
+
+long random(long howsmall, long howbig)
+{
+  if (howsmall >= howbig) {
+    return howsmall;
+  }
+  return howsmall + rand() % (howbig - howsmall);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+GpioOutputRegister& GpioOutputRegister::operator=(uint32_t mask)
+{
+  if (mask & digitalPinToBitMask(SS)) {
+    W5100Sim::instance().chipSelect(_level);
+  }
+  return *this;
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  return W5100Sim::instance().transfer(data);
+}
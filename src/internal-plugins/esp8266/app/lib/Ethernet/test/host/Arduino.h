@@ -0,0 +1,43 @@
+// Minimal Arduino core for building the Ethernet library on a Linux host
+// against the simulated W5100 (see W5100Sim.h)
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define OUTPUT 0x01
+#define SS     15
+
+#define digitalPinToBitMask(pin) (1UL << (pin))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+long random(long howsmall, long howbig);
+void pinMode(uint8_t pin, uint8_t mode);
+
+// GPIO set/clear registers, only ever written with the W5100 chip select mask
+class GpioOutputRegister {
+public:
+  explicit GpioOutputRegister(bool level) : _level(level) {}
+  GpioOutputRegister& operator=(uint32_t mask);
+private:
+  bool _level;
+};
+
+extern GpioOutputRegister GPOC;
+extern GpioOutputRegister GPOS;
+
+#include "Print.h"
+#include "Stream.h"
+#include "IPAddress.h"
+
+#endif
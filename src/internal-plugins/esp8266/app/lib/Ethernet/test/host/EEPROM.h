@@ -0,0 +1,38 @@
+// RAM backed stand-in for the ESP8266 emulated EEPROM, survives Ethernet.begin()
+// calls within a test process the way flash survives a power cycle
+
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class EEPROMClass {
+public:
+  EEPROMClass() { memset(_data, 0xFF, sizeof(_data)); }
+
+  void begin(size_t size) {}
+  bool commit() { _commits++; return true; }
+  void end() {}
+
+  template<typename T> T& get(int address, T& t) {
+    memcpy(&t, _data + address, sizeof(T));
+    return t;
+  }
+  template<typename T> const T& put(int address, const T& t) {
+    memcpy(_data + address, &t, sizeof(T));
+    return t;
+  }
+
+  void clear() { memset(_data, 0xFF, sizeof(_data)); }
+  unsigned commits() const { return _commits; }
+
+private:
+  uint8_t _data[4096];
+  unsigned _commits = 0;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
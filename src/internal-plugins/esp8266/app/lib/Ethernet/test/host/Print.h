@@ -0,0 +1,36 @@
+#ifndef Print_h
+#define Print_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+class Print {
+public:
+  Print() : _writeError(0) {}
+  virtual ~Print() {}
+
+  int getWriteError() { return _writeError; }
+  void clearWriteError() { setWriteError(0); }
+
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size-- && write(*buffer++)) {
+      n++;
+    }
+    return n;
+  }
+  size_t write(const char *str) {
+    return (str == NULL) ? 0 : write((const uint8_t *)str, strlen(str));
+  }
+  virtual void flush() {}
+
+protected:
+  void setWriteError(int err = 1) { _writeError = err; }
+
+private:
+  int _writeError;
+};
+
+#endif
@@ -0,0 +1,26 @@
+// SPI bus of the Linux host build, every byte is clocked into the simulated W5100
+
+#ifndef _SPI_H_INCLUDED
+#define _SPI_H_INCLUDED
+
+#include "Arduino.h"
+
+#define MSBFIRST  1
+#define SPI_MODE0 0x00
+
+class SPISettings {
+public:
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {}
+};
+
+class SPIClass {
+public:
+  void begin() {}
+  void beginTransaction(SPISettings settings) {}
+  void endTransaction() {}
+  uint8_t transfer(uint8_t data);
+};
+
+extern SPIClass SPI;
+
+#endif
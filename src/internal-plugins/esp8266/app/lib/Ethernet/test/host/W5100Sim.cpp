@@ -0,0 +1,472 @@
+#include "W5100Sim.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Register offsets, mirroring utility/w5100.h
+#define MR        0x0000
+#define SnMR      0x0000
+#define SnCR      0x0001
+#define SnIR      0x0002
+#define SnSR      0x0003
+#define SnPORT    0x0004
+#define SnDIPR    0x000C
+#define SnDPORT   0x0010
+#define SnTX_FSR  0x0020
+#define SnTX_RD   0x0022
+#define SnTX_WR   0x0024
+#define SnRX_RSR  0x0026
+#define SnRX_RD   0x0028
+
+#define MR_RST        0x80
+#define MODE_TCP      0x01
+#define MODE_UDP      0x02
+
+#define CMD_OPEN      0x01
+#define CMD_LISTEN    0x02
+#define CMD_CONNECT   0x04
+#define CMD_DISCON    0x08
+#define CMD_CLOSE     0x10
+#define CMD_SEND      0x20
+#define CMD_SEND_MAC  0x21
+#define CMD_SEND_KEEP 0x22
+#define CMD_RECV      0x40
+
+#define IR_SEND_OK    0x10
+#define IR_RECV       0x04
+#define IR_DISCON     0x02
+#define IR_CON        0x01
+
+#define SR_CLOSED      0x00
+#define SR_INIT        0x13
+#define SR_LISTEN      0x14
+#define SR_ESTABLISHED 0x17
+#define SR_CLOSE_WAIT  0x1C
+#define SR_UDP         0x22
+
+#define UDP_HEADER_SIZE 8
+
+W5100Sim& W5100Sim::instance()
+{
+  static W5100Sim sim;
+  return sim;
+}
+
+W5100Sim::W5100Sim() : _selected(false), _frameLength(0)
+{
+  for (int s = 0; s < SOCKETS; s++) {
+    _fd[s] = -1;
+    _listenFd[s] = -1;
+  }
+  reset();
+}
+
+void W5100Sim::reset()
+{
+  for (int s = 0; s < SOCKETS; s++) {
+    closeSocket(s);
+  }
+  memset(_memory, 0, sizeof(_memory));
+  for (int s = 0; s < SOCKETS; s++) {
+    set16(socketRegister(s, SnTX_FSR), BUF_SIZE);
+    _rxWrite[s] = 0;
+    _rxRead[s] = 0;
+    _txWrite[s][0] = 0;
+    _txWrite[s][1] = 0;
+  }
+  _selected = false;
+  _frameLength = 0;
+  resetCounters();
+}
+
+void W5100Sim::resetCounters()
+{
+  memset(&_counters, 0, sizeof(_counters));
+}
+
+uint16_t W5100Sim::hostPort(uint16_t devicePort)
+{
+  return (devicePort < PRIVILEGED_PORTS) ? devicePort + PORT_OFFSET : devicePort;
+}
+
+uint16_t W5100Sim::devicePort(uint16_t hostPort)
+{
+  if (hostPort >= PORT_OFFSET && hostPort < PORT_OFFSET + PRIVILEGED_PORTS) {
+    return hostPort - PORT_OFFSET;
+  }
+  return hostPort;
+}
+
+void W5100Sim::chipSelect(bool level)
+{
+  if (!level && !_selected) {
+    _counters.chipSelects++;
+  }
+  _selected = !level;
+  _frameLength = 0;
+}
+
+uint8_t W5100Sim::transfer(uint8_t data)
+{
+  _counters.spiBytes++;
+  if (!_selected) {
+    // Nobody is listening on the bus
+    return 0;
+  }
+
+  if (_frameLength < 3) {
+    _frame[_frameLength++] = data;
+    return 0;
+  }
+
+  // Fourth byte of the frame: opcode, address high, address low, data
+  uint16_t addr = (_frame[1] << 8) | _frame[2];
+  _frameLength = 0;
+  if (_frame[0] == 0xF0) {
+    _counters.writeFrames++;
+    writeRegister(addr, data);
+    return 0;
+  }
+  if (_frame[0] == 0x0F) {
+    _counters.readFrames++;
+    return readRegister(addr);
+  }
+  return 0;
+}
+
+uint16_t W5100Sim::get16(uint16_t addr) const
+{
+  return (_memory[addr] << 8) | _memory[addr + 1];
+}
+
+void W5100Sim::set16(uint16_t addr, uint16_t value)
+{
+  _memory[addr] = value >> 8;
+  _memory[addr + 1] = value & 0xFF;
+}
+
+uint8_t W5100Sim::readRegister(uint16_t addr)
+{
+  addr &= MEMORY_SIZE - 1;
+  if (addr >= CH_BASE && addr < CH_BASE + SOCKETS * CH_SIZE) {
+    int s = (addr - CH_BASE) / CH_SIZE;
+    uint16_t offset = (addr - CH_BASE) % CH_SIZE;
+    if (offset == SnCR) {
+      // Commands complete immediately, this is the library polling for it
+      _counters.commandWaits++;
+    } else if (offset == SnSR || offset == SnRX_RSR) {
+      poll(s);
+    }
+  }
+  return _memory[addr];
+}
+
+void W5100Sim::writeRegister(uint16_t addr, uint8_t data)
+{
+  addr &= MEMORY_SIZE - 1;
+  if (addr == MR) {
+    if (data & MR_RST) {
+      reset();
+      return;
+    }
+    _memory[addr] = data;
+    return;
+  }
+
+  if (addr >= CH_BASE && addr < CH_BASE + SOCKETS * CH_SIZE) {
+    int s = (addr - CH_BASE) / CH_SIZE;
+    uint16_t offset = (addr - CH_BASE) % CH_SIZE;
+    if (offset == SnCR) {
+      execute(s, data);
+      _memory[addr] = 0;
+      return;
+    }
+    if (offset == SnIR) {
+      // Write one to clear
+      _memory[addr] &= ~data;
+      return;
+    }
+    if (offset == SnTX_WR || offset == SnTX_WR + 1) {
+      // Latched until the next Sock_SEND, reads keep returning the
+      // pointer of the last send (send_data_processing_offset relies on it)
+      _txWrite[s][offset - SnTX_WR] = data;
+      return;
+    }
+  }
+  _memory[addr] = data;
+}
+
+void W5100Sim::execute(int s, uint8_t command)
+{
+  _counters.commands++;
+  switch (command) {
+    case CMD_OPEN:
+      open(s);
+      break;
+    case CMD_LISTEN:
+      listen(s);
+      break;
+    case CMD_CONNECT:
+      connect(s);
+      break;
+    case CMD_DISCON:
+    case CMD_CLOSE:
+      closeSocket(s);
+      break;
+    case CMD_SEND:
+    case CMD_SEND_MAC:
+    case CMD_SEND_KEEP:
+      _counters.sendCommands++;
+      send(s);
+      break;
+    case CMD_RECV:
+      _counters.recvCommands++;
+      _rxRead[s] = get16(socketRegister(s, SnRX_RD));
+      updateReceivedSize(s);
+      break;
+    default:
+      break;
+  }
+}
+
+static void loopbackAddress(struct sockaddr_in& addr, const uint8_t* ip, uint16_t port)
+{
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (ip && !(ip[0] == 255 && ip[1] == 255 && ip[2] == 255 && ip[3] == 255)) {
+    memcpy(&addr.sin_addr.s_addr, ip, 4);
+  } else {
+    // The limited broadcast address stays on the loopback interface
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  }
+}
+
+void W5100Sim::open(int s)
+{
+  closeSocket(s);
+
+  uint8_t mode = _memory[socketRegister(s, SnMR)] & 0x0F;
+  uint16_t port = get16(socketRegister(s, SnPORT));
+
+  set16(socketRegister(s, SnTX_RD), 0);
+  set16(socketRegister(s, SnTX_WR), 0);
+  _txWrite[s][0] = 0;
+  _txWrite[s][1] = 0;
+  set16(socketRegister(s, SnTX_FSR), BUF_SIZE);
+  set16(socketRegister(s, SnRX_RD), 0);
+  set16(socketRegister(s, SnRX_RSR), 0);
+  _rxWrite[s] = 0;
+  _rxRead[s] = 0;
+  _memory[socketRegister(s, SnIR)] = 0;
+
+  if (mode == MODE_UDP) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+    struct sockaddr_in addr;
+    loopbackAddress(addr, NULL, hostPort(port));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+      ::close(fd);
+      return;
+    }
+    _fd[s] = fd;
+    _memory[socketRegister(s, SnSR)] = SR_UDP;
+  } else if (mode == MODE_TCP) {
+    _memory[socketRegister(s, SnSR)] = SR_INIT;
+  }
+}
+
+void W5100Sim::listen(int s)
+{
+  if (_memory[socketRegister(s, SnSR)] != SR_INIT) {
+    return;
+  }
+
+  // Sockets listening on the same port share one host listener, whichever
+  // of them polls first takes the next pending connection
+  uint16_t port = get16(socketRegister(s, SnPORT));
+  for (int t = 0; t < SOCKETS; t++) {
+    if (t != s && _listenFd[t] >= 0 && get16(socketRegister(t, SnPORT)) == port) {
+      _listenFd[s] = _listenFd[t];
+      _memory[socketRegister(s, SnSR)] = SR_LISTEN;
+      return;
+    }
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  loopbackAddress(addr, NULL, hostPort(port));
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(fd, SOCKETS) != 0) {
+    ::close(fd);
+    _memory[socketRegister(s, SnSR)] = SR_CLOSED;
+    return;
+  }
+  _listenFd[s] = fd;
+  _memory[socketRegister(s, SnSR)] = SR_LISTEN;
+}
+
+void W5100Sim::connect(int s)
+{
+  if (_memory[socketRegister(s, SnSR)] != SR_INIT) {
+    return;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  loopbackAddress(addr, &_memory[socketRegister(s, SnDIPR)], hostPort(get16(socketRegister(s, SnDPORT))));
+  if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    ::close(fd);
+    _memory[socketRegister(s, SnSR)] = SR_CLOSED;
+    return;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  _fd[s] = fd;
+  _memory[socketRegister(s, SnSR)] = SR_ESTABLISHED;
+  _memory[socketRegister(s, SnIR)] |= IR_CON;
+}
+
+void W5100Sim::send(int s)
+{
+  uint16_t rd = get16(socketRegister(s, SnTX_RD));
+  uint16_t wr = (_txWrite[s][0] << 8) | _txWrite[s][1];
+  uint16_t len = wr - rd;
+  uint8_t data[BUF_SIZE];
+  uint16_t base = TXBUF_BASE + s * BUF_SIZE;
+
+  for (uint16_t i = 0; i < len && i < BUF_SIZE; i++) {
+    data[i] = _memory[base + ((rd + i) & BUF_MASK)];
+  }
+
+  uint8_t status = _memory[socketRegister(s, SnSR)];
+  if (status == SR_UDP && _fd[s] >= 0) {
+    struct sockaddr_in addr;
+    loopbackAddress(addr, &_memory[socketRegister(s, SnDIPR)], hostPort(get16(socketRegister(s, SnDPORT))));
+    sendto(_fd[s], data, len, 0, (struct sockaddr*)&addr, sizeof(addr));
+  } else if ((status == SR_ESTABLISHED || status == SR_CLOSE_WAIT) && _fd[s] >= 0) {
+    uint16_t sent = 0;
+    while (sent < len) {
+      ssize_t n = ::send(_fd[s], data + sent, len - sent, MSG_NOSIGNAL);
+      if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        break;
+      }
+      if (n > 0) {
+        sent += n;
+      }
+    }
+  }
+
+  set16(socketRegister(s, SnTX_RD), wr);
+  set16(socketRegister(s, SnTX_WR), wr);
+  set16(socketRegister(s, SnTX_FSR), BUF_SIZE);
+  _memory[socketRegister(s, SnIR)] |= IR_SEND_OK;
+}
+
+void W5100Sim::closeSocket(int s)
+{
+  if (_fd[s] >= 0) {
+    ::close(_fd[s]);
+    _fd[s] = -1;
+  }
+  releaseListener(s);
+  _memory[socketRegister(s, SnSR)] = SR_CLOSED;
+}
+
+void W5100Sim::releaseListener(int s)
+{
+  int fd = _listenFd[s];
+  if (fd < 0) {
+    return;
+  }
+  _listenFd[s] = -1;
+  for (int t = 0; t < SOCKETS; t++) {
+    if (_listenFd[t] == fd) {
+      return;
+    }
+  }
+  ::close(fd);
+}
+
+void W5100Sim::updateReceivedSize(int s)
+{
+  set16(socketRegister(s, SnRX_RSR), _rxWrite[s] - _rxRead[s]);
+}
+
+void W5100Sim::poll(int s)
+{
+  uint8_t status = _memory[socketRegister(s, SnSR)];
+  uint16_t base = RXBUF_BASE + s * BUF_SIZE;
+  uint8_t data[BUF_SIZE];
+
+  if (status == SR_LISTEN && _listenFd[s] >= 0) {
+    int fd = accept4(_listenFd[s], NULL, NULL, SOCK_NONBLOCK);
+    if (fd < 0) {
+      return;
+    }
+    releaseListener(s);
+    _fd[s] = fd;
+    status = SR_ESTABLISHED;
+    _memory[socketRegister(s, SnSR)] = status;
+    _memory[socketRegister(s, SnIR)] |= IR_CON;
+  }
+
+  if (_fd[s] < 0) {
+    return;
+  }
+
+  if (status == SR_UDP) {
+    for (;;) {
+      uint16_t space = BUF_SIZE - (uint16_t)(_rxWrite[s] - _rxRead[s]);
+      ssize_t size = recv(_fd[s], data, 1, MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+      if (size < 0 || size + UDP_HEADER_SIZE > space) {
+        break;
+      }
+
+      struct sockaddr_in from;
+      socklen_t fromLength = sizeof(from);
+      size = recvfrom(_fd[s], data + UDP_HEADER_SIZE, BUF_SIZE - UDP_HEADER_SIZE, 0, (struct sockaddr*)&from, &fromLength);
+      if (size < 0) {
+        break;
+      }
+      uint16_t port = devicePort(ntohs(from.sin_port));
+      memcpy(data, &from.sin_addr.s_addr, 4);
+      data[4] = port >> 8;
+      data[5] = port & 0xFF;
+      data[6] = size >> 8;
+      data[7] = size & 0xFF;
+      for (ssize_t i = 0; i < size + UDP_HEADER_SIZE; i++) {
+        _memory[base + ((_rxWrite[s] + i) & BUF_MASK)] = data[i];
+      }
+      _rxWrite[s] += size + UDP_HEADER_SIZE;
+      _memory[socketRegister(s, SnIR)] |= IR_RECV;
+    }
+  } else if (status == SR_ESTABLISHED) {
+    uint16_t space = BUF_SIZE - (uint16_t)(_rxWrite[s] - _rxRead[s]);
+    if (space > 0) {
+      ssize_t size = recv(_fd[s], data, space, MSG_DONTWAIT);
+      if (size == 0) {
+        // The peer closed its side
+        _memory[socketRegister(s, SnSR)] = SR_CLOSE_WAIT;
+        _memory[socketRegister(s, SnIR)] |= IR_DISCON;
+      } else if (size > 0) {
+        for (ssize_t i = 0; i < size; i++) {
+          _memory[base + ((_rxWrite[s] + i) & BUF_MASK)] = data[i];
+        }
+        _rxWrite[s] += size;
+        _memory[socketRegister(s, SnIR)] |= IR_RECV;
+      }
+    }
+  }
+
+  updateReceivedSize(s);
+}
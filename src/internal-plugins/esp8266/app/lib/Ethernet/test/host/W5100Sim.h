@@ -0,0 +1,93 @@
+// Register level model of the W5100 used by the Linux host build of the
+// Ethernet library. The SPI frames sent by utility/w5100.cpp are decoded
+// against a 32 KB register file, socket commands are carried out on real
+// loopback sockets, and every SPI byte, chip select and command is counted
+// so per-operation costs can be measured and regression-tested.
+
+#ifndef W5100SIM_H_INCLUDED
+#define W5100SIM_H_INCLUDED
+
+#include <stdint.h>
+
+class W5100Sim {
+public:
+  struct Counters {
+    uint32_t spiBytes;      // bytes clocked over SPI
+    uint32_t chipSelects;   // CS assertions, one per register frame
+    uint32_t readFrames;    // register read frames
+    uint32_t writeFrames;   // register write frames
+    uint32_t commands;      // socket commands issued through SnCR
+    uint32_t commandWaits;  // SnCR polls waiting for a command to complete
+    uint32_t recvCommands;  // Sock_RECV commands
+    uint32_t sendCommands;  // Sock_SEND commands
+  };
+
+  // Device ports below this are shifted by PORT_OFFSET on the host so that
+  // DNS and DHCP can be exercised without root
+  static const uint16_t PRIVILEGED_PORTS = 1024;
+  static const uint16_t PORT_OFFSET = 20000;
+
+  static W5100Sim& instance();
+
+  // Close every host socket and clear the register file and counters
+  void reset();
+
+  void resetCounters();
+  const Counters& counters() const { return _counters; }
+
+  // Host port a device side port is bound to, and back
+  static uint16_t hostPort(uint16_t devicePort);
+  static uint16_t devicePort(uint16_t hostPort);
+
+  // Bus interface driven by the SPI and GPIO shims
+  void chipSelect(bool level);
+  uint8_t transfer(uint8_t data);
+
+private:
+  static const int SOCKETS = 4;
+  static const uint16_t MEMORY_SIZE = 0x8000;
+  static const uint16_t CH_BASE = 0x0400;
+  static const uint16_t CH_SIZE = 0x0100;
+  static const uint16_t TXBUF_BASE = 0x4000;
+  static const uint16_t RXBUF_BASE = 0x6000;
+  static const uint16_t BUF_SIZE = 2048;
+  static const uint16_t BUF_MASK = 0x07FF;
+
+  W5100Sim();
+
+  uint8_t readRegister(uint16_t addr);
+  void writeRegister(uint16_t addr, uint8_t data);
+
+  uint16_t get16(uint16_t addr) const;
+  void set16(uint16_t addr, uint16_t value);
+  uint16_t socketRegister(int s, uint16_t offset) const { return CH_BASE + s * CH_SIZE + offset; }
+
+  void execute(int s, uint8_t command);
+  void open(int s);
+  void listen(int s);
+  void connect(int s);
+  void send(int s);
+  void closeSocket(int s);
+  // Drop a socket's share of a host listener, closing it with the last one
+  void releaseListener(int s);
+  // Move whatever the host socket has pending into the RX ring
+  void poll(int s);
+  void updateReceivedSize(int s);
+
+  uint8_t _memory[MEMORY_SIZE];
+  int _fd[SOCKETS];
+  int _listenFd[SOCKETS];
+  // RX ring pointers as seen by the chip, RSR only moves on Sock_RECV
+  uint16_t _rxWrite[SOCKETS];
+  uint16_t _rxRead[SOCKETS];
+  // Sn_TX_WR as last written by the library
+  uint8_t _txWrite[SOCKETS][2];
+
+  bool _selected;
+  uint8_t _frame[4];
+  int _frameLength;
+
+  Counters _counters;
+};
+
+#endif
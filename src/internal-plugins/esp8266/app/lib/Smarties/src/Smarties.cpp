@@ -5,6 +5,7 @@ int MAX_TIME_CONNECTION_RETRY = 30; // In seconds
 float MAX_TIME_SLEEP = (ESP.deepSleepMax() / 1000000L);
 int HTTP_SENSOR_TIMEOUT = 20 * 1000;
 int HTTP_PING_TIMEOUT = 10 * 1000;
+int HTTP_READINGS_TIMEOUT = 20 * 1000;
 
 int POWER_MODE_DEEP_SLEEP = 0;
 int POWER_MODE_SLEEP = 1;
@@ -20,10 +21,41 @@ DynamicJsonBuffer sensorBuffer;
 JsonObject& sensorValues = sensorBuffer.createObject();
 DynamicJsonBuffer configBuffer;
 JsonVariant config;
+boolean configParsed = false;
+smarties_device_t device;
 WiFiClient client;
 
-int poweredMode = POWER_MODE_SLEEP;
-int sleepTime = 60;
+int poweredMode = SMARTIES_POWERED_MODE;
+int sleepTime = SMARTIES_TIMER;
+
+unsigned long sensorPowerOn = 0;
+boolean wifiResuming = false;
+
+smarties_readings_t readings;
+uint32_t clockBase = 0;
+
+#define ACQUISITION_PENDING  0
+#define ACQUISITION_STARTED  1
+#define ACQUISITION_DONE     2
+
+// Written only here so that the magic appears once in the image. Volatile
+// keeps the compiler from folding the empty initializer into the reads.
+const volatile smarties_config_t smartiesConfig PROGMEM __attribute__((used, aligned(4))) = {
+    {'S', 'M', 'A', 'R', 'T', 'I', 'E', 'S', '-', 'C', 'O', 'N', 'F', 'I', 'G', '!'}, 0, 0, {0, 0, 0, 0}, {{0}, {0}, {0}}, {0}
+};
+
+acquisition_task_t acquisitions[ACQUISITION_MAX_TASKS];
+uint8_t acquisitionCount = 0;
+
+WiFiClient channelClient;
+char channelLine[CHANNEL_LINE_SIZE];
+size_t channelLength = 0;
+unsigned long channelAttempt = 0;
+unsigned long channelSent = 0;
+unsigned long channelReceived = 0;
+boolean channelTried = false;
+channel_command_t channelCommands[CHANNEL_MAX_COMMANDS];
+uint8_t channelCommandCount = 0;
 
 // #ifdef ENABLE_ADC_VCC_MONITOR
 // ADC_MODE(ADC_VCC); // For VCC read
@@ -44,6 +76,7 @@ void Smarties::enableVccPin(int pin) {
     Serial.println("Enable VCC pin");
     pinMode(pin, OUTPUT);
     digitalWrite(pin, HIGH);
+    sensorPowerOn = millis();
     delay(200);
 }
 
@@ -55,30 +88,147 @@ void Smarties::disableVccPin(int pin) {
     pinMode(pin, INPUT);
 }
 
-void Smarties::setup(String jsonConfiguration)
+// Burst read of A0 with the radio off, filtered with trimmedMean()
+// system_adc_read_fast() only runs with Wi-Fi in NULL_MODE and interrupts
+// locked, so the station is dropped for the burst and resumed afterwards
+uint16_t Smarties::readAnalog(uint16_t samples) {
+    uint16_t buffer[ANALOG_MAX_SAMPLES];
+    samples = constrain(samples, 1, ANALOG_MAX_SAMPLES);
+
+    uint8_t mode = wifi_get_opmode();
+    if (mode != NULL_MODE) {
+        wifi_set_opmode_current(NULL_MODE);
+    }
+
+    system_soft_wdt_stop();
+    ets_intr_lock();
+    system_adc_read_fast(buffer, samples, 8);
+    ets_intr_unlock();
+    system_soft_wdt_restart();
+
+    if (mode != NULL_MODE) {
+        wifi_set_opmode_current(mode);
+        resumeWifi();
+    }
+
+    return trimmedMean(buffer, samples);
+}
+
+// Sorts the samples in place and averages the middle half, dropping the
+// lowest and highest quarter. Below four samples this is the median.
+uint16_t Smarties::trimmedMean(uint16_t *samples, uint16_t count) {
+    if (count == 0) {
+        return 0;
+    }
+
+    for (uint16_t i = 1; i < count; i++) {
+        uint16_t value = samples[i];
+        uint16_t j = i;
+        while (j > 0 && samples[j - 1] > value) {
+            samples[j] = samples[j - 1];
+            j--;
+        }
+        samples[j] = value;
+    }
+
+    uint16_t trim = count / 4;
+    if (trim == 0) {
+        return samples[count / 2];
+    }
+
+    uint32_t sum = 0;
+    uint16_t kept = count - 2 * trim;
+    for (uint16_t i = trim; i < count - trim; i++) {
+        sum += samples[i];
+    }
+
+    return (sum + kept / 2) / kept;
+}
+
+void Smarties::setup()
 {
     Serial.begin(115200);
-    config = NULL;
-    parseConfig(jsonConfiguration);
     Serial.println("Smarties ESP8266 library");
-    Serial.println("Configuration : ");
-    Serial.println(jsonConfiguration);
-
-    poweredMode = config["options"]["poweredMode"];
-    sleepTime = config["options"]["timer"];
+    Serial.println(String(SMARTIES_IOT_APP) + " version " + String(SMARTIES_VERSION));
+    loadDevice();
+    Serial.println("IoT : " + String(device.id));
+    loadReadings();
 
     if (!shouldFirmwareUpdate()) {
         checkRun();
     }
 
+    // Sensors warm up while the station associates
+    enableVccPin(SENSOR_VCC_PIN);
+
     connect();
 
     if (shouldFirmwareUpdate()) {
         Serial.println("Entering firmware update mode");
         updateFirmware();
     }
+}
 
-    enableVccPin(SENSOR_VCC_PIN);
+static uint32_t fnv1a(uint32_t hash, uint32_t word, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++) {
+        hash = (hash ^ ((word >> (i * 8)) & 0xFF)) * 16777619UL;
+    }
+
+    return hash;
+}
+
+// Copies the IoT settings written into the firmware image by the hub to RAM,
+// checking them along with the JSON. Flash only takes aligned 32 bit loads,
+// the region is read a word at a time.
+boolean Smarties::loadDevice() {
+    uint32_t length = smartiesConfig.length;
+    const volatile uint32_t *words = (const volatile uint32_t *)&smartiesConfig.device;
+    uint32_t *target = (uint32_t *)&device;
+    uint32_t hash = 2166136261UL;
+
+    for (uint32_t i = 0; i < sizeof(smarties_device_t) / 4; i++) {
+        target[i] = words[i];
+        hash = fnv1a(hash, target[i], 4);
+    }
+
+    words = (const volatile uint32_t *)smartiesConfig.data;
+    for (uint32_t i = 0; i < length && length <= SMARTIES_CONFIG_SIZE; i += 4) {
+        hash = fnv1a(hash, words[i >> 2], (length - i < 4) ? length - i : 4);
+    }
+
+    if (length > SMARTIES_CONFIG_SIZE || hash != smartiesConfig.checksum) {
+        Serial.println("Error : no valid configuration in firmware");
+        memset(&device, 0, sizeof(smarties_device_t));
+        return false;
+    }
+
+    device.id[SMARTIES_ID_SIZE - 1] = 0;
+    device.ssid[SMARTIES_SSID_SIZE - 1] = 0;
+    device.passphrase[SMARTIES_PASSPHRASE_SIZE - 1] = 0;
+
+    return true;
+}
+
+// Whole IoT configuration as JSON, checked by loadDevice()
+String Smarties::loadConfig() {
+    uint32_t length = smartiesConfig.length;
+    const volatile uint32_t *words = (const volatile uint32_t *)smartiesConfig.data;
+
+    if (length == 0 || length > SMARTIES_CONFIG_SIZE) {
+        return "{}";
+    }
+
+    String json;
+    json.reserve(length);
+    uint32_t word = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        if ((i & 3) == 0) {
+            word = words[i >> 2];
+        }
+        json += (char)((word >> ((i & 3) * 8)) & 0xFF);
+    }
+
+    return json;
 }
 
 JsonObject &Smarties::parseJson(DynamicJsonBuffer &jsonBuffer, String json) {
@@ -90,28 +240,25 @@ JsonObject &Smarties::parseJson(DynamicJsonBuffer &jsonBuffer, String json) {
     return root;
 }
 
-void Smarties::parseConfig(String jsonConfiguration) {
-    config = parseJson(configBuffer, jsonConfiguration);
-}
-
+// The library itself only uses the typed settings, the JSON is parsed on
+// first use for apps needing other form values
 JsonVariant &Smarties::getConfig() {
+    if (!configParsed) {
+        config = parseJson(configBuffer, loadConfig());
+        configParsed = true;
+    }
+
     return config;
 }
 
 void Smarties::connect() {
     if (WiFi.status() != WL_CONNECTED) {
         #ifdef ESP8266
-            const char* iotApp = config["iotApp"];
-            const char* id = config["id"];
-            WiFi.hostname(String(iotApp) + "-" + String(id));
+            WiFi.hostname(String(SMARTIES_IOT_APP) + "-" + String(device.id));
         #endif
 
-            const char* ssid = config["ESP8266Form"]["ssid"];
-            const char* passphrase = config["ESP8266Form"]["passphrase"];
-
-            Serial.println("SSID : " + String(ssid));
-            Serial.println("Passphrase : " + String(passphrase));
-            WiFi.begin(ssid, passphrase);
+            Serial.println("SSID : " + String(device.ssid));
+            WiFi.begin(device.ssid, device.passphrase);
             int counter = 0;
             while ((WiFi.status() != WL_CONNECTED) && (counter < MAX_TIME_CONNECTION_ATTEMPT)) {
                 delay(500);
@@ -142,6 +289,100 @@ void Smarties::connect() {
     ping();
 }
 
+unsigned long Smarties::sensorPoweredFor() {
+    return millis() - sensorPowerOn;
+}
+
+// Register a sensor read for acquire(). start() is called once the sensors
+// have been powered for warmup ms, then finish() once ready() returns true.
+// A NULL ready() means the result is available as soon as start() returns.
+boolean Smarties::addAcquisition(AcquisitionStep start, AcquisitionReady ready, AcquisitionStep finish, unsigned long warmup) {
+    if (acquisitionCount >= ACQUISITION_MAX_TASKS) {
+        Serial.println("Error : too many acquisitions");
+        return false;
+    }
+
+    acquisition_task_t &task = acquisitions[acquisitionCount++];
+    task.start = start;
+    task.ready = ready;
+    task.finish = finish;
+    task.warmup = warmup;
+    task.state = ACQUISITION_PENDING;
+
+    return true;
+}
+
+// Run every registered acquisition, in registration order, overlapping the
+// ones that convert in the background. Whatever is still pending after
+// timeout ms is started and finished anyway so that every result is set.
+void Smarties::acquire(unsigned long timeout) {
+    unsigned long begin = millis();
+    uint8_t remaining = acquisitionCount;
+
+    for (uint8_t i = 0; i < acquisitionCount; i++) {
+        acquisitions[i].state = ACQUISITION_PENDING;
+    }
+
+    while (remaining > 0 && (millis() - begin) < timeout) {
+        for (uint8_t i = 0; i < acquisitionCount; i++) {
+            acquisition_task_t &task = acquisitions[i];
+            if (task.state == ACQUISITION_PENDING && sensorPoweredFor() >= task.warmup) {
+                task.start();
+                task.state = ACQUISITION_STARTED;
+            }
+            if (task.state == ACQUISITION_STARTED && (task.ready == NULL || task.ready())) {
+                if (task.finish != NULL) {
+                    task.finish();
+                }
+                task.state = ACQUISITION_DONE;
+                remaining--;
+            }
+        }
+        yield();
+    }
+
+    if (remaining > 0) {
+        Serial.println("Acquisition timeout, " + String(remaining) + " pending");
+        for (uint8_t i = 0; i < acquisitionCount; i++) {
+            acquisition_task_t &task = acquisitions[i];
+            if (task.state == ACQUISITION_PENDING) {
+                task.start();
+            }
+            if (task.state != ACQUISITION_DONE && task.finish != NULL) {
+                task.finish();
+            }
+            task.state = ACQUISITION_DONE;
+        }
+    }
+
+    Serial.println("Acquisition done in " + String(millis() - begin) + "ms");
+}
+
+// Rejoin the saved access point after the radio was switched off, without
+// restarting the HTTP server or pinging again. Association carries on in the
+// background until waitWifi() is called before the next transmission.
+void Smarties::resumeWifi() {
+    WiFi.begin();
+    wifiResuming = true;
+}
+
+void Smarties::waitWifi() {
+    if (!wifiResuming) {
+        return;
+    }
+
+    wifiResuming = false;
+    int counter = 0;
+    while ((WiFi.status() != WL_CONNECTED) && (counter < MAX_TIME_CONNECTION_ATTEMPT)) {
+        delay(500);
+        counter++;
+    }
+
+    if (WiFi.status() != WL_CONNECTED) {
+        Serial.println("WiFi not resumed after analog read");
+    }
+}
+
 int Smarties::getResetReason() {
   rst_info* ri = system_get_rst_info();
   if (ri == NULL)
@@ -192,9 +433,7 @@ void Smarties::checkRun() {
 }
 
 String Smarties::baseUrl() {
-    const char* apiUrl = config["apiUrl"];
-
-    return apiUrl;
+    return SMARTIES_API_URL;
 }
 
 void Smarties::httpUpdateServer() {
@@ -231,13 +470,13 @@ void Smarties::httpUpdateServer() {
 
 void Smarties::ping() {
     if (!shouldFirmwareUpdate()) {
-        const char* id = config["id"];
+        const char* id = device.id;
         String ip = WiFi.localIP().toString();
         long freeHeap = ESP.getFreeHeap();
         // ADC_MODE(ADC_VCC);
         float vcc = ESP.getVcc() / 1000;
         // ADC_MODE(ADC_TOUT);
-        const int currentVersion = config["version"];
+        const int currentVersion = SMARTIES_VERSION;
 
         DynamicJsonBuffer pingBuffer;
         JsonObject& pingData = pingBuffer.createObject();
@@ -248,6 +487,10 @@ void Smarties::ping() {
 
         String payload = transmit(baseUrl() + "esp/ping/" + String(id) + "/", pingData, HTTP_PING_TIMEOUT);
 
+        if (payload.length() > 0 && readings.count > 0) {
+            sendReadings();
+        }
+
         if (payload != NULL) {
             DynamicJsonBuffer updateBuffer;
             JsonVariant updateData = parseJson(updateBuffer, payload);
@@ -263,7 +506,7 @@ void Smarties::ping() {
 }
 
 void Smarties::updateFirmware() {
-    const char* id = config["id"];
+    const char* id = device.id;
     Serial.println("Updating ...");
     resetFirmwareUpdate();
     updating = true;
@@ -291,17 +534,24 @@ void Smarties::updateFirmware() {
 }
 
 String Smarties::transmit(String url, JsonObject& jsonObject, int timeout) {
+    int httpCode = 0;
+    return transmit(url, jsonObject, timeout, httpCode);
+}
+
+// The status code is set to 0 when the hub could not be reached
+String Smarties::transmit(String url, JsonObject& jsonObject, int timeout, int &httpCode) {
     String data;
     String payload;
     jsonObject.printTo(data);
 
     Serial.println("Calling " + url + " with data " + data);
+    waitWifi();
     if (WiFi.status() == WL_CONNECTED) {
         HTTPClient http;
         http.setTimeout(timeout);
         http.begin(client, url);
         http.addHeader("Content-Type", "application/json");
-        int httpCode = http.POST(data);
+        httpCode = http.POST(data);
 
         if (httpCode == HTTP_CODE_OK || httpCode == 500) {
             payload = http.getString();
@@ -310,15 +560,30 @@ String Smarties::transmit(String url, JsonObject& jsonObject, int timeout) {
         Serial.println("Response payload : " + payload);
         http.end();
     } else {
+        httpCode = 0;
         Serial.println("Could not transmit data. Not connected to network.");
     }
 
     return payload;
 }
 
+// Values are only taken by the hub on a 200 {"success":true} answer, a hub
+// error also has a body
+boolean Smarties::deliver(String url, JsonObject& jsonObject, int timeout) {
+    int httpCode = 0;
+    String payload = transmit(url, jsonObject, timeout, httpCode);
+    if (httpCode != HTTP_CODE_OK) {
+        return false;
+    }
+
+    DynamicJsonBuffer jsonBuffer;
+    JsonObject &response = jsonBuffer.parseObject(payload);
+    return response.success() && response["success"].as<bool>();
+}
+
 void Smarties::postSensorValue(String sensorType, float value) {
     if (!shouldFirmwareUpdate()) {
-        String id = config["id"];
+        String id = device.id;
         // ADC_MODE(ADC_VCC);
         String vcc = String(ESP.getVcc() / 1000);
         // ADC_MODE(ADC_TOUT);
@@ -334,12 +599,27 @@ void Smarties::postSensorValue(String sensorType, float value) {
         // Store values
         sensorValues[sensorType] = value;
 
-        transmit(url, root, HTTP_SENSOR_TIMEOUT);
+        // Older readings go first, and a hub that did not take them will not take this one either
+        if (readings.count > 0 && !sendReadings()) {
+            storeReading(sensorType, value);
+            return;
+        }
+
+        if (!deliver(url, root, HTTP_SENSOR_TIMEOUT)) {
+            storeReading(sensorType, value);
+        }
     }
 }
 
+// Publish a local value on /values without posting it to the hub. The name
+// is stored by pointer and must outlive the node (a string literal).
+void Smarties::setValue(const char *name, unsigned long value) {
+    sensorValues[name] = value;
+}
+
 void Smarties::loop() {
     Serial.println("+> Connecting");
+    waitWifi();
     if (WiFi.status() != WL_CONNECTED) {
         Serial.println("+> Connect");
         connect();
@@ -361,6 +641,225 @@ void Smarties::loop() {
     rest(poweredMode, _min(MAX_TIME_SLEEP, sleepTime));
 }
 
+// Hub host, taken from the api url (http://host:port/...)
+String Smarties::apiHost() {
+    String url = String(SMARTIES_API_URL);
+    int start = url.indexOf("://");
+    start = (start < 0) ? 0 : start + 3;
+    int end = start;
+    while (end < (int)url.length() && url[end] != ':' && url[end] != '/') {
+        end++;
+    }
+
+    return url.substring(start, end);
+}
+
+// Keep the channel to the hub open and serve it, to be called from the app
+// loop of always powered nodes. The hub gets state changes as they happen
+// and sends commands on the same connection instead of HTTP requests. Either
+// side sends a PING after CHANNEL_HEARTBEAT ms of silence, the connection is
+// dropped and opened again after CHANNEL_TIMEOUT ms without any line.
+void Smarties::channel() {
+    unsigned long now = millis();
+
+    if (!channelClient.connected()) {
+        if (WiFi.status() != WL_CONNECTED || (channelTried && now - channelAttempt < CHANNEL_RETRY)) {
+            return;
+        }
+
+        channelTried = true;
+        channelAttempt = now;
+        String host = apiHost();
+        channelClient.setTimeout(CHANNEL_CONNECT_TIMEOUT);
+        if (host.length() == 0 || !channelClient.connect(host.c_str(), CHANNEL_PORT)) {
+            return;
+        }
+
+        Serial.println("Channel connected to " + host);
+        channelClient.setNoDelay(true);
+        channelLength = 0;
+        channelReceived = now;
+        channelSend("HELLO " + String(device.id) + " " + String(SMARTIES_VERSION) + " " + WiFi.localIP().toString());
+    }
+
+    while (channelClient.available() > 0) {
+        char c = channelClient.read();
+        if (c == '\n') {
+            channelLine[channelLength] = 0;
+            channelLength = 0;
+            channelReceived = now;
+            channelReceive(channelLine);
+        } else if (c != '\r' && channelLength < CHANNEL_LINE_SIZE - 1) {
+            channelLine[channelLength++] = c;
+        }
+    }
+
+    if (now - channelReceived > CHANNEL_TIMEOUT) {
+        Serial.println("Channel timeout");
+        channelClient.stop();
+    } else if (now - channelSent > CHANNEL_HEARTBEAT) {
+        channelSend("PING");
+    }
+}
+
+boolean Smarties::channelConnected() {
+    return channelClient.connected();
+}
+
+// Register a command the hub can send on the channel. The name is stored by
+// pointer and must outlive the node (a string literal). The callback gets
+// what follows the name and returns false when the command is refused.
+boolean Smarties::onCommand(const char *name, ChannelCommand callback) {
+    if (channelCommandCount >= CHANNEL_MAX_COMMANDS) {
+        Serial.println("Error : too many channel commands");
+        return false;
+    }
+
+    channelCommands[channelCommandCount].name = name;
+    channelCommands[channelCommandCount].callback = callback;
+    channelCommandCount++;
+
+    return true;
+}
+
+// Push a state change to the hub, false when the channel is not connected
+boolean Smarties::publish(const char *key, String value) {
+    if (!channelClient.connected()) {
+        return false;
+    }
+
+    value.replace('\n', ' ');
+    channelSend("STATE " + String(key) + " " + value);
+
+    return true;
+}
+
+void Smarties::channelSend(String line) {
+    channelClient.print(line + "\n");
+    channelSent = millis();
+}
+
+void Smarties::channelReceive(char *line) {
+    char *args = strchr(line, ' ');
+    if (args != NULL) {
+        *args++ = 0;
+    } else {
+        args = line + strlen(line);
+    }
+
+    if (strcmp(line, "PING") == 0) {
+        channelSend("PONG");
+    } else if (strcmp(line, "VERSION") == 0) {
+        if (atoi(args) > SMARTIES_VERSION) {
+            Serial.println("New firmware version available : " + String(args));
+            setFirmwareUpdate();
+            ESP.reset();
+        }
+    } else if (strcmp(line, "CMD") == 0) {
+        // CMD <sequence> <name> [arguments], acknowledged with ACK <sequence> <1|0>
+        char *name = strchr(args, ' ');
+        if (name != NULL) {
+            *name++ = 0;
+            char *params = strchr(name, ' ');
+            if (params != NULL) {
+                *params++ = 0;
+            } else {
+                params = name + strlen(name);
+            }
+
+            boolean accepted = false;
+            for (uint8_t i = 0; i < channelCommandCount; i++) {
+                if (strcmp(channelCommands[i].name, name) == 0) {
+                    accepted = channelCommands[i].callback(params);
+                    break;
+                }
+            }
+
+            channelSend("ACK " + String(args) + " " + String(accepted ? 1 : 0));
+        }
+    }
+}
+
+// Seconds elapsed on the node, across deep sleeps. It only dates readings
+// relative to each other and to the upload, and is lost on power off.
+uint32_t Smarties::nodeClock() {
+    return clockBase + millis() / 1000;
+}
+
+static uint32_t readingsChecksum() {
+    const uint8_t *data = (const uint8_t *)&readings.clock;
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < sizeof(readings) - offsetof(smarties_readings_t, clock); i++) {
+        hash = (hash ^ data[i]) * 16777619UL;
+    }
+
+    return hash;
+}
+
+void Smarties::loadReadings() {
+    if (!ESP.rtcUserMemoryRead(READINGS_RTC_OFFSET, (uint32_t *)&readings, sizeof(readings)) || readings.magic != READINGS_MAGIC || readings.checksum != readingsChecksum() || readings.head >= READINGS_MAX || readings.count > READINGS_MAX) {
+        memset(&readings, 0, sizeof(readings));
+        readings.magic = READINGS_MAGIC;
+    }
+
+    clockBase = readings.clock;
+    if (readings.count > 0) {
+        Serial.println(String(readings.count) + " readings waiting for the hub");
+    }
+}
+
+// Write the ring to RTC memory, with the clock ahead seconds from now
+void Smarties::saveReadings(uint32_t ahead) {
+    readings.clock = nodeClock() + ahead;
+    readings.checksum = readingsChecksum();
+    ESP.rtcUserMemoryWrite(READINGS_RTC_OFFSET, (uint32_t *)&readings, sizeof(readings));
+}
+
+// Keep a reading that could not be sent, the oldest one is overwritten when full
+void Smarties::storeReading(String sensorType, float value) {
+    smarties_reading_t &reading = readings.readings[readings.head];
+    reading.clock = nodeClock();
+    reading.value = value;
+    memset(reading.type, 0, READINGS_TYPE_SIZE);
+    strncpy(reading.type, sensorType.c_str(), READINGS_TYPE_SIZE);
+
+    readings.head = (readings.head + 1) % READINGS_MAX;
+    if (readings.count < READINGS_MAX) {
+        readings.count++;
+    }
+
+    saveReadings();
+    Serial.println("Reading kept for later, " + String(readings.count) + " waiting");
+}
+
+// Send every kept reading in one request, dated by their age in seconds
+boolean Smarties::sendReadings() {
+    uint32_t now = nodeClock();
+    DynamicJsonBuffer jsonBuffer;
+    JsonObject& root = jsonBuffer.createObject();
+    root["id"] = device.id;
+    JsonArray& values = root.createNestedArray("values");
+
+    for (uint16_t i = 0; i < readings.count; i++) {
+        const smarties_reading_t &reading = readings.readings[(readings.head + READINGS_MAX - readings.count + i) % READINGS_MAX];
+        char type[READINGS_TYPE_SIZE + 1] = {0};
+        memcpy(type, reading.type, READINGS_TYPE_SIZE);
+        JsonObject& value = values.createNestedObject();
+        value["type"] = jsonBuffer.strdup(type);
+        value["value"] = reading.value;
+        value["age"] = now - reading.clock;
+    }
+
+    if (!deliver(baseUrl() + "esp/sensor/backfill/" + String(device.id) + "/", root, HTTP_READINGS_TIMEOUT)) {
+        return false;
+    }
+
+    readings.count = 0;
+    saveReadings();
+
+    return true;
+}
+
 void Smarties::saveCounter(int value) {
     EEPROM.begin(512);
     EEPROM.put(0, value);
@@ -435,10 +934,13 @@ boolean Smarties::canRunHttpServer() {
 // Mode : 0 - Deep sleep mode, 1 - always powered but sleep, 2 - always powered, 3 - light sleep mode
 // Duration in seconds
 void Smarties::rest(int mode, long duration) {
-    if (!updating) {
+    // Nothing to do for always powered nodes, loop() runs back to back
+    if (!updating && mode != POWER_MODE_ALWAYS) {
         disableVccPin(SENSOR_VCC_PIN);
 
         if (mode == POWER_MODE_DEEP_SLEEP) {
+            // millis() starts over on wake up, the clock carries on from here
+            saveReadings(duration);
             Serial.println("Entering deep sleep for time " + String(duration) + "s");
             ESP.deepSleep(((uint64_t)duration * 1000000L));
         }
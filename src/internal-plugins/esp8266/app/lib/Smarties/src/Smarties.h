@@ -21,27 +21,142 @@ extern "C" {
 #include "user_interface.h"
 }
 
+// Number of A0 samples taken by readAnalog() when none is given, and the
+// largest burst it accepts
+#define ANALOG_SAMPLES 32
+#define ANALOG_MAX_SAMPLES 64
+
+// App level constants generated by the hub for each build (app, version,
+// api url and power options). Builds made outside of the hub get defaults.
+#if defined(__has_include)
+#if __has_include(<smarties_config.h>)
+#include <smarties_config.h>
+#endif
+#endif
+
+#ifndef SMARTIES_CONFIG_HEADER
+constexpr char SMARTIES_IOT_APP[] = "";
+constexpr char SMARTIES_API_URL[] = "";
+constexpr int SMARTIES_VERSION = 0;
+constexpr int SMARTIES_POWERED_MODE = 1;
+constexpr long SMARTIES_TIMER = 60;
+#endif
+
+// Configuration region of the firmware image. It is compiled empty and the
+// hub writes each IoT's settings into it, after the magic, so one build of
+// an app serves every IoT of that app. Sizes keep every field word aligned.
+#define SMARTIES_CONFIG_MAGIC_SIZE 16
+#define SMARTIES_CONFIG_SIZE 2048
+#define SMARTIES_ID_SIZE 20
+#define SMARTIES_SSID_SIZE 36
+#define SMARTIES_PASSPHRASE_SIZE 68
+
+typedef struct {
+    char id[SMARTIES_ID_SIZE];
+    char ssid[SMARTIES_SSID_SIZE];
+    char passphrase[SMARTIES_PASSPHRASE_SIZE];
+} smarties_device_t;
+
+typedef struct {
+    char magic[SMARTIES_CONFIG_MAGIC_SIZE];
+    uint32_t length;                // JSON length
+    uint32_t checksum;              // FNV-1a of the device settings and the JSON
+    uint8_t balance[4];             // Keeps the image XOR checksum unchanged
+    smarties_device_t device;
+    char data[SMARTIES_CONFIG_SIZE]; // Whole IoT configuration, see getConfig()
+} smarties_config_t;
+
+// Readings that could not be sent are kept in RTC user memory, which
+// survives deep sleep, and sent back in one batch once the hub answers
+// again. Blocks 0 to 118 are used, the BMP085 library keeps its calibration
+// from block 120.
+#define READINGS_RTC_OFFSET 0
+#define READINGS_MAX 23
+#define READINGS_TYPE_SIZE 12
+#define READINGS_MAGIC 0x52454144
+
+typedef struct {
+    uint32_t clock;                 // Node clock when read, in seconds
+    float value;
+    char type[READINGS_TYPE_SIZE];  // Not terminated when full
+} smarties_reading_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t checksum;              // FNV-1a of what follows
+    uint32_t clock;                 // Node clock at the last save, in seconds
+    uint16_t head;                  // Next slot
+    uint16_t count;
+    smarties_reading_t readings[READINGS_MAX];
+} smarties_readings_t;
+
+// Acquisition scheduler, see Smarties::addAcquisition()
+#define ACQUISITION_MAX_TASKS 6
+#define ACQUISITION_TIMEOUT 5000 // In milliseconds
+
+typedef void (*AcquisitionStep)();
+typedef boolean (*AcquisitionReady)();
+
+typedef struct {
+    AcquisitionStep start;
+    AcquisitionReady ready;
+    AcquisitionStep finish;
+    unsigned long warmup;   // Milliseconds since sensor power on before start
+    uint8_t state;
+} acquisition_task_t;
+
+// Persistent line channel to the hub, see Smarties::channel(). Lines are
+// HELLO, STATE, PING and ACK from the node, CMD, VERSION and PING from the hub.
+#define CHANNEL_PORT 8095
+#define CHANNEL_LINE_SIZE 128
+#define CHANNEL_MAX_COMMANDS 8
+#define CHANNEL_CONNECT_TIMEOUT 2000 // In milliseconds
+#define CHANNEL_HEARTBEAT 30000      // In milliseconds without sending
+#define CHANNEL_TIMEOUT 90000        // In milliseconds without receiving
+#define CHANNEL_RETRY 10000          // In milliseconds between two connections
+
+typedef boolean (*ChannelCommand)(const char *args);
+
+typedef struct {
+    const char *name;
+    ChannelCommand callback;
+} channel_command_t;
+
 class Smarties {
   public:
     Smarties();
     ESP8266WebServer &getWebServer();
     JsonObject &parseJson(DynamicJsonBuffer &jsonBuffer, String json);
-    void setup(String jsonConfiguration);
+    void setup();
     void loop();
     String baseUrl();
     String transmit(String url, JsonObject& jsonObject, int timeout);
+    String transmit(String url, JsonObject& jsonObject, int timeout, int &httpCode);
     void postSensorValue(String sensorType, float value);
+    void setValue(const char *name, unsigned long value);
     JsonVariant &getConfig();
     void rest(int mode, long duration);
     void ping();
     void enableVccPin(int pin);
     void disableVccPin(int pin);
+    uint16_t readAnalog(uint16_t samples = ANALOG_SAMPLES);
+    static uint16_t trimmedMean(uint16_t *samples, uint16_t count);
+    unsigned long sensorPoweredFor();
+    boolean addAcquisition(AcquisitionStep start, AcquisitionReady ready = NULL, AcquisitionStep finish = NULL, unsigned long warmup = 0);
+    void acquire(unsigned long timeout = ACQUISITION_TIMEOUT);
+    void channel();
+    boolean channelConnected();
+    boolean onCommand(const char *name, ChannelCommand callback);
+    boolean publish(const char *key, String value);
   private:
     int getResetReason();
     void checkRun();
     void httpUpdateServer();
     void connect();
-    void parseConfig(String jsonConfiguration);
+    void resumeWifi();
+    void waitWifi();
+    boolean loadDevice();
+    String loadConfig();
     void updateFirmware();
     void cleanCounter();
     void saveCounter(int value);
@@ -50,6 +165,15 @@ class Smarties {
     void resetFirmwareUpdate();
     void setFirmwareUpdate();
     boolean shouldFirmwareUpdate();
+    String apiHost();
+    uint32_t nodeClock();
+    void loadReadings();
+    void saveReadings(uint32_t ahead = 0);
+    void storeReading(String sensorType, float value);
+    boolean sendReadings();
+    boolean deliver(String url, JsonObject& jsonObject, int timeout);
+    void channelSend(String line);
+    void channelReceive(char *line);
 };
 
 #endif
@@ -0,0 +1,73 @@
+"use strict";
+
+const net = require("net");
+
+/**
+ * Loaded plugin function
+ *
+ * @param  {PluginAPI} api The core APIs
+ */
+function loaded(api) {
+    /**
+     * This class listens for the persistent channels opened by always powered ESP nodes.
+     * Connections and heartbeats are handed to the ESP8266 plugin, which speaks the line protocol.
+     *
+     * @class
+     */
+    class EspChannelService extends api.exported.Service.class {
+        /**
+         * Constructor
+         *
+         * @param  {Esp8266} plugin The ESP8266 plugin
+         * @param  {number} port The listening port
+         * @param  {number} interval The heartbeat check interval, in milliseconds
+         * @returns {EspChannelService}        The instance
+         */
+        constructor(plugin, port, interval) {
+            super("esp8266-channel");
+            this.plugin = plugin;
+            this.port = port;
+            this.interval = interval;
+            this.server = null;
+            this.timer = null;
+        }
+
+        /**
+         * Start the service
+         */
+        start() {
+            super.start();
+            this.server = net.createServer((socket) => {
+                this.plugin.acceptChannel(socket);
+            });
+            this.server.on("error", (err) => {
+                api.exported.Logger.err("ESP channel server error : " + err.message);
+            });
+            this.server.listen(this.port);
+
+            this.timer = api.exported.TimerWrapper.class.setInterval((self) => {
+                self.plugin.checkChannels();
+            }, this.interval, this);
+        }
+
+        /**
+         * Stop the service, open channels are closed
+         */
+        stop() {
+            if (this.timer) {
+                api.exported.TimerWrapper.class.clearInterval(this.timer);
+                this.timer = null;
+            }
+            if (this.server) {
+                this.server.close();
+                this.server = null;
+            }
+            this.plugin.closeChannels();
+            super.stop();
+        }
+    }
+
+    return EspChannelService;
+}
+
+module.exports = loaded;
@@ -1,5 +1,8 @@
 "use strict";
-const md5File = require("md5-file");
+
+const request = require("request");
+const EspIngestionServiceClass = require("./service.js");
+const EspChannelServiceClass = require("./channelService.js");
 
 /**
  * Loaded function
@@ -67,9 +70,15 @@ function loaded(api) {
 
     const CONF_KEY = "esp8266";
     const WS_SENSOR_SET_ROUTE = ":/esp/sensor/set/";
+    const WS_SENSOR_BACKFILL_ROUTE = ":/esp/sensor/backfill/";
     const WS_PING_ROUTE = ":/esp/ping/";
     const WS_FIRMWARE_ROUTE = ":/esp/firmware/upgrade/";
     const PING_EVENT_KEY = "esp8266-ping";
+    const STATE_EVENT_KEY = "esp8266-state";
+    const CHANNEL_PORT = 8095;
+    const CHANNEL_HEARTBEAT = 30000; // In milliseconds without sending
+    const CHANNEL_TIMEOUT = 90000; // In milliseconds without receiving
+    const CHANNEL_COMMAND_TIMEOUT = 5000; // In milliseconds
     const errorFirmware = {};
 
     /**
@@ -91,13 +100,26 @@ function loaded(api) {
             wiringSchema.right["D2"].push("ADS1015 SDA");
             wiringSchema.left["SD3"].push("ADS1015 VCC");
             wiringSchema.right["GND-2"].push("ADS1015 GND");
-            this.api.iotAPI.registerLib("app", "esp8266", 61, wiringSchema, ESP8266Form);
+            this.api.iotAPI.registerLib("app", "esp8266", 62, wiringSchema, ESP8266Form);
             this.api.iotAPI.addIngredientForReceipe("esp8266", "Nodemcu v1", "Nodemcu board, based on ESP8266. SD3 pin is used for powering 3v3 sensors and save battery life.", 1, true, true);
             this.api.iotAPI.addIngredientForReceipe("esp8266", "ADS1015", "Analog digital converter", 1, false, false);
             this.api.webAPI.register(this, this.api.webAPI.constants().POST, WS_SENSOR_SET_ROUTE + "[id]/[type]/[value]/[vcc*]/", this.api.webAPI.Authentication().AUTH_LOCAL_NETWORK_LEVEL);
+            this.api.webAPI.register(this, this.api.webAPI.constants().POST, WS_SENSOR_BACKFILL_ROUTE + "[id]/", this.api.webAPI.Authentication().AUTH_LOCAL_NETWORK_LEVEL);
             this.api.webAPI.register(this, this.api.webAPI.constants().POST, WS_PING_ROUTE + "[id]/", this.api.webAPI.Authentication().AUTH_LOCAL_NETWORK_LEVEL);
             this.api.webAPI.register(this, this.api.webAPI.constants().GET, WS_FIRMWARE_ROUTE + "[id]/", this.api.webAPI.Authentication().AUTH_LOCAL_NETWORK_LEVEL);
-            this.firmwareFile = {};
+            const EspIngestionService = EspIngestionServiceClass(api);
+            this.ingestion = new EspIngestionService();
+            this.ingestion.disableAutoStart = true;
+            api.servicesManagerAPI.add(this.ingestion);
+            this.ingestion.start();
+            this.channels = {};
+            this.states = {};
+            this.commandSequence = 0;
+            const EspChannelService = EspChannelServiceClass(api);
+            this.channelService = new EspChannelService(this, CHANNEL_PORT, CHANNEL_HEARTBEAT / 3);
+            this.channelService.disableAutoStart = true;
+            api.servicesManagerAPI.add(this.channelService);
+            this.channelService.start();
 
             try {
                 this.configurations = this.api.configurationAPI.getConfManager().loadData(Object, CONF_KEY, true);
@@ -150,7 +172,8 @@ function loaded(api) {
                 EVERY_HOUR: (60 * 60),
                 EVERY_DAY: (24 * 60 * 60),
                 EVERY_WEEK: (7* 24 * 60 * 60),
-                PING_EVENT_KEY: PING_EVENT_KEY
+                PING_EVENT_KEY: PING_EVENT_KEY,
+                STATE_EVENT_KEY: STATE_EVENT_KEY
             };
         }
 
@@ -185,6 +208,232 @@ function loaded(api) {
             }
         }
 
+        /**
+         * Store the address and version sent by an IoT, by HTTP ping or on the channel
+         *
+         * @param  {object} iot    The IoT
+         * @param  {object} params The ping parameters : `ip`, `version`, and optionally `freeHeap` and `vcc`
+         */
+        registerPing(iot, params) {
+            this.configurations[iot.id.toString()] = params;
+            this.configurations[iot.id.toString()].lastUpdated = this.api.exported.DateUtils.class.timestamp();
+            this.configurations[iot.id.toString()].currentVersion = parseInt(params.version);
+            this.api.iotAPI.setUpgradeUrl(iot.id, ((this.configurations[iot.id.toString()] && this.configurations[iot.id.toString()].ip) ? this.getUpgradeUrl(this.configurations[iot.id.toString()].ip) : null));
+            this.api.iotAPI.setVersion(iot.id, ((this.configurations[iot.id.toString()] && this.configurations[iot.id.toString()].currentVersion) ? this.configurations[iot.id.toString()].currentVersion : 0));
+            this.api.coreAPI.dispatchEvent(PING_EVENT_KEY, Object.assign({id:iot.id.toString()}, this.configurations[iot.id.toString()]));
+            this.api.configurationAPI.getConfManager().saveData(this.configurations, CONF_KEY);
+        }
+
+        /**
+         * Get the firmware version an IoT should run
+         *
+         * @param  {object} iot The IoT
+         * @returns {number}     The version, `-1` if the app firmware is locked
+         */
+        getAvailableVersion(iot) {
+            return (errorFirmware[iot.iotApp] ? -1 : this.api.iotAPI.getVersion(iot.iotApp));
+        }
+
+        /**
+         * Get the IPv4 address of a channel peer
+         *
+         * @param  {string} address The socket remote address
+         * @returns {string}         The address
+         */
+        peerAddress(address) {
+            return (address === "::1") ? "127.0.0.1" : (address ? address.replace(/^::ffff:/, "") : "");
+        }
+
+        /**
+         * Check whether a channel peer is on the local network, as the web services do for the local network authentication level
+         *
+         * @param  {string} address The peer address
+         * @returns {boolean}         `true` if the peer is local
+         */
+        isLocalPeer(address) {
+            const ip = this.peerAddress(address);
+            const ipExploded = ip.split(".");
+            const localIpExploded = (this.api.environmentAPI.getLocalIp() || "").split(".");
+            if (ipExploded.length !== 4) {
+                return false;
+            }
+            if (ip === "127.0.0.1") {
+                return true;
+            }
+
+            return (localIpExploded.length === 4 && ipExploded[0] === localIpExploded[0] && ipExploded[1] === localIpExploded[1] && ipExploded[2] === localIpExploded[2]);
+        }
+
+        /**
+         * Send heartbeats on idle channels and close the silent ones. Called by the channel service.
+         */
+        checkChannels() {
+            const now = Date.now();
+            Object.keys(this.channels).forEach((iotId) => {
+                const channel = this.channels[iotId];
+                if (now - channel.received > CHANNEL_TIMEOUT) {
+                    api.exported.Logger.warn("ESP channel timeout for " + iotId);
+                    channel.socket.destroy();
+                } else if (now - channel.sent > CHANNEL_HEARTBEAT) {
+                    this.channelSend(channel, "PING");
+                }
+            });
+        }
+
+        /**
+         * Close every open channel. Called by the channel service when stopped.
+         */
+        closeChannels() {
+            Object.keys(this.channels).forEach((iotId) => {
+                this.channels[iotId].socket.destroy();
+            });
+        }
+
+        /**
+         * Serve a node connection. Peers outside of the local network are refused, and the node address is the peer one.
+         *
+         * @param  {net.Socket} socket The socket
+         */
+        acceptChannel(socket) {
+            if (!this.isLocalPeer(socket.remoteAddress)) {
+                api.exported.Logger.warn("ESP channel refused for non local peer " + socket.remoteAddress);
+                socket.destroy();
+                return;
+            }
+
+            const channel = {socket:socket, address:this.peerAddress(socket.remoteAddress), iotId:null, received:Date.now(), sent:Date.now(), pending:{}};
+            let buffer = "";
+            socket.setEncoding("utf8");
+            socket.setNoDelay(true);
+            socket.setKeepAlive(true, CHANNEL_HEARTBEAT);
+            socket.on("data", (data) => {
+                buffer += data;
+                let index;
+                while ((index = buffer.indexOf("\n")) >= 0) {
+                    const line = buffer.substr(0, index).replace("\r", "");
+                    buffer = buffer.substr(index + 1);
+                    channel.received = Date.now();
+                    this.channelReceive(channel, line);
+                }
+                if (buffer.length > 1024) {
+                    socket.destroy();
+                }
+            });
+            socket.on("error", (err) => {
+                api.exported.Logger.verbose("ESP channel error : " + err.message);
+            });
+            socket.on("close", () => {
+                Object.keys(channel.pending).forEach((sequence) => {
+                    channel.pending[sequence](Error("Channel closed"));
+                });
+                channel.pending = {};
+                if (channel.iotId && this.channels[channel.iotId] === channel) {
+                    delete this.channels[channel.iotId];
+                    api.exported.Logger.info("ESP channel closed for " + channel.iotId);
+                }
+            });
+        }
+
+        /**
+         * Send a line on a channel
+         *
+         * @param  {object} channel The channel
+         * @param  {string} line    The line
+         */
+        channelSend(channel, line) {
+            channel.sent = Date.now();
+            channel.socket.write(line + "\n");
+        }
+
+        /**
+         * Process a line received on a channel. Nodes send `HELLO <id> <version> <ip>`, `STATE <key> <value>` and `ACK <sequence> <1|0>`,
+         * the hub sends `VERSION <version>` and `CMD <sequence> <command> [arguments]`, and `PING` / `PONG` go both ways.
+         * The address announced in `HELLO` is ignored, the peer one is used.
+         *
+         * @param  {object} channel The channel
+         * @param  {string} line    The line
+         */
+        channelReceive(channel, line) {
+            const parts = line.split(" ");
+            if (parts[0] === "HELLO" && parts.length >= 3) {
+                const iot = this.api.iotAPI.getIot(parts[1]);
+                if (!iot || !iot.id) {
+                    api.exported.Logger.warn("ESP channel refused for unknown iot " + parts[1]);
+                    channel.socket.destroy();
+                    return;
+                }
+
+                const iotId = iot.id.toString();
+                if (this.channels[iotId] && this.channels[iotId] !== channel) {
+                    this.channels[iotId].socket.destroy();
+                }
+                channel.iotId = iotId;
+                this.channels[iotId] = channel;
+                api.exported.Logger.info("ESP channel opened for " + iotId + " on ip " + channel.address + " version " + parts[2]);
+                this.registerPing(iot, Object.assign({}, this.configurations[iotId], {ip:channel.address, version:parts[2]}));
+                this.channelSend(channel, "VERSION " + this.getAvailableVersion(iot));
+            } else if (!channel.iotId) {
+                channel.socket.destroy();
+            } else if (parts[0] === "PING") {
+                this.channelSend(channel, "PONG");
+            } else if (parts[0] === "STATE" && parts.length >= 2) {
+                const value = parts.slice(2).join(" ");
+                if (!this.states[channel.iotId]) {
+                    this.states[channel.iotId] = {};
+                }
+                this.states[channel.iotId][parts[1]] = value;
+                this.api.coreAPI.dispatchEvent(STATE_EVENT_KEY, {id:channel.iotId, key:parts[1], value:value});
+            } else if (parts[0] === "ACK" && parts.length >= 3 && channel.pending[parts[1]]) {
+                const cb = channel.pending[parts[1]];
+                delete channel.pending[parts[1]];
+                cb((parts[2] === "1") ? null : Error("Command refused"));
+            }
+        }
+
+        /**
+         * Get the last states pushed by an IoT on its channel
+         *
+         * @param  {string} iotId IoT identifier
+         * @returns {object}       The states, by key
+         */
+        getState(iotId) {
+            return this.states[iotId.toString()] ? this.states[iotId.toString()] : {};
+        }
+
+        /**
+         * Send a command to an IoT, on its channel when connected or by HTTP on `/<command>` otherwise
+         *
+         * @param  {string} iotId IoT identifier
+         * @param  {string} command The command
+         * @param  {Function} [cb=null] The callback `(err) => {}`
+         */
+        sendCommand(iotId, command, cb = null) {
+            const channel = this.channels[iotId.toString()];
+            if (channel) {
+                const sequence = (++this.commandSequence).toString();
+                const timer = api.exported.TimerWrapper.class.setTimeout(() => {
+                    if (channel.pending[sequence]) {
+                        delete channel.pending[sequence];
+                        if (cb) cb(Error("Command timeout"));
+                    }
+                }, CHANNEL_COMMAND_TIMEOUT);
+                channel.pending[sequence] = (err) => {
+                    api.exported.TimerWrapper.class.clearTimeout(timer);
+                    if (cb) cb(err);
+                };
+                this.channelSend(channel, "CMD " + sequence + " " + command);
+            } else {
+                const ip = this.getIp(iotId);
+                if (ip) {
+                    request("http://" + ip + "/" + command, { }, (err) => {
+                        if (cb) cb(err ? err : null);
+                    });
+                } else if (cb) {
+                    cb(Error("No ip found for " + iotId));
+                }
+            }
+        }
+
         /**
          * Process API callback
          *
@@ -195,16 +444,7 @@ function loaded(api) {
             if (apiRequest.route.startsWith(WS_SENSOR_SET_ROUTE)) {
                 return new Promise((resolve, reject) => {
                     if (apiRequest.data.type && apiRequest.data.id && apiRequest.data.value) {
-                        const sensors = this.api.sensorAPI.getSensors(apiRequest.data.type);
-                        let received = false;
-
-                        Object.keys(sensors).forEach((sensorKey) => {
-                            const sensor = this.api.sensorAPI.getSensor(sensorKey);
-                            if (parseInt(apiRequest.data.id) === sensor.getIotIdentifier()) {
-                                sensor.setValue(parseFloat(apiRequest.data.value), apiRequest.data.vcc?parseFloat(apiRequest.data.vcc):null);
-                                received = true;
-                            }
-                        });
+                        const received = this.ingestion.push(apiRequest.data.id, apiRequest.data.type, parseFloat(apiRequest.data.value), apiRequest.data.vcc?parseFloat(apiRequest.data.vcc):null);
 
                         if (!received) {
                             api.exported.Logger.warn("No registered sensor received value");
@@ -216,58 +456,67 @@ function loaded(api) {
                     }
 
                 });
+            } else if (apiRequest.route.startsWith(WS_SENSOR_BACKFILL_ROUTE)) {
+                // Readings kept by a node while the hub was unreachable, dated by their age in seconds
+                return new Promise((resolve, reject) => {
+                    if (apiRequest.data.id && apiRequest.params && Array.isArray(apiRequest.params.values)) {
+                        const now = this.api.exported.DateUtils.class.timestamp();
+                        let received = 0;
+                        apiRequest.params.values.forEach((reading) => {
+                            received += this.ingestion.push(apiRequest.data.id, reading.type, parseFloat(reading.value), null, now - Math.max(0, parseInt(reading.age)));
+                        });
+
+                        api.exported.Logger.info("Backfilled " + received + " values from " + apiRequest.params.values.length + " readings for ESP " + apiRequest.data.id);
+                        resolve(this.api.webAPI.APIResponse(true, {success:true, received:received}));
+                    } else {
+                        reject(this.api.webAPI.APIResponse(false, {}, 1096, "Invalid parameters"));
+                    }
+                });
             } else if (apiRequest.route.startsWith(WS_PING_ROUTE)) {
                 const iot = this.api.iotAPI.getIot(apiRequest.data.id);
                 if (iot && iot.id) {
                     this.api.exported.Logger.info("Ping ESP " + apiRequest.data.id + " on ip " + apiRequest.params.ip + " version " + apiRequest.params.version);
-                    this.configurations[iot.id.toString()] = apiRequest.params;
-                    this.configurations[iot.id.toString()].lastUpdated = this.api.exported.DateUtils.class.timestamp();
-                    this.configurations[iot.id.toString()].currentVersion = parseInt(apiRequest.params.version);
-                    this.api.iotAPI.setUpgradeUrl(iot.id, ((this.configurations[iot.id.toString()] && this.configurations[iot.id.toString()].ip) ? this.getUpgradeUrl(this.configurations[iot.id.toString()].ip) : null));
-                    this.api.iotAPI.setVersion(iot.id, ((this.configurations[iot.id.toString()] && this.configurations[iot.id.toString()].currentVersion) ? this.configurations[iot.id.toString()].currentVersion : 0));
-                    this.api.coreAPI.dispatchEvent(PING_EVENT_KEY, Object.assign({id:iot.id.toString()}, this.configurations[iot.id.toString()]));
-                    this.api.configurationAPI.getConfManager().saveData(this.configurations, CONF_KEY);
+                    this.registerPing(iot, apiRequest.params);
                 }
 
                 return new Promise((resolve) => {
-                    resolve(this.api.webAPI.APIResponse(true, {success:true, version:((this.api.iotAPI.isBuilding() || errorFirmware[iot.iotApp])?-1:this.api.iotAPI.getVersion(this.api.iotAPI.getIot(apiRequest.data.id).iotApp))}));
+                    resolve(this.api.webAPI.APIResponse(true, {success:true, version:this.getAvailableVersion(this.api.iotAPI.getIot(apiRequest.data.id))}));
                 });
             } else if (apiRequest.route.startsWith(WS_FIRMWARE_ROUTE)) {
                 return new Promise((resolve, reject) => {
                     const iot = this.api.iotAPI.getIot(apiRequest.data.id);
-                    if (this.api.iotAPI.isBuilding()) {
-                        reject(this.api.webAPI.APIResponse(false, {}, 1079, "Build is already running"));
-                    } else if (iot) {
-                        // We need to build firmware on first time
-                        if (!this.firmwareFile[apiRequest.data.id]) {
-                            this.api.iotAPI.build(apiRequest.data.id, iot.iotApp, false, iot, (error, details) => {
-                                if (error) {
-                                    // Error
-                                    errorFirmware[iot.iotApp] = true;
-                                    api.exported.Logger.err("Locked firmware for app " + iot.iotApp + ". Firmware built failed : " + error.message);
-                                    api.exported.Logger.err("Build firmware failed for id (1090)" + apiRequest.data.id);
-                                    delete this.firmwareFile[apiRequest.data.id];
-                                } else if (details && details.firmwarePath) {
-                                    // Success
-                                    this.firmwareFile[apiRequest.data.id] = details.firmwarePath;
-                                    api.exported.Logger.info(details);
-                                    api.exported.Logger.info("Firmware built for app " + iot.iotApp);
-                                } else {
-                                    // Error : success without generated firmware
-                                    errorFirmware[iot.iotApp] = true;
-                                    api.exported.Logger.err("Locked firmware for app " + iot.iotApp + ". Firmware built failed : " + error.message);
-                                    api.exported.Logger.err("Build firmware failed for id (1091)" + apiRequest.data.id);
-                                    delete this.firmwareFile[apiRequest.data.id];
+                    if (iot) {
+                        // Firmwares are prebuilt when the app or the IoT changes, so this is usually served on first request
+                        const firmware = this.api.iotAPI.getFirmware(apiRequest.data.id);
+                        if (firmware) {
+                            apiRequest.res.setHeader("x-MD5", firmware.md5);
+                            apiRequest.res.sendFile(firmware.path, {acceptRanges:true, headers:{"Content-Type":"application/octet-stream"}}, (err) => {
+                                if (err) {
+                                    api.exported.Logger.err("Firmware download failed for id " + apiRequest.data.id + " : " + err.message);
                                 }
                             });
-                            reject(this.api.webAPI.APIResponse(false, {}, 1095, "Building firmware"));
                         } else {
-                            // On second time, download firmware
-                            const md5 = md5File.sync(this.firmwareFile[apiRequest.data.id]);
-                            apiRequest.res.setHeader("Content-Type", "application/octet-stream");
-                            apiRequest.res.setHeader("x-MD5", md5);
-                            apiRequest.res.download(this.firmwareFile[apiRequest.data.id]);
-                            delete this.firmwareFile[apiRequest.data.id];
+                            if (!this.api.iotAPI.isBuilding(apiRequest.data.id)) {
+                                this.api.iotAPI.build(apiRequest.data.id, iot.iotApp, false, iot, (error, details) => {
+                                    if (error) {
+                                        // Error
+                                        errorFirmware[iot.iotApp] = true;
+                                        api.exported.Logger.err("Locked firmware for app " + iot.iotApp + ". Firmware built failed : " + error.message);
+                                        api.exported.Logger.err("Build firmware failed for id (1090)" + apiRequest.data.id);
+                                    } else if (details && details.firmwarePath) {
+                                        // Success
+                                        api.exported.Logger.info(details);
+                                        api.exported.Logger.info("Firmware built for app " + iot.iotApp);
+                                    } else {
+                                        // Error : success without generated firmware
+                                        errorFirmware[iot.iotApp] = true;
+                                        api.exported.Logger.err("Locked firmware for app " + iot.iotApp + ". Firmware built failed");
+                                        api.exported.Logger.err("Build firmware failed for id (1091)" + apiRequest.data.id);
+                                    }
+                                });
+                            }
+                            // The node asks again until its firmware is built
+                            reject(this.api.webAPI.APIResponse(false, {}, 1095, "Building firmware"));
                         }
 
                     } else {
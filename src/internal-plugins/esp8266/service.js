@@ -0,0 +1,214 @@
+"use strict";
+
+const FLUSH_INTERVAL = 10000; // In milliseconds
+const WRITE_TIMEOUT = 5000; // In milliseconds, before the next write of a bucket goes on without the sensor callback
+
+/**
+ * Loaded plugin function
+ *
+ * @param  {PluginAPI} api The core APIs
+ */
+function loaded(api) {
+    /**
+     * This class ingests the values posted by ESP nodes.
+     * Sensors are found through an (iot, type) index rebuilt when sensors are reloaded, and values are kept in memory by sensor and hour,
+     * the granularity sensors store at, then flushed every few seconds so that each sensor gets one write per hour bucket instead of one per value.
+     *
+     * @class
+     */
+    class EspIngestionService extends api.exported.Service.class {
+        /**
+         * Constructor
+         *
+         * @returns {EspIngestionService}        The instance
+         */
+        constructor() {
+            super("esp8266-ingestion");
+            this.index = null;
+            this.buckets = {};
+            this.timer = null;
+            this.statistics = {values:0, writes:0, flushes:0};
+            api.coreAPI.registerEvent(api.sensorAPI.constants().EVENT_SENSORS_READY, () => {
+                this.index = null;
+            });
+        }
+
+        /**
+         * Start the service
+         */
+        start() {
+            super.start();
+            this.timer = api.exported.TimerWrapper.class.setInterval((self) => {
+                self.flush();
+            }, FLUSH_INTERVAL, this);
+        }
+
+        /**
+         * Stop the service, buffered values are written
+         */
+        stop() {
+            if (this.timer) {
+                api.exported.TimerWrapper.class.clearInterval(this.timer);
+                this.timer = null;
+            }
+            this.flush();
+            super.stop();
+        }
+
+        /**
+         * Build the (iot, type) to sensors index
+         */
+        buildIndex() {
+            this.index = {};
+            Object.keys(api.sensorAPI.getSensors()).forEach((sensorKey) => {
+                const sensor = api.sensorAPI.getSensor(sensorKey);
+                if (sensor && sensor.getIotIdentifier && sensor.getIotIdentifier() != null) {
+                    const key = sensor.getIotIdentifier() + "/" + sensor.type;
+                    if (!this.index[key]) {
+                        this.index[key] = [];
+                    }
+                    this.index[key].push(sensor.id);
+                }
+            });
+        }
+
+        /**
+         * Get the sensors bound to an IoT for a type
+         *
+         * @param  {number} iotId The IoT identifier
+         * @param  {string} type  The sensor type
+         * @returns {Array}       The sensor identifiers
+         */
+        getSensorIds(iotId, type) {
+            if (!this.index) {
+                this.buildIndex();
+            }
+
+            const sensorIds = this.index[parseInt(iotId) + "/" + type];
+            return sensorIds ? sensorIds : [];
+        }
+
+        /**
+         * Buffer a value for every sensor bound to an IoT for a type
+         *
+         * @param  {number} iotId The IoT identifier
+         * @param  {string} type  The sensor type
+         * @param  {number} value The value
+         * @param  {number} [vcc=null] The node voltage
+         * @param  {number} [timestamp=null] When the value was read, now if not set
+         * @returns {number}       The number of sensors that received the value
+         */
+        push(iotId, type, value, vcc = null, timestamp = null) {
+            const sensorIds = this.getSensorIds(iotId, type);
+            if (sensorIds.length === 0) {
+                return 0;
+            }
+
+            if (!timestamp) {
+                timestamp = api.exported.DateUtils.class.timestamp();
+            }
+            const hour = api.exported.DateUtils.class.roundedTimestamp(timestamp, api.exported.DateUtils.ROUND_TIMESTAMP_HOUR);
+
+            sensorIds.forEach((sensorId) => {
+                const key = sensorId + "/" + hour;
+                if (!this.buckets[key]) {
+                    this.buckets[key] = {sensorId:sensorId, values:[], vcc:null, timestamp:timestamp};
+                }
+                const bucket = this.buckets[key];
+                bucket.values.push(value);
+                if (vcc != null) {
+                    bucket.vcc = vcc;
+                }
+                // Latest reading of the hour, to keep the sensor's own last value up to date
+                bucket.timestamp = Math.max(bucket.timestamp, timestamp);
+            });
+            this.statistics.values++;
+
+            return sensorIds.length;
+        }
+
+        /**
+         * Combine the values of a bucket as the sensor would aggregate them.
+         * Count aggregation counts calls, its values are not combined and are written one after the other.
+         *
+         * @param  {Sensor} sensor The sensor
+         * @param  {Array} values The values, in reception order
+         * @returns {Array}        The values to set
+         */
+        combine(sensor, values) {
+            const constants = (sensor.constructor && sensor.constructor.constants) ? sensor.constructor.constants() : {};
+            switch (sensor.aggregationMode) {
+            case constants.AGGREGATION_MODE_SUM:
+                return [values.reduce((sum, value) => sum + value, 0)];
+            case constants.AGGREGATION_MODE_MIN:
+                return [Math.min(...values)];
+            case constants.AGGREGATION_MODE_MAX:
+                return [Math.max(...values)];
+            case constants.AGGREGATION_MODE_COUNT:
+                return values;
+            default:
+                return [values[values.length - 1]];
+            }
+        }
+
+        /**
+         * Write buffered values to their sensors
+         */
+        flush() {
+            const buckets = this.buckets;
+            this.buckets = {};
+            const keys = Object.keys(buckets);
+            if (keys.length === 0) {
+                return;
+            }
+
+            this.statistics.flushes++;
+            keys.forEach((key) => {
+                const bucket = buckets[key];
+                const sensor = api.sensorAPI.getSensor(bucket.sensorId);
+                if (sensor) {
+                    this.write(sensor, bucket, this.combine(sensor, bucket.values));
+                }
+            });
+        }
+
+        /**
+         * Set the values of a bucket one after the other. Each write reads then updates the hour row,
+         * so the next one waits for the sensor callback, or for a timeout as sensors may drop invalid values without calling back.
+         *
+         * @param  {Sensor} sensor The sensor
+         * @param  {object} bucket The bucket
+         * @param  {Array} values The values to set
+         * @param  {number} [index=0] The first value to set
+         */
+        write(sensor, bucket, values, index = 0) {
+            if (index >= values.length) {
+                return;
+            }
+
+            let done = false;
+            const timer = api.exported.TimerWrapper.class.setTimeout(() => {
+                next();
+            }, WRITE_TIMEOUT);
+            const next = () => {
+                if (!done) {
+                    done = true;
+                    api.exported.TimerWrapper.class.clearTimeout(timer);
+                    this.write(sensor, bucket, values, index + 1);
+                }
+            };
+
+            try {
+                this.statistics.writes++;
+                sensor.setValue(values[index], bucket.vcc, next, bucket.timestamp);
+            } catch(e) {
+                api.exported.Logger.err("Could not set value of sensor " + bucket.sensorId + " : " + e.message);
+                next();
+            }
+        }
+    }
+
+    return EspIngestionService;
+}
+
+module.exports = loaded;
@@ -11,10 +11,12 @@
 #endif
 #include <WiFiClient.h>
 
-#include "esp8266_pwm.h"
+#include <Ticker.h>
+#include <sigma_delta.h>
 #include <Smarties.h>
+#include "ring_buffer.h"
+#include "telegram_filter.h"
 
-String JSON_CONFIG = "%config%";
 Smarties smarties = Smarties();
 
 // application config
@@ -39,8 +41,24 @@ Smarties smarties = Smarties();
 // if the bonjour support is turned on, then use the following as the name
 #define DEVICE_NAME "ser2net"
 
-// serial end ethernet buffer size
-#define BUFFER_SIZE 128
+// bridge buffers, serial to network and network to serial
+#define SERIAL_BUFFER_SIZE 4096
+#define NET_BUFFER_SIZE 2048
+// UART driver receive buffer, absorbs RFLink bursts between two loops
+#define SERIAL_RX_BUFFER_SIZE 1024
+// longest line framed for filtering, longer ones are forwarded as is
+#define LINE_BUFFER_SIZE 256
+
+// telegram filter pushed by the hub as {"ids":["6968", ...], "window":1000}
+#define FILTER_ROUTE "/rflink/filter"
+
+// serial data is coalesced on the TCP side until a line is complete, a full
+// segment is pending or the oldest byte waited this long
+#define TCP_COALESCE_BYTES 1460
+#define TCP_COALESCE_DELAY 5 // In milliseconds
+
+// Smarties housekeeping (reconnection, HTTP server, counters) runs this often
+#define HOUSEKEEPING_INTERVAL 1000 // In milliseconds
 
 // hardware config
 #define WIFI_LED 14
@@ -48,13 +66,41 @@ Smarties smarties = Smarties();
 #define TX_LED 12
 #define RX_LED 13
 
+// The Wifi LED is driven by the sigma-delta modulator, so it costs no
+// interrupts. Breathing is stepped from a Ticker, off the bridge loop.
+#define LED_CHANNEL 0
+#define LED_MAX_DUTY 255
+#define LED_BREATH_INTERVAL 10 // In milliseconds, one duty step
+
 #ifdef BONJOUR_SUPPORT
 // multicast DNS responder
 MDNSResponder mdns;
 #endif
 
 WiFiServer server(TCP_LISTEN_PORT);
-ESP8266_PWM pwm;
+Ticker breath;
+uint8_t pulse = 0;
+uint8_t pulse_dir = 1;
+
+void led_set(uint8_t duty) {
+  sigmaDeltaWrite(LED_CHANNEL, duty);
+}
+
+void led_breath_step() {
+  if(pulse_dir) {
+    pulse++;
+    if(pulse == LED_MAX_DUTY) {
+      pulse_dir = 0;
+    }
+  } else {
+    pulse--;
+    if(pulse == 0) {
+      pulse_dir = 1;
+    }
+  }
+
+  led_set(pulse);
+}
 
 #ifdef STATIC_IP
 IPAddress parse_ip_address(const char *str) {
@@ -107,17 +153,18 @@ void connect_to_wifi() {
 #ifdef USE_WDT
     wdt_reset();
 #endif
-    pwm.set(0, (count & 1) ? PWM_MAX_DUTY : 0);
+    led_set((count & 1) ? LED_MAX_DUTY : 0);
     count++;
     delay(250);
   }
 
-  pwm.set(0, PWM_MAX_DUTY);
+  led_set(LED_MAX_DUTY);
 }
 
 void error() {
   int count = 0;
 
+  breath.detach();
 #ifdef CONNECTION_LED
   digitalWrite(CONNECTION_LED, LOW);
 #endif
@@ -126,14 +173,14 @@ void error() {
 
   while(1) {
     count++;
-    pwm.set(0, (count & 1) ? PWM_MAX_DUTY : 0);
+    led_set((count & 1) ? LED_MAX_DUTY : 0);
     delay(100);
   }
 }
 
 void setup(void)
 {
-    smarties.setup(JSON_CONFIG);
+    smarties.setup();
 
 
 
@@ -155,11 +202,14 @@ void setup(void)
   pinMode(TX_LED, OUTPUT);
   pinMode(RX_LED, OUTPUT);
 
-  // set up the Wifi LED for PWM
-  pwm.connect(0, WIFI_LED);
-  pwm.set(0, 0);
-  pwm.begin(1, 500);
+  // set up the Wifi LED on the sigma-delta modulator
+  sigmaDeltaSetup(LED_CHANNEL, 10000);
+  sigmaDeltaAttachPin(WIFI_LED, LED_CHANNEL);
+  led_set(0);
+
+  smarties.getWebServer().on(FILTER_ROUTE, HTTP_POST, handle_filter);
 
+  Serial.setRxBufferSize(SERIAL_RX_BUFFER_SIZE);
   Serial.begin(BAUD_RATE);
 
   // Connect to WiFi network
@@ -174,42 +224,193 @@ void setup(void)
 
   // Start TCP server
   server.begin();
+
+  breath.attach_ms(LED_BREATH_INTERVAL, led_breath_step);
 }
 
 WiFiClient client;
-uint8 pulse = 0;
-uint8 pulse_dir = 1;
-int pulse_counter = 1;
+RingBuffer<SERIAL_BUFFER_SIZE> serial_buffer;
+RingBuffer<NET_BUFFER_SIZE> net_buffer;
+
+// arrival time of the oldest byte waiting in serial_buffer, and whether a
+// complete line is pending
+unsigned long serial_oldest = 0;
+bool serial_line = false;
+unsigned long last_housekeeping = 0;
+
+// serial line being framed
+char line_buffer[LINE_BUFFER_SIZE];
+size_t line_length = 0;
+TelegramFilter filter;
+
+struct {
+  unsigned long serialToTcp;    // bytes
+  unsigned long tcpToSerial;    // bytes
+  unsigned long segments;       // TCP writes of coalesced serial data
+  unsigned long serialOverruns; // housekeeping intervals with a UART overrun
+  unsigned long filtered;       // telegrams from devices out of the allow-list
+  unsigned long duplicates;     // telegrams repeated within the duplicate window
+  unsigned long latency;        // last serial to TCP latency, in microseconds
+  unsigned long latencyMax;     // in microseconds
+} stats;
+
+void reset_buffers() {
+  serial_buffer.clear();
+  net_buffer.clear();
+  serial_line = false;
+  line_length = 0;
+}
 
-void loop(void)
-{
-  size_t bytes_read;
-  uint8_t net_buf[BUFFER_SIZE];
-  uint8_t serial_buf[BUFFER_SIZE];
+void handle_filter() {
+  ESP8266WebServer &http = smarties.getWebServer();
+  DynamicJsonBuffer jsonBuffer;
+  JsonObject &root = smarties.parseJson(jsonBuffer, http.arg("plain"));
+  if (!root.success()) {
+    http.send(400, "application/json", "{}");
+    return;
+  }
 
-#ifdef USE_WDT
-  wdt_reset();
-#endif
+  filter.clearIds();
+  JsonArray &ids = root["ids"];
+  for (JsonVariant id : ids) {
+    filter.allowId(id.as<const char*>());
+  }
+  if (root.containsKey("window")) {
+    filter.setWindow(root["window"].as<unsigned long>());
+  }
+
+  http.send(200, "application/json", "{}");
+}
+
+// Queue the framed line for the network, filtering it when complete
+void forward_line(bool complete) {
+  size_t length = line_length;
+  while(complete && length > 0 && (line_buffer[length - 1] == '\n' || line_buffer[length - 1] == '\r')) {
+    length--;
+  }
+
+  bool duplicate = false;
+  if(!complete || filter.accept(line_buffer, length, millis(), &duplicate)) {
+    if(serial_buffer.available() == 0) {
+      serial_oldest = micros();
+    }
+    serial_buffer.write((const uint8_t *)line_buffer, line_length);
+    serial_line = serial_line || complete;
+  } else if(duplicate) {
+    stats.duplicates++;
+  } else {
+    stats.filtered++;
+  }
+
+  line_length = 0;
+}
+
+void housekeeping() {
+  if (millis() - last_housekeeping < HOUSEKEEPING_INTERVAL) {
+    return;
+  }
+  last_housekeeping = millis();
 
+  if (Serial.hasOverrun()) {
+    stats.serialOverruns++;
+  }
+
+  smarties.setValue("serialToTcp", stats.serialToTcp);
+  smarties.setValue("tcpToSerial", stats.tcpToSerial);
+  smarties.setValue("segments", stats.segments);
+  smarties.setValue("serialOverruns", stats.serialOverruns);
+  smarties.setValue("filtered", stats.filtered);
+  smarties.setValue("duplicates", stats.duplicates);
+  smarties.setValue("latency", stats.latency);
+  smarties.setValue("latencyMax", stats.latencyMax);
   smarties.loop();
+}
+
+void pump_net_to_serial() {
+  uint8_t *free_span;
+  const uint8_t *data;
+  size_t length;
+
+  int count = client.available();
+  if(count > 0) {
+    length = net_buffer.reserve(&free_span);
+    if(length > 0) {
+      net_buffer.commit(client.read(free_span, _min(length, (size_t)count)));
+    }
+  }
+
+  // only what the UART can take without blocking
+  length = _min(net_buffer.peek(&data), (size_t)Serial.availableForWrite());
+  if(length > 0) {
+    length = Serial.write(data, length);
+    net_buffer.consume(length);
+    stats.tcpToSerial += length;
+  }
+
+  digitalWrite(TX_LED, net_buffer.available() > 0 ? HIGH : LOW);
+}
+
+void pump_serial_to_net() {
+  const uint8_t *data;
+  size_t length;
+
+  // frame lines, bytes stay in the UART buffer until serial_buffer can take
+  // a whole one
+  while(Serial.available() > 0 && serial_buffer.space() >= LINE_BUFFER_SIZE) {
+    char c = Serial.read();
+    line_buffer[line_length++] = c;
+    if(c == '\n') {
+      forward_line(true);
+    } else if(line_length == LINE_BUFFER_SIZE) {
+      forward_line(false);
+    }
+  }
+
+  size_t pending = serial_buffer.available();
+  if(pending == 0) {
+    digitalWrite(RX_LED, LOW);
+    return;
+  }
+  digitalWrite(RX_LED, HIGH);
+
+  if(!serial_line && pending < TCP_COALESCE_BYTES && (micros() - serial_oldest) < TCP_COALESCE_DELAY * 1000UL) {
+    return;
+  }
 
-  pulse_counter--;
-  if(pulse_counter == 0) {
-    pulse_counter = 1000;
-    if(pulse_dir) {
-      pulse++;
-      if(pulse == PWM_MAX_DUTY) {
-        pulse_dir = 0;
-      }
-    } else {
-      pulse--;
-      if(pulse == 0) {
-        pulse_dir = 1;
-      }
+  bool sent = false;
+  while(serial_buffer.available() > 0) {
+    length = _min(serial_buffer.peek(&data), (size_t)client.availableForWrite());
+    if(length == 0) {
+      break;
+    }
+    length = client.write(data, length);
+    if(length == 0) {
+      break;
     }
+    serial_buffer.consume(length);
+    stats.serialToTcp += length;
+    sent = true;
+  }
 
-    pwm.set(0, pulse);
+  if(sent) {
+    stats.segments++;
+    stats.latency = micros() - serial_oldest;
+    if(stats.latency > stats.latencyMax) {
+      stats.latencyMax = stats.latency;
+    }
+    // what is left goes with the next segment
+    serial_oldest = micros();
+    serial_line = serial_line && serial_buffer.available() > 0;
   }
+}
+
+void loop(void)
+{
+#ifdef USE_WDT
+  wdt_reset();
+#endif
+
+  housekeeping();
 
 #ifdef BONJOUR_SUPPORT
   // Check for any mDNS queries and send responses
@@ -222,6 +423,7 @@ void loop(void)
     while(Serial.available()) {
       Serial.read();
     }
+    reset_buffers();
 
     client = server.available();
     if(!client) {
@@ -231,38 +433,16 @@ void loop(void)
       return;
     }
 
+    // coalescing is done above, Nagle would only add delay
+    client.setNoDelay(true);
 #ifdef CONNECTION_LED
     digitalWrite(CONNECTION_LED, HIGH);
 #endif
   }
-#define min(a,b) ((a)<(b)?(a):(b))
-  if(client.connected()) {
-    // check the network for any bytes to send to the serial
-    int count = client.available();
-    if(count > 0) {
-      digitalWrite(TX_LED, HIGH);
-
-      bytes_read = client.read(net_buf, min(count, BUFFER_SIZE));
-      Serial.write(net_buf, bytes_read);
-      Serial.flush();
-    } else {
-      digitalWrite(TX_LED, LOW);
-    }
 
-    // now check the serial for any bytes to send to the network
-    bytes_read = 0;
-    while(Serial.available() && bytes_read < BUFFER_SIZE) {
-      serial_buf[bytes_read] = Serial.read();
-      bytes_read++;
-    }
-
-    if(bytes_read > 0) {
-      digitalWrite(RX_LED, HIGH);
-      client.write((const uint8_t*)serial_buf, bytes_read);
-      client.flush();
-    } else {
-      digitalWrite(RX_LED, LOW);
-    }
+  if(client.connected()) {
+    pump_net_to_serial();
+    pump_serial_to_net();
   } else {
     // make sure the TX and RX LEDs aren't on
     digitalWrite(TX_LED, LOW);
@@ -272,5 +452,6 @@ void loop(void)
 #endif
 
     client.stop();
+    reset_buffers();
   }
 }
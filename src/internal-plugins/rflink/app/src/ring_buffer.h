@@ -0,0 +1,71 @@
+/*
+  Byte ring buffer for the serial / TCP bridge
+
+  Indexes run freely and are masked on access, so SIZE must be a power of two.
+  Reads and writes expose contiguous spans of the storage, letting the bridge
+  hand them straight to Serial and WiFiClient without an extra copy.
+*/
+#ifndef __ring_buffer_h__
+#define __ring_buffer_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+template <size_t SIZE>
+class RingBuffer {
+  static_assert((SIZE & (SIZE - 1)) == 0, "RingBuffer size must be a power of two");
+
+public:
+  RingBuffer() : _head(0), _tail(0) {}
+
+  size_t available() const { return _head - _tail; }
+  size_t space() const { return SIZE - available(); }
+  void clear() { _tail = _head; }
+
+  // Contiguous free span, fill it then commit() what was written
+  size_t reserve(uint8_t **data) {
+    size_t offset = _head & (SIZE - 1);
+    size_t length = SIZE - offset;
+    *data = &_buffer[offset];
+    return (length < space()) ? length : space();
+  }
+
+  void commit(size_t length) { _head += length; }
+
+  // Copy as much of data as fits, returns the number of bytes written
+  size_t write(const uint8_t *data, size_t length) {
+    size_t written = 0;
+    uint8_t *span;
+    size_t spanLength;
+    while (written < length && (spanLength = reserve(&span)) > 0) {
+      if (spanLength > length - written) {
+        spanLength = length - written;
+      }
+      memcpy(span, data + written, spanLength);
+      commit(spanLength);
+      written += spanLength;
+    }
+    return written;
+  }
+
+  // Contiguous pending span, send it then consume() what was sent
+  size_t peek(const uint8_t **data) const {
+    size_t offset = _tail & (SIZE - 1);
+    size_t length = SIZE - offset;
+    *data = &_buffer[offset];
+    return (length < available()) ? length : available();
+  }
+
+  void consume(size_t length) { _tail += length; }
+
+  // Byte at position index from the oldest one, index < available()
+  uint8_t at(size_t index) const { return _buffer[(_tail + index) & (SIZE - 1)]; }
+
+private:
+  uint8_t _buffer[SIZE];
+  size_t _head;
+  size_t _tail;
+};
+
+#endif
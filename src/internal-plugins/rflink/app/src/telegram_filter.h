@@ -0,0 +1,148 @@
+/*
+  RFLink telegram filter for the serial / TCP bridge
+
+  Radio telegrams look like 20;2D;Blyss;ID=6968;SWITCH=C4;CMD=ON;
+  Only those carrying an ID= field are filtered: they are dropped when the
+  device is not in the allow-list (an empty list allows everything) or when
+  the same telegram, sequence number aside, was seen within the duplicate
+  window. Versions, acknowledges and anything else always go through.
+*/
+#ifndef __telegram_filter_h__
+#define __telegram_filter_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#define TELEGRAM_MAX_IDS 32
+#define TELEGRAM_ID_LENGTH 15
+#define TELEGRAM_RECENT 16
+#define TELEGRAM_DEFAULT_WINDOW 1000 // In milliseconds
+
+class TelegramFilter {
+public:
+  TelegramFilter() : _idCount(0), _window(TELEGRAM_DEFAULT_WINDOW), _recentIndex(0) {
+    memset(_recent, 0, sizeof(_recent));
+  }
+
+  void clearIds() { _idCount = 0; }
+
+  bool allowId(const char *id) {
+    if (_idCount >= TELEGRAM_MAX_IDS) {
+      return false;
+    }
+    size_t i = 0;
+    for (; id[i] && i < TELEGRAM_ID_LENGTH; i++) {
+      _ids[_idCount][i] = tolower((unsigned char)id[i]);
+    }
+    _ids[_idCount][i] = 0;
+    _idCount++;
+    return true;
+  }
+
+  void setWindow(unsigned long window) { _window = window; }
+  uint8_t idCount() const { return _idCount; }
+  unsigned long window() const { return _window; }
+
+  // Whether a line, without its line ending, should be forwarded
+  bool accept(const char *line, size_t length, unsigned long now, bool *duplicate) {
+    *duplicate = false;
+
+    // skip 20;xx; so that the sequence number does not defeat duplicate detection
+    if (length < 3 || strncmp(line, "20;", 3) != 0) {
+      return true;
+    }
+    const char *payload = (const char *)memchr(line + 3, ';', length - 3);
+    if (payload == NULL) {
+      return true;
+    }
+    payload++;
+    size_t payloadLength = length - (payload - line);
+
+    const char *id = field(payload, payloadLength, "ID=");
+    if (id == NULL) {
+      return true;
+    }
+
+    if (_idCount > 0 && !allowed(id, (line + length) - id)) {
+      return false;
+    }
+
+    if (_window > 0) {
+      uint32_t hash = fnv1a(payload, payloadLength);
+      for (uint8_t i = 0; i < TELEGRAM_RECENT; i++) {
+        if (_recent[i].hash == hash && _recent[i].time != 0 && (now - _recent[i].time) < _window) {
+          *duplicate = true;
+          return false;
+        }
+      }
+      _recent[_recentIndex].hash = hash;
+      _recent[_recentIndex].time = now ? now : 1;
+      _recentIndex = (_recentIndex + 1) % TELEGRAM_RECENT;
+    }
+
+    return true;
+  }
+
+private:
+  // Value of a key=value field, NULL if absent
+  static const char *field(const char *payload, size_t length, const char *key) {
+    size_t keyLength = strlen(key);
+    const char *end = payload + length;
+    const char *p = payload;
+    while (p < end) {
+      if ((size_t)(end - p) > keyLength && strncmp(p, key, keyLength) == 0) {
+        return p + keyLength;
+      }
+      const char *next = (const char *)memchr(p, ';', end - p);
+      if (next == NULL) {
+        break;
+      }
+      p = next + 1;
+    }
+    return NULL;
+  }
+
+  bool allowed(const char *id, size_t available) {
+    size_t length = 0;
+    while (length < available && id[length] != ';') {
+      length++;
+    }
+    for (uint8_t i = 0; i < _idCount; i++) {
+      if (strlen(_ids[i]) != length) {
+        continue;
+      }
+      size_t j = 0;
+      while (j < length && tolower((unsigned char)id[j]) == _ids[i][j]) {
+        j++;
+      }
+      if (j == length) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static uint32_t fnv1a(const char *data, size_t length) {
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < length; i++) {
+      hash ^= (uint8_t)data[i];
+      hash *= 16777619UL;
+    }
+    return hash;
+  }
+
+  struct Recent {
+    uint32_t hash;
+    unsigned long time;
+  };
+
+  char _ids[TELEGRAM_MAX_IDS][TELEGRAM_ID_LENGTH + 1];
+  uint8_t _idCount;
+  unsigned long _window;
+  Recent _recent[TELEGRAM_RECENT];
+  uint8_t _recentIndex;
+};
+
+#endif
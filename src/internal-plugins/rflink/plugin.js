@@ -11,6 +11,8 @@ const BASE_RFLINK_UPDATE_URL = "http://www.nemcon.nl/blog2/fw/update.jsp";
 const RFLINK_LAN_PORT = 9999;
 const RETRY_IN_SECONDS = 3;
 const SEND_BUFFER_IN_MS = 500;
+const BRIDGE_FILTER_ROUTE = "/rflink/filter";
+const DEFAULT_DUPLICATE_WINDOW_IN_MS = 1000;
 
 /**
  * Loaded plugin function
@@ -24,7 +26,7 @@ function loaded(api) {
 
     const espPlugin = api.getPluginInstance("esp8266");
     const wiringSchema = api.iotAPI.getWiringSchemaForLib("esp8266");
-    api.iotAPI.registerApp("app", "rflink-lan", "RFLink LAN", 1, api.iotAPI.constants().PLATFORMS.ESP8266, api.iotAPI.constants().BOARDS.NODEMCU, api.iotAPI.constants().FRAMEWORKS.ARDUINO, ["esp8266"], espPlugin.generateOptions(espPlugin.constants().MODE_ALWAYS_POWERED, 0), wiringSchema);
+    api.iotAPI.registerApp("app", "rflink-lan", "RFLink LAN", 2, api.iotAPI.constants().PLATFORMS.ESP8266, api.iotAPI.constants().BOARDS.NODEMCU, api.iotAPI.constants().FRAMEWORKS.ARDUINO, ["esp8266"], espPlugin.generateOptions(espPlugin.constants().MODE_ALWAYS_POWERED, 0), wiringSchema);
 
     /**
      * This class manage RFLink form configuration
@@ -40,9 +42,11 @@ function loaded(api) {
          * @param  {number} retry Retry policy
          * @param  {boolean} flash Flash Rflink
          * @param  {string} command RFlink command
+         * @param  {string} allowedIds Comma separated device identifiers forwarded by a LAN bridge
+         * @param  {number} duplicateWindow Window in ms during which a LAN bridge drops repeated telegrams
          * @returns {RFlinkForm}        The instance
          */
-        constructor(id, port, retry, flash, command) {
+        constructor(id, port, retry, flash, command, allowedIds, duplicateWindow) {
             super(id);
             /**
              * @Property("port");
@@ -76,6 +80,21 @@ function loaded(api) {
              * @Title("rflink.command");
              */
             this.command = command;
+
+            /**
+             * @Property("allowedIds");
+             * @Type("string");
+             * @Title("rflink.bridge.allowed.ids");
+             */
+            this.allowedIds = allowedIds;
+
+            /**
+             * @Property("duplicateWindow");
+             * @Type("number");
+             * @Title("rflink.bridge.duplicate.window");
+             * @Default(1000);
+             */
+            this.duplicateWindow = duplicateWindow;
         }
 
         /**
@@ -105,7 +124,7 @@ function loaded(api) {
          * @returns {RFlinkForm}      An instance
          */
         json(data) {
-            return new RFlinkForm(data.id, data.port, data.retry, data.flash, data.command);
+            return new RFlinkForm(data.id, data.port, data.retry, data.flash, data.command, data.allowedIds, data.duplicateWindow);
         }
     }
 
@@ -146,6 +165,14 @@ function loaded(api) {
                 this.service.port = port;
             }
 
+            // The bridge keeps its filter in RAM, push it again when it pings after a reboot
+            api.coreAPI.registerEvent(espPlugin.constants().PING_EVENT_KEY, (data) => {
+                const configuration = api.configurationAPI.getConfiguration();
+                if (data && data.ip && configuration && configuration.port && data.id === configuration.port.toString()) {
+                    this.pushBridgeFilter(data.ip, configuration);
+                }
+            });
+
             const self = this;
             api.configurationAPI.setUpdateCb((data, user) => {
                 if (data && data.command && data.command.length > 0) {
@@ -158,7 +185,7 @@ function loaded(api) {
                     data.command = "";
                 } else {
                     if (data && data.port) {
-                        const port = this.startRFLinkInLanMode(data.port);
+                        const port = this.startRFLinkInLanMode(data.port, data);
                         this.service.port = port;
                         if (this.socatService) {
                             this.socatService.start();
@@ -289,9 +316,10 @@ function loaded(api) {
          * Socat will connect to the TCP socket and mount an endpoint
          *
          * @param  {string} [confPort=null] The configuration settings, port or iot identifier
+         * @param  {object} [configuration=null] The configuration pushed to the bridge, if not set the saved one
          * @returns {string}          The port, if USB connected the USB endpoint, if LAN the mounted endpoint
          */
-        startRFLinkInLanMode(confPort = null) {
+        startRFLinkInLanMode(confPort = null, configuration = null) {
             let port = confPort?confPort:api.configurationAPI.getConfiguration().port;
             const iotId = port; // I know  ...
             if (this.api.iotAPI.getIot(iotId)) {
@@ -315,12 +343,35 @@ function loaded(api) {
                     this.socatService = socatService;
                     this.api.servicesManagerAPI.add(this.socatService);
                     port = socatPort;
+                    this.pushBridgeFilter(ip, configuration);
                 }
             }
 
             return port;
         }
 
+        /**
+         * Push the telegram filter to a LAN bridge. The bridge only forwards telegrams
+         * from the allowed device identifiers (all of them if the list is empty) and drops
+         * repeated telegrams within the duplicate window.
+         *
+         * @param  {string} ip The bridge IP address
+         * @param  {object} [configuration=null] The configuration, if not set the saved one
+         */
+        pushBridgeFilter(ip, configuration = null) {
+            configuration = configuration || api.configurationAPI.getConfiguration() || {};
+            const allowedIds = (configuration.allowedIds ? configuration.allowedIds.split(",") : []).map((id) => id.trim().toLowerCase()).filter((id) => id.length > 0);
+            const duplicateWindow = (configuration.duplicateWindow !== undefined && configuration.duplicateWindow !== null) ? parseInt(configuration.duplicateWindow) : DEFAULT_DUPLICATE_WINDOW_IN_MS;
+
+            request.post({url:"http://" + ip + BRIDGE_FILTER_ROUTE, json:{ids:allowedIds, window:duplicateWindow}, timeout:5000}, (error, response) => {
+                if (error || !response || response.statusCode !== 200) {
+                    api.exported.Logger.warn("Could not push telegram filter to RFLink bridge " + ip + (error ? " : " + error.message : ""));
+                } else {
+                    api.exported.Logger.info("Telegram filter pushed to RFLink bridge " + ip + " (" + allowedIds.length + " allowed ids, " + duplicateWindow + " ms duplicate window)");
+                }
+            });
+        }
+
         /**
          * Convert RFLink radio status to smarties radio statuses
          *
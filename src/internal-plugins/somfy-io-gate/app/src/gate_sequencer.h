@@ -0,0 +1,200 @@
+/*
+  Non blocking Somfy io gate sequencer
+
+  The Keygo remote buttons are pulsed (active low) by a step queue played from
+  poll() against millis(), so HTTP handlers only enqueue and return. Commands
+  wait in their own queue and are expanded into pulses once the previous one
+  is done.
+
+  The gate input is sequential : a second open while the gate moves stops it,
+  and an open once the gate is open closes it. A command is then dropped
+  (coalesced) only when the same one is already the last queued one. The
+  state and position estimate is for reporting only, it follows the commands
+  sent from here over GATE_TRAVEL_TIME for a full opening, closing and
+  auto-close are not modelled, and it drifts when the gate is also driven by
+  another remote. It goes back to unknown GATE_STATE_TIMEOUT after the last
+  command.
+*/
+#ifndef __gate_sequencer_h__
+#define __gate_sequencer_h__
+
+#include <Arduino.h>
+
+#define GATE_STEPS_SIZE 16          // Pulse steps, power of two
+#define GATE_COMMANDS_SIZE 8        // Commands, power of two
+#define GATE_PULSE 50               // In milliseconds, button pressed
+#define GATE_PULSE_GAP 100          // In milliseconds, between two presses of a command
+#define GATE_COMMAND_GAP 100        // In milliseconds, between two commands
+#define GATE_TRAVEL_TIME 20000      // In milliseconds, closed to fully open
+#define GATE_PEDESTRIAN_POSITION 30 // In percent of a full opening
+#define GATE_STATE_TIMEOUT 120000   // In milliseconds, before the estimate is unknown again
+
+#define GATE_COMMAND_OPEN 0
+#define GATE_COMMAND_STOP 1
+#define GATE_COMMAND_PEDESTRIAN 2
+
+#define GATE_STATE_UNKNOWN 0
+#define GATE_STATE_OPENING 1
+#define GATE_STATE_OPEN 2
+#define GATE_STATE_STOPPED 3
+
+#define GATE_QUEUED 0
+#define GATE_COALESCED 1
+#define GATE_FULL 2
+
+class GateSequencer {
+public:
+  GateSequencer(uint8_t openPin, uint8_t pedestrianPin)
+      : _openPin(openPin), _pedestrianPin(pedestrianPin), _stepHead(0), _stepTail(0), _next(0),
+        _commandHead(0), _commandTail(0), _state(GATE_STATE_UNKNOWN), _from(0), _target(0), _since(0) {}
+
+  void begin() {
+    pinMode(_openPin, OUTPUT);
+    digitalWrite(_openPin, HIGH);
+    pinMode(_pedestrianPin, OUTPUT);
+    digitalWrite(_pedestrianPin, HIGH);
+  }
+
+  uint8_t enqueue(uint8_t command) {
+    // Never against the estimate, which cannot tell whether the gate closed
+    if (_commandHead != _commandTail && _commands[(_commandHead - 1) & (GATE_COMMANDS_SIZE - 1)] == command) {
+      return GATE_COALESCED;
+    }
+
+    if (_commandHead - _commandTail >= GATE_COMMANDS_SIZE) {
+      return GATE_FULL;
+    }
+
+    _commands[_commandHead & (GATE_COMMANDS_SIZE - 1)] = command;
+    _commandHead++;
+    return GATE_QUEUED;
+  }
+
+  void poll() {
+    unsigned long now = millis();
+
+    while (true) {
+      if (_stepHead != _stepTail) {
+        if ((long)(now - _next) < 0) {
+          break;
+        }
+        const step_t &step = _steps[_stepTail & (GATE_STEPS_SIZE - 1)];
+        digitalWrite(step.pin, step.level);
+        _next = now + step.wait;
+        _stepTail++;
+      } else if (_commandHead != _commandTail && (long)(now - _next) >= 0) {
+        start(_commands[_commandTail & (GATE_COMMANDS_SIZE - 1)], now);
+        _commandTail++;
+      } else {
+        break;
+      }
+    }
+
+    if (_state == GATE_STATE_OPENING && position(now) >= _target) {
+      _state = GATE_STATE_OPEN;
+      _from = _target;
+    } else if (_state != GATE_STATE_UNKNOWN && _state != GATE_STATE_OPENING && now - _since >= GATE_STATE_TIMEOUT) {
+      _state = GATE_STATE_UNKNOWN;
+    }
+  }
+
+  size_t pending() const { return _commandHead - _commandTail; }
+  uint8_t state() const { return _state; }
+  uint8_t position() const { return position(millis()); }
+
+  // Milliseconds since the last command was played
+  unsigned long age() const { return millis() - _since; }
+
+  static const char *stateName(uint8_t state) {
+    switch (state) {
+      case GATE_STATE_OPENING: return "opening";
+      case GATE_STATE_OPEN: return "open";
+      case GATE_STATE_STOPPED: return "stopped";
+      default: return "unknown";
+    }
+  }
+
+private:
+  typedef struct {
+    uint8_t pin;
+    uint8_t level;
+    uint16_t wait;
+  } step_t;
+
+  void push(uint8_t pin, uint8_t level, uint16_t wait) {
+    step_t &step = _steps[_stepHead & (GATE_STEPS_SIZE - 1)];
+    step.pin = pin;
+    step.level = level;
+    step.wait = wait;
+    _stepHead++;
+  }
+
+  void press(uint8_t pin, uint16_t release) {
+    push(pin, LOW, GATE_PULSE);
+    push(pin, HIGH, release);
+  }
+
+  void start(uint8_t command, unsigned long now) {
+    uint8_t current = position(now);
+    switch (command) {
+      case GATE_COMMAND_STOP:
+        press(_openPin, GATE_PULSE_GAP);
+        press(_openPin, GATE_COMMAND_GAP);
+        _state = GATE_STATE_STOPPED;
+        _target = current;
+        break;
+      case GATE_COMMAND_PEDESTRIAN:
+        press(_pedestrianPin, GATE_COMMAND_GAP);
+        _state = GATE_STATE_OPENING;
+        _target = GATE_PEDESTRIAN_POSITION;
+        break;
+      default:
+        press(_openPin, GATE_COMMAND_GAP);
+        if (_state == GATE_STATE_OPENING) {
+          // Sequential input, the press stops the gate
+          _state = GATE_STATE_STOPPED;
+          _target = current;
+        } else if (_state == GATE_STATE_OPEN) {
+          // The press closes the gate, which is not modelled
+          _state = GATE_STATE_UNKNOWN;
+          _target = current;
+        } else {
+          _state = GATE_STATE_OPENING;
+          _target = 100;
+        }
+        break;
+    }
+    _from = current;
+    _since = now ? now : 1;
+  }
+
+  uint8_t position(unsigned long now) const {
+    if (_state != GATE_STATE_OPENING) {
+      return _from;
+    }
+    unsigned long travelled = ((now - _since) * 100UL) / GATE_TRAVEL_TIME;
+    if (_target <= _from) {
+      return _target;
+    }
+    return (travelled >= (unsigned long)(_target - _from)) ? _target : _from + travelled;
+  }
+
+  uint8_t _openPin;
+  uint8_t _pedestrianPin;
+
+  step_t _steps[GATE_STEPS_SIZE];
+  size_t _stepHead;
+  size_t _stepTail;
+  unsigned long _next;
+
+  uint8_t _commands[GATE_COMMANDS_SIZE];
+  size_t _commandHead;
+  size_t _commandTail;
+
+  uint8_t _state;
+  uint8_t _from;
+  uint8_t _target;
+  unsigned long _since;
+};
+
+#endif
@@ -1,33 +1,70 @@
 #include <Smarties.h>
 #include <string>
 #include <memory>
+#include "gate_sequencer.h"
+
+#define WIFI_RETRY 5000 // In milliseconds between two reconnection attempts
 
-String JSON_CONFIG = "%config%";
 Smarties smarties = Smarties();
+GateSequencer gate(D1, D3);
+
+unsigned long wifiLost = 0;
+unsigned long wifiAttempt = 0;
+uint8_t publishedState = 0xFF;
+
+String gateStatus() {
+	return ", \"state\":\"" + String(GateSequencer::stateName(gate.state())) + "\", \"position\":" + String(gate.position()) + ", \"pending\":" + String(gate.pending());
+}
+
+// Commands are queued and pulsed by gate.poll(), handlers answer at once
+void queued(uint8_t command) {
+	uint8_t result = gate.enqueue(command);
+	if (result == GATE_FULL) {
+		smarties.getWebServer().send(503, "application/json", "{\"success\":false, \"error\":\"Command queue full\"}");
+	} else {
+		smarties.getWebServer().send(200, "application/json", "{\"success\":true, \"coalesced\":" + String((result == GATE_COALESCED) ? "true" : "false") + gateStatus() + "}");
+	}
+}
 
 void openGate() {
-	digitalWrite(D1, LOW);
-	delay(50);
- 	digitalWrite(D1, HIGH);
-	smarties.getWebServer().send(200, "application/json", "{\"success\":true}");
+	queued(GATE_COMMAND_OPEN);
 }
 
 void stopGate() {
-	digitalWrite(D1, LOW);
-	delay(50);
- 	digitalWrite(D1, HIGH);
-	delay(100);
-	digitalWrite(D1, LOW);
-	delay(50);
- 	digitalWrite(D1, HIGH);
-	smarties.getWebServer().send(200, "application/json", "{\"success\":true}");
+	queued(GATE_COMMAND_STOP);
 }
 
 void openGatePedestrian() {
-	digitalWrite(D3, LOW);
-	delay(50);
- 	digitalWrite(D3, HIGH);
-	smarties.getWebServer().send(200, "application/json", "{\"success\":true}");
+	queued(GATE_COMMAND_PEDESTRIAN);
+}
+
+void statusGate() {
+	smarties.getWebServer().send(200, "application/json", "{\"success\":true" + gateStatus() + ", \"age\":" + String(gate.age()) + "}");
+}
+
+boolean openCommand(const char *args) {
+	return gate.enqueue(GATE_COMMAND_OPEN) != GATE_FULL;
+}
+
+boolean stopCommand(const char *args) {
+	return gate.enqueue(GATE_COMMAND_STOP) != GATE_FULL;
+}
+
+boolean openPedestrianCommand(const char *args) {
+	return gate.enqueue(GATE_COMMAND_PEDESTRIAN) != GATE_FULL;
+}
+
+// Push the estimated state to the hub on each change, and again once the
+// channel is back
+void publishState() {
+	if (!smarties.channelConnected()) {
+		publishedState = 0xFF;
+	} else if (gate.state() != publishedState) {
+		smarties.publish("position", String(gate.position()));
+		if (smarties.publish("state", GateSequencer::stateName(gate.state()))) {
+			publishedState = gate.state();
+		}
+	}
 }
 
 void ping() {
@@ -35,25 +72,48 @@ void ping() {
     smarties.getWebServer().send(200, "application/json", "{\"success\":true}");
 }
 
+// Rejoin the access point in the background, the gate keeps being driven and
+// the hub is pinged once back as the address may have changed
+void checkWifi() {
+	unsigned long now = millis();
+	if (WiFi.status() != WL_CONNECTED) {
+		if (wifiLost == 0) {
+			wifiLost = now ? now : 1;
+			wifiAttempt = now;
+		} else if (now - wifiAttempt >= WIFI_RETRY) {
+			Serial.println("WiFi lost for " + String(now - wifiLost) + "ms, reconnecting");
+			WiFi.reconnect();
+			wifiAttempt = now;
+		}
+	} else if (wifiLost != 0) {
+		Serial.println("WiFi back after " + String(now - wifiLost) + "ms");
+		wifiLost = 0;
+		smarties.ping();
+	}
+}
+
 
 void setup() {
-    smarties.setup(JSON_CONFIG);
+    smarties.setup();
 
-	pinMode(D1, OUTPUT);
-  	digitalWrite(D1, HIGH);
-	pinMode(D3, OUTPUT);
-  	digitalWrite(D3, HIGH);
-    delay(25);
+	gate.begin();
+	WiFi.setAutoReconnect(true);
 
     smarties.getWebServer().on("/open", openGate);
 	smarties.getWebServer().on("/open-pedestrian", openGatePedestrian);
 	smarties.getWebServer().on("/stop", stopGate);
+	smarties.getWebServer().on("/status", statusGate);
 	smarties.getWebServer().on("/ping", ping);
+
+	smarties.onCommand("open", openCommand);
+	smarties.onCommand("open-pedestrian", openPedestrianCommand);
+	smarties.onCommand("stop", stopCommand);
 }
 
 void loop() {
-	if (WiFi.status() != WL_CONNECTED) {
-		ESP.reset();
-	}
+	gate.poll();
+	checkWifi();
+	smarties.channel();
+	publishState();
     smarties.getWebServer().handleClient();
 }
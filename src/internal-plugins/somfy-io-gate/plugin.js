@@ -1,7 +1,5 @@
 "use strict";
 
-const request = require("request");
-
 /**
  * Loaded function
  *
@@ -88,7 +86,7 @@ function loaded(api) {
             wiringSchema.right["D3"].push("Keygo left button - top pin");
             wiringSchema.right["GND-2"].push("Keygo -");
             wiringSchema.right["3V3-2"].push("Keygo +");
-            this.api.iotAPI.registerApp("app", "somfy-io-gate", "Nodemcu somfy keygo", 3, api.iotAPI.constants().PLATFORMS.ESP8266, api.iotAPI.constants().BOARDS.NODEMCU, api.iotAPI.constants().FRAMEWORKS.ARDUINO, ["esp8266"], espPlugin.generateOptions(espPlugin.constants().MODE_ALWAYS_POWERED, 0), wiringSchema);
+            this.api.iotAPI.registerApp("app", "somfy-io-gate", "Nodemcu somfy keygo", 4, api.iotAPI.constants().PLATFORMS.ESP8266, api.iotAPI.constants().BOARDS.NODEMCU, api.iotAPI.constants().FRAMEWORKS.ARDUINO, ["esp8266"], espPlugin.generateOptions(espPlugin.constants().MODE_ALWAYS_POWERED, 0), wiringSchema);
             this.api.iotAPI.addIngredientForReceipe("somfy-io-gate", "Keygo io 1W", "Remote controller", 1, true);
             this.keygo = null;
             const self = this;
@@ -141,8 +139,8 @@ function loaded(api) {
         openGate(pedestrian = false, cb = null) {
             if (this.keygo) {
                 const command = (pedestrian ? "open-pedestrian" : "open");
-                this.api.exported.Logger.info("Trigger " + "http://" + this.keygo.ip + "/" + command);
-                request("http://" + this.keygo.ip + "/" + command, { }, (err) => {
+                this.api.exported.Logger.info("Trigger " + command + " on " + this.keygo.id);
+                this.api.getPluginInstance("esp8266").sendCommand(this.keygo.id, command, (err) => {
                     if (err) {
                         api.exported.Logger.err(err);
                         if (cb) cb(err);
@@ -163,8 +161,8 @@ function loaded(api) {
         stopGate(cb = null) {
             if (this.keygo) {
                 const command = "stop";
-                this.api.exported.Logger.info("Trigger " + "http://" + this.keygo.ip + "/" + command);
-                request("http://" + this.keygo.ip + "/" + command, { }, (err) => {
+                this.api.exported.Logger.info("Trigger " + command + " on " + this.keygo.id);
+                this.api.getPluginInstance("esp8266").sendCommand(this.keygo.id, command, (err) => {
                     if (err) {
                         api.exported.Logger.err(err);
                         if (cb) cb(err);
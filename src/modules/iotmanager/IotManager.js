@@ -1,5 +1,8 @@
 "use strict";
 const fs = require("fs-extra");
+const os = require("os");
+const path = require("path");
+const crypto = require("crypto");
 const md5File = require("md5-file");
 const childProcess = require("child_process");
 const Logger = require("./../../logger/Logger");
@@ -17,7 +20,33 @@ const SRC_FOLDER = "src";
 const LIB_FOLDER = "lib";
 const GLOBAL_LIB_FOLDER = "global_lib";
 const MAIN_FILE = "main.cpp";
-const CONFIGURATION_PLACEHOLDER = "%config%";
+
+// Configuration region reserved in firmwares by the Smarties lib (smarties_config_t)
+const CONFIGURATION_MAGIC = "SMARTIES-CONFIG!";
+const CONFIGURATION_LENGTH_OFFSET = 16;
+const CONFIGURATION_CHECKSUM_OFFSET = 20;
+const CONFIGURATION_BALANCE_OFFSET = 24;
+const CONFIGURATION_DEVICE_OFFSET = 28;
+// IoT settings (smarties_device_t), null terminated strings
+const CONFIGURATION_DEVICE_FIELDS = [{key:"id", size:20}, {key:"ssid", size:36}, {key:"passphrase", size:68}];
+const CONFIGURATION_DATA_OFFSET = 152;
+const CONFIGURATION_SIZE = 2048;
+// App constants header generated in the build workspace, read by the Smarties lib
+const CONFIGURATION_HEADER = "include/smarties_config.h";
+// Configured firmwares, named after app, version, content hash and configuration hash
+const FIRMWARES_FOLDER = "iot-firmwares/";
+
+const BUILD_STATUS_QUEUED = "queued";
+const BUILD_STATUS_RUNNING = "running";
+const BUILD_STATUS_DONE = "done";
+const BUILD_STATUS_FAILED = "failed";
+const BUILD_STEP_QUEUED = "queued";
+const BUILD_STEP_COMPILING = "compiling";
+const BUILD_STEP_CONFIGURING = "configuring";
+const BUILD_STEP_UPLOADING = "uploading";
+const BUILD_STEP_DONE = "done";
+// Rough completion of a build job for each step, in percent
+const BUILD_PROGRESS = {queued:0, compiling:10, configuring:80, uploading:90, done:100};
 
 const IOT_MANAGER_AVAILABLE_GET = ":/iot/available/get/";
 const IOT_MANAGER_POST_BASE = ":/iot/set";
@@ -64,7 +93,15 @@ class IotManager {
         this.messageManager = messageManager;
         this.iotApps = {};
         this.iotLibs = {};
-        this.isBuildingApp = false;
+        this.buildJobs = [];
+        this.lastBuildJobs = {};
+        this.buildJobCounter = 0;
+        // Each build already compiles on all cores, workers mostly overlap packages and uploads
+        const cores = os.cpus().length;
+        const workers = (appConfiguration.iot && appConfiguration.iot.buildWorkers) ? parseInt(appConfiguration.iot.buildWorkers) : Math.ceil(cores / 2);
+        this.buildWorkers = Math.max(1, Math.min(cores, workers));
+        this.buildCacheStatistics = {hits:0, misses:0, toolchainUpdates:0};
+        this.firmwareArtifacts = {};
 
         try {
             this.iots = this.confManager.loadData(Object, CONF_MANAGER_KEY, true);
@@ -243,6 +280,7 @@ class IotManager {
             }
         }
 
+        this.prebuildFirmwares(appId);
         Logger.info("Registered IoT app " + name);
     }
 
@@ -271,96 +309,619 @@ class IotManager {
         }
     }
 
+    /**
+     * Feed a hash with the relative paths and contents of all files in a folder, in a stable order
+     *
+     * @param  {Hash} hash   A crypto hash
+     * @param  {string} folder The folder
+     * @param  {string} [base=folder] The folder paths are relative to
+     */
+    hashFolder(hash, folder, base = folder) {
+        fs.readdirSync(folder).sort().forEach((file) => {
+            const filePath = folder + "/" + file;
+            if (fs.statSync(filePath).isDirectory()) {
+                this.hashFolder(hash, filePath, base);
+            } else {
+                hash.update(path.relative(base, filePath));
+                hash.update(fs.readFileSync(filePath));
+            }
+        });
+    }
+
+    /**
+     * Get the content hash of a registered app or lib folders, computed once
+     *
+     * @param  {object} iotAppOrLib An entry of `iotApps` or `iotLibs`
+     * @param  {Array} folders   The folders to hash
+     * @param  {number} version   The version, used when sources can not be read (pkg snapshot)
+     * @returns {string}           A md5 hex hash
+     */
+    folderContentHash(iotAppOrLib, folders, version) {
+        if (!iotAppOrLib.contentHash) {
+            const hash = crypto.createHash("md5");
+            try {
+                folders.forEach((folder) => {
+                    this.hashFolder(hash, folder);
+                });
+                iotAppOrLib.contentHash = hash.digest("hex");
+            } catch(e) {
+                Logger.warn("Could not hash IoT sources, using version : " + e.message);
+                iotAppOrLib.contentHash = "version-" + version;
+            }
+        }
+
+        return iotAppOrLib.contentHash;
+    }
+
+    /**
+     * Get the content hash of an app, its libraries and its build target.
+     * The build workspace is keyed by this hash, so compiled objects are reused as long as none of the sources changed.
+     *
+     * @param  {string} appId An app identifier
+     * @returns {string}       A md5 hex hash
+     */
+    contentHash(appId) {
+        const app = this.iotApps[appId];
+        const hash = crypto.createHash("md5");
+        hash.update([app.platform, app.board, app.framework].join("/"));
+        app.dependencies.forEach((dependencyId) => {
+            const dependency = this.iotLibs[dependencyId];
+            hash.update(dependencyId + ":" + this.folderContentHash(dependency, [dependency.lib, dependency.globalLib], dependency.version));
+        });
+        hash.update(appId + ":" + this.folderContentHash(app, [app.src, app.lib, app.globalLib], app.version));
+        hash.update(this.configurationHeader(appId));
+
+        return hash.digest("hex");
+    }
+
+    /**
+     * FNV-1a hash of a configuration, as checked by the firmware
+     *
+     * @param  {Buffer} data The configuration
+     * @returns {number}      The 32 bits hash
+     */
+    configurationChecksum(data) {
+        let hash = 2166136261;
+        for (let i = 0 ; i < data.length ; i++) {
+            hash = Math.imul(hash ^ data[i], 16777619) >>> 0;
+        }
+
+        return hash;
+    }
+
+    /**
+     * Write an IoT configuration into the reserved region of a firmware image.
+     * The settings used by the Smarties lib are written as fixed size fields, followed by the whole JSON configuration.
+     * A balance byte keeps the XOR of the region, hence the image checksum, unchanged.
+     *
+     * @param  {Buffer} image The firmware image, patched in place
+     * @param  {object} device The IoT settings : `id`, `ssid` and `passphrase`
+     * @param  {string} jsonConfiguration The JSON configuration
+     * @returns {Buffer}       The patched image
+     */
+    patchFirmware(image, device, jsonConfiguration) {
+        const offset = image.indexOf(CONFIGURATION_MAGIC);
+        if (offset === -1 || image.indexOf(CONFIGURATION_MAGIC, offset + 1) !== -1) {
+            throw Error("No configuration region found in firmware");
+        }
+
+        const data = Buffer.from(jsonConfiguration, "utf8");
+        if (data.length > CONFIGURATION_SIZE) {
+            throw Error("Configuration is too large (" + data.length + " bytes)");
+        }
+
+        const region = image.slice(offset, offset + CONFIGURATION_DATA_OFFSET + CONFIGURATION_SIZE);
+        if (region.length < CONFIGURATION_DATA_OFFSET + CONFIGURATION_SIZE) {
+            throw Error("Truncated configuration region in firmware");
+        }
+
+        const xor = (buffer) => buffer.reduce((value, byte) => value ^ byte, 0);
+        const initialXor = xor(region);
+        region.fill(0, CONFIGURATION_LENGTH_OFFSET);
+        let fieldOffset = CONFIGURATION_DEVICE_OFFSET;
+        CONFIGURATION_DEVICE_FIELDS.forEach((field) => {
+            const value = Buffer.from((device[field.key] !== null && device[field.key] !== undefined) ? device[field.key].toString() : "", "utf8");
+            if (value.length >= field.size) {
+                throw Error("Configuration " + field.key + " is too long (" + value.length + " bytes)");
+            }
+            value.copy(region, fieldOffset);
+            fieldOffset += field.size;
+        });
+        data.copy(region, CONFIGURATION_DATA_OFFSET);
+        region.writeUInt32LE(data.length, CONFIGURATION_LENGTH_OFFSET);
+        region.writeUInt32LE(this.configurationChecksum(region.slice(CONFIGURATION_DEVICE_OFFSET, CONFIGURATION_DATA_OFFSET + data.length)), CONFIGURATION_CHECKSUM_OFFSET);
+        region[CONFIGURATION_BALANCE_OFFSET] = initialXor ^ xor(region);
+
+        return image;
+    }
+
+    /**
+     * Generate the constants header of an app build : app identifier, version, api url and power options.
+     * These are shared by all IoTs of the app, so they are compiled in and the header is part of the content hash.
+     *
+     * @param  {string} appId An app identifier
+     * @returns {string}       The C++ header
+     */
+    configurationHeader(appId) {
+        const app = this.iotApps[appId];
+        const options = app.options ? app.options : {};
+        let header = "";
+        header += "// Generated by Smarties for " + appId + ", do not edit\n";
+        header += "#ifndef smarties_config_h\n";
+        header += "#define smarties_config_h\n";
+        header += "\n";
+        header += "#define SMARTIES_CONFIG_HEADER\n";
+        header += "constexpr char SMARTIES_IOT_APP[] = " + JSON.stringify(appId) + ";\n";
+        header += "constexpr char SMARTIES_API_URL[] = " + JSON.stringify(this.environmentManager.getLocalAPIUrl()) + ";\n";
+        header += "constexpr int SMARTIES_VERSION = " + parseInt(this.getVersion(appId)) + ";\n";
+        header += "constexpr int SMARTIES_POWERED_MODE = " + parseInt((options.poweredMode !== undefined) ? options.poweredMode : 1) + ";\n";
+        header += "constexpr long SMARTIES_TIMER = " + parseInt((options.timer !== undefined) ? options.timer : 60) + ";\n";
+        header += "\n";
+        header += "#endif\n";
+
+        return header;
+    }
+
+    /**
+     * Write the constants header of an app in a build workspace
+     *
+     * @param  {string} folder The folder where file should be written
+     * @param  {string} appId  An app identifier
+     */
+    writeConfigurationHeader(folder, appId) {
+        fs.ensureDirSync(path.dirname(folder + CONFIGURATION_HEADER));
+        fs.writeFileSync(folder + CONFIGURATION_HEADER, this.configurationHeader(appId));
+    }
+
+    /**
+     * Get the settings patched in the firmware of an IoT
+     *
+     * @param  {string} id     The iot identifier
+     * @param  {string} appId  An app identifier
+     * @param  {object} [config=null] The IoT configuration
+     * @returns {object}        An object with the `jsonConfiguration` string and the typed `device` settings
+     */
+    firmwareSettings(id, appId, config = null) {
+        const app = this.iotApps[appId];
+        const baseConfiguration = {
+            apiUrl:this.environmentManager.getLocalAPIUrl(),
+            version:this.getVersion(appId),
+            options:app.options
+        };
+
+        if (!config) {
+            config = {};
+        }
+
+        return {
+            jsonConfiguration:JSON.stringify(Object.assign(baseConfiguration, config)),
+            device:{
+                id:((config.id !== undefined && config.id !== null) ? config.id : id),
+                ssid:(config.ESP8266Form ? config.ESP8266Form.ssid : null),
+                passphrase:(config.ESP8266Form ? config.ESP8266Form.passphrase : null)
+            }
+        };
+    }
+
+    /**
+     * Get the path of a configured firmware in the artifact store
+     *
+     * @param  {string} appId             An app identifier
+     * @param  {string} jsonConfiguration The JSON configuration
+     * @returns {string}                   The firmware path
+     */
+    firmwareArtifactPath(appId, jsonConfiguration) {
+        const configurationHash = crypto.createHash("md5").update(jsonConfiguration).digest("hex").substr(0, 12);
+        return path.resolve(this.appConfiguration.cachePath + FIRMWARES_FOLDER) + "/" + appId + "-" + this.getVersion(appId) + "-" + this.contentHash(appId).substr(0, 12) + "-" + configurationHash + ".bin";
+    }
+
+    /**
+     * Get a configured firmware of the artifact store.
+     * Hash and size of firmwares built before a restart are computed on first access.
+     *
+     * @param  {string} firmwarePath The firmware path
+     * @returns {object}              An object with `path`, `md5` and `size` properties, `null` if the firmware is not built
+     */
+    firmwareArtifact(firmwarePath) {
+        if (!fs.existsSync(firmwarePath)) {
+            delete this.firmwareArtifacts[firmwarePath];
+            return null;
+        }
+
+        if (!this.firmwareArtifacts[firmwarePath]) {
+            this.firmwareArtifacts[firmwarePath] = {path:firmwarePath, md5:md5File.sync(firmwarePath), size:fs.statSync(firmwarePath).size};
+        }
+
+        return this.firmwareArtifacts[firmwarePath];
+    }
+
+    /**
+     * Get the firmware built for the current configuration of an IoT
+     *
+     * @param  {string} id The iot identifier
+     * @returns {object}    An object with `path`, `md5` and `size` properties, `null` if the firmware is not built yet
+     */
+    getFirmware(id) {
+        const iot = this.getIot(id);
+        if (!iot || !this.iotApps[iot.iotApp]) {
+            return null;
+        }
+
+        return this.firmwareArtifact(this.firmwareArtifactPath(iot.iotApp, this.firmwareSettings(id, iot.iotApp, iot).jsonConfiguration));
+    }
+
+    /**
+     * Remove the build cache entries of an app that the current sources will not use anymore :
+     * firmwares of other versions or contents, base firmwares of other contents, and workspaces of other contents.
+     * The latest workspace is kept when none matches the current content, so that the next build can reuse its objects.
+     *
+     * @param  {string} appId An app identifier
+     */
+    pruneBuildCache(appId) {
+        const escapedAppId = appId.replace(/[^a-zA-Z0-9]/g, "\\$&");
+        const version = this.getVersion(appId).toString();
+        const contentHash = this.contentHash(appId).substr(0, 12);
+        const remove = (file) => {
+            Logger.info("Removing stale IoT build cache entry " + file);
+            fs.removeSync(file);
+        };
+
+        try {
+            const folder = this.appConfiguration.cachePath + FIRMWARES_FOLDER;
+            if (fs.existsSync(folder)) {
+                const firmwarePattern = new RegExp("^" + escapedAppId + "-(\\d+)-([0-9a-f]{12})-[0-9a-f]{12}\\.bin$");
+                fs.readdirSync(folder).forEach((file) => {
+                    const match = file.match(firmwarePattern);
+                    if (match && (match[1] !== version || match[2] !== contentHash)) {
+                        remove(folder + file);
+                        delete this.firmwareArtifacts[folder + file];
+                    }
+                });
+            }
+
+            const basePattern = new RegExp("^iot-base-" + escapedAppId + "-([0-9a-f]{12})\\.bin$");
+            const files = fs.readdirSync(this.appConfiguration.cachePath);
+            files.forEach((file) => {
+                const match = file.match(basePattern);
+                if (match && match[1] !== contentHash) {
+                    remove(this.appConfiguration.cachePath + file);
+                }
+            });
+
+            // A running build may still use its workspace
+            const workspaces = this.workspaces(appId, files);
+            if (workspaces.length > 0 && !this.buildJobs.some((job) => job.appId === appId && job.status === BUILD_STATUS_RUNNING)) {
+                const kept = (workspaces.indexOf(this.workspacePath(appId, contentHash)) !== -1) ? this.workspacePath(appId, contentHash) : workspaces[0];
+                workspaces.filter((workspace) => workspace !== kept).forEach(remove);
+            }
+        } catch(e) {
+            Logger.warn("Could not prune IoT build cache of app " + appId + " : " + e.message);
+        }
+    }
+
+    /**
+     * Queue the builds of all IoTs of an app whose firmware is not in the artifact store yet, and prune the stale build cache entries
+     *
+     * @param  {string} appId An app identifier
+     */
+    prebuildFirmwares(appId) {
+        const iots = this.getIots(appId);
+        if (iots.length === 0) {
+            return;
+        }
+
+        this.pruneBuildCache(appId);
+        try {
+            iots.forEach((iot) => {
+                if (!this.getFirmware(iot.id)) {
+                    Logger.info("Prebuilding firmware of IoT " + iot.id + " for app " + appId);
+                    this.build(iot.id, appId, false, iot);
+                }
+            });
+        } catch(e) {
+            Logger.err("Could not prebuild firmwares of IoT app " + appId + " : " + e.message);
+        }
+    }
+
     /**
      * Build a firmware for a specific appId
+     * Builds are queued and run by a pool of workers. A build identical to a queued or running one is not queued again, its callback is called with the results of the first one.
      *
      * @param  {string}   id         The iot identifier
      * @param  {string}   appId         An app identifier
      * @param  {boolean}  [flash=false] `true` if USB flash sequence should be done after build, `false` otherwise
      * @param  {object}   [config=null] A configuration injected to firmware
-     * @param  {Function} cb            A callback `(error, result) => {}` called when firmware / flash is done. The result object contains 2 properties, `firmwarePath` for the firmware, `stdout` for the results
+     * @param  {Function} cb            A callback `(error, result) => {}` called when firmware / flash is done. The result object contains 4 properties, `firmwarePath` for the firmware, `md5` for its hash, `stdout` for the results and `cache` for the build cache usage (`hit`, `toolchainUpdate`, `duration` in ms)
+     * @returns {object}                The build job status
      */
     build(id, appId, flash = false, config = null, cb) {
-        if (!this.isBuildingApp) {
-            this.isBuildingApp = true;
+        const key = JSON.stringify([id.toString(), appId, flash, config]);
+        let job = this.buildJobs.find((pendingJob) => pendingJob.key === key);
+        if (job) {
+            Logger.info("IoT build " + job.id + " already " + job.status + ", not queued again");
+        } else {
+            job = {id:++this.buildJobCounter, key:key, iotId:id, appId:appId, flash:flash, config:config, status:BUILD_STATUS_QUEUED, step:BUILD_STEP_QUEUED, progress:BUILD_PROGRESS[BUILD_STEP_QUEUED], queued:DateUtils.class.timestamp(), callbacks:[]};
+            this.buildJobs.push(job);
+            this.lastBuildJobs[id] = job;
+        }
 
-            const tmpDir = this.appConfiguration.cachePath + "iot-flash-" + DateUtils.class.timestamp() + "-" + appId + "/";
-            fs.ensureDirSync(tmpDir);
+        if (cb) {
+            job.callbacks.push(cb);
+        }
 
-            // Copy dependencies
-            this.iotApps[appId].dependencies.forEach((dependencyId) => {
-                const dependency = this.iotLibs[dependencyId];
-                this.copySync(dependency.lib, tmpDir + LIB_FOLDER);
-                this.copySync(dependency.globalLib, tmpDir + GLOBAL_LIB_FOLDER);
-            });
-            // Copy sources
-            this.copySync(this.iotApps[appId].src, tmpDir + SRC_FOLDER);
-            this.copySync(this.iotApps[appId].lib, tmpDir + LIB_FOLDER);
-            this.copySync(this.iotApps[appId].globalLib, tmpDir + GLOBAL_LIB_FOLDER);
-
-            // Configuration injection
-            const baseConfiguration = {
-                apiUrl:this.environmentManager.getLocalAPIUrl(),
-                version:this.getVersion(appId),
-                options:this.iotApps[appId].options
+        this.scheduleBuilds();
+
+        return this.buildJobStatus(job);
+    }
+
+    /**
+     * Start queued builds while workers are available.
+     * Builds of a same app share a workspace, so they never run at the same time.
+     * Toolchain packages are shared by all apps, so a build that has to update them runs alone until its stamp is written.
+     */
+    scheduleBuilds() {
+        this.buildJobs.filter((job) => job.status === BUILD_STATUS_QUEUED).forEach((job) => {
+            // Builds may complete synchronously, so state is read again for each job
+            const running = this.buildJobs.filter((runningJob) => runningJob.status === BUILD_STATUS_RUNNING);
+            if (job.status !== BUILD_STATUS_QUEUED || running.length >= this.buildWorkers || running.find((runningJob) => runningJob.appId === job.appId || runningJob.toolchainUpdate)) {
+                return;
+            }
+
+            const toolchainUpdate = !fs.existsSync(this.toolchainStampPath(job.appId));
+            if (toolchainUpdate && running.length > 0) {
+                return;
+            }
+
+            job.toolchainUpdate = toolchainUpdate;
+            job.status = BUILD_STATUS_RUNNING;
+            job.started = DateUtils.class.timestamp();
+            const complete = (error, details) => {
+                job.status = error ? BUILD_STATUS_FAILED : BUILD_STATUS_DONE;
+                job.error = error ? error.message : null;
+                job.finished = DateUtils.class.timestamp();
+                this.setBuildStep(job, BUILD_STEP_DONE);
+                this.buildJobs.splice(this.buildJobs.indexOf(job), 1);
+                job.callbacks.forEach((callback) => {
+                    try {
+                        callback(error, details);
+                    } catch(e) {
+                        Logger.err(e.message);
+                    }
+                });
+                job.callbacks = [];
+                this.scheduleBuilds();
             };
 
-            if (!config) {
-                config = {};
+            try {
+                this.runBuild(job, job.iotId, job.appId, job.flash, job.config, complete);
+            } catch(e) {
+                complete(e);
             }
+        });
+    }
 
-            // eslint-disable-next-line
-            const jsonConfiguration = JSON.stringify(Object.assign(baseConfiguration, config)).replace(/\"/g, '\\"');
+    /**
+     * Update the current step of a build job
+     *
+     * @param  {object} job  The build job
+     * @param  {string} step The step
+     */
+    setBuildStep(job, step) {
+        job.step = step;
+        job.progress = BUILD_PROGRESS[step];
+    }
+
+    /**
+     * Get the public status of a build job
+     *
+     * @param  {object} job The build job
+     * @returns {object}     The status
+     */
+    buildJobStatus(job) {
+        const queued = this.buildJobs.filter((pendingJob) => pendingJob.status === BUILD_STATUS_QUEUED);
+        return {
+            id:job.id,
+            iotId:job.iotId,
+            appId:job.appId,
+            flash:job.flash,
+            status:job.status,
+            step:job.step,
+            progress:job.progress,
+            position:(job.status === BUILD_STATUS_QUEUED) ? queued.indexOf(job) + 1 : 0,
+            queued:job.queued,
+            started:job.started ? job.started : null,
+            finished:job.finished ? job.finished : null,
+            error:job.error ? job.error : null
+        };
+    }
+
+    /**
+     * Get the status of the last build job of an IoT
+     *
+     * @param  {string} id The iot identifier
+     * @returns {object}    The status, `null` if the IoT has never been built
+     */
+    getBuildJob(id) {
+        return this.lastBuildJobs[id] ? this.buildJobStatus(this.lastBuildJobs[id]) : null;
+    }
+
+    /**
+     * Run a build job
+     * The app is compiled once per content hash into a base firmware, then each IoT firmware is the base one with its configuration patched in.
+     *
+     * @param  {object}   job        The build job
+     * @param  {string}   id         The iot identifier
+     * @param  {string}   appId         An app identifier
+     * @param  {boolean}  flash `true` if USB flash sequence should be done after build, `false` otherwise
+     * @param  {object}   config A configuration injected to firmware
+     * @param  {Function} cb            A callback `(error, result) => {}` called when firmware / flash is done
+     */
+    runBuild(job, id, appId, flash, config, cb) {
+        const app = this.iotApps[appId];
+        const contentHash = this.contentHash(appId).substr(0, 12);
+        // Sources are copied over the previous build of the same content
+        const tmpDir = this.workspacePath(appId, contentHash) + "/";
+        const buildPath = tmpDir + ".pio/build/" + app.board + "/firmware.bin";
+        const baseFirmwarePath = this.appConfiguration.cachePath + "iot-base-" + appId + "-" + contentHash + ".bin";
+        const settings = this.firmwareSettings(id, appId, config);
+        const firmwarePath = this.firmwareArtifactPath(appId, settings.jsonConfiguration);
 
+        const startTime = Date.now();
+        const cache = {hit:false, toolchainUpdate:false};
+        const done = (error, details) => {
+            cache.duration = Date.now() - startTime;
+            if (details) {
+                details.cache = cache;
+            }
+            cb(error, details);
+        };
+
+        const configure = (stdout) => {
+            this.setBuildStep(job, BUILD_STEP_CONFIGURING);
+            let md5;
             try {
-                const mainFilePath = tmpDir + SRC_FOLDER + "/" + MAIN_FILE;
-                let mainContent = fs.readFileSync(mainFilePath, {encoding:"utf-8"});
-                if (mainContent) {
-                    mainContent = mainContent.replace(CONFIGURATION_PLACEHOLDER, jsonConfiguration);
-                    fs.writeFileSync(mainFilePath, mainContent);
+                const artifact = this.firmwareArtifact(firmwarePath);
+                if (artifact) {
+                    md5 = artifact.md5;
+                } else {
+                    const image = this.patchFirmware(fs.readFileSync(baseFirmwarePath), settings.device, settings.jsonConfiguration);
+                    fs.ensureDirSync(this.appConfiguration.cachePath + FIRMWARES_FOLDER);
+                    fs.writeFileSync(firmwarePath, image);
+                    md5 = crypto.createHash("md5").update(image).digest("hex");
+                    this.firmwareArtifacts[firmwarePath] = {path:firmwarePath, md5:md5, size:image.length};
                 }
+                app.firmwareBuildPath[id] = firmwarePath;
             } catch(e) {
-                Logger.err(e.message);
+                done(e);
+                return;
             }
 
-            this.writeDescriptor(tmpDir, appId);
-            const self = this;
-
-            this.installationManager.executeCommand("cd " + tmpDir + "; platformio update; platformio run -e " + this.iotApps[appId].board + (flash?" -t upload":""), false, (error, stdout, stderr) => {
-                const firmwarePath = tmpDir + ".pio/build/" + this.iotApps[appId].board + "/firmware.bin";
-                if (fs.existsSync(firmwarePath)) {
-                    this.iotApps[appId].firmwareBuildPath[id] = firmwarePath;
+            if (flash) {
+                // Upload the configured image as is
+                this.setBuildStep(job, BUILD_STEP_UPLOADING);
+                // The workspace may have been pruned or moved since the firmware was built, upload only needs the descriptor
+                if (!fs.existsSync(tmpDir + "platformio.ini")) {
+                    fs.ensureDirSync(tmpDir);
+                    this.writeDescriptor(tmpDir, appId);
                 }
-                if (error) {
-                    self.isBuildingApp = false;
-                    if (fs.existsSync(firmwarePath)) {
-                        cb(error, {firmwarePath:firmwarePath});
-                    } else {
-                        cb(error);
-                    }
+                fs.copySync(firmwarePath, buildPath);
+                this.installationManager.executeCommand("cd " + tmpDir + "; platformio run -e " + app.board + " -t nobuild -t upload", false, (error, uploadStdout, stderr) => {
+                    done(error, {firmwarePath:firmwarePath, md5:md5, stdout:stdout + uploadStdout + (error ? stderr : "")});
+                });
+            } else {
+                done(null, {firmwarePath:firmwarePath, md5:md5, stdout:stdout});
+            }
+        };
 
-                } else {
-                    if (fs.existsSync(firmwarePath)) {
-                        self.isBuildingApp = false;
-                        cb(null, {firmwarePath:firmwarePath, stdout:stdout});
-                    } else {
-                        self.isBuildingApp = false;
-                        cb(Error("No build found - " + stderr + stdout));
-                    }
+        if (this.firmwareArtifact(firmwarePath) || fs.existsSync(baseFirmwarePath)) {
+            this.buildCacheStatistics.hits++;
+            cache.hit = true;
+            configure("");
+            return;
+        }
+
+        this.buildCacheStatistics.misses++;
+        this.setBuildStep(job, BUILD_STEP_COMPILING);
+        this.reuseWorkspace(appId, tmpDir);
+        fs.ensureDirSync(tmpDir);
+        // Sources are replaced, objects in .pio are kept and only rebuilt when their sources changed
+        [SRC_FOLDER, LIB_FOLDER, GLOBAL_LIB_FOLDER].forEach((folder) => {
+            fs.removeSync(tmpDir + folder);
+        });
+
+        // Copy dependencies
+        app.dependencies.forEach((dependencyId) => {
+            const dependency = this.iotLibs[dependencyId];
+            this.copySync(dependency.lib, tmpDir + LIB_FOLDER);
+            this.copySync(dependency.globalLib, tmpDir + GLOBAL_LIB_FOLDER);
+        });
+        // Copy sources
+        this.copySync(app.src, tmpDir + SRC_FOLDER);
+        this.copySync(app.lib, tmpDir + LIB_FOLDER);
+        this.copySync(app.globalLib, tmpDir + GLOBAL_LIB_FOLDER);
+
+        this.writeDescriptor(tmpDir, appId);
+        this.writeConfigurationHeader(tmpDir, appId);
+        // Never pick up the firmware of a previous build if this one fails
+        fs.removeSync(buildPath);
+
+        // Packages are only checked when the toolchain changed
+        const toolchainStamp = this.toolchainStampPath(appId);
+        cache.toolchainUpdate = !fs.existsSync(toolchainStamp);
+        if (cache.toolchainUpdate) {
+            this.buildCacheStatistics.toolchainUpdates++;
+        }
+
+        this.installationManager.executeCommand("cd " + tmpDir + "; " + (cache.toolchainUpdate ? "platformio update; " : "") + "platformio run -e " + app.board, false, (error, stdout, stderr) => {
+            if (error) {
+                done(error);
+            } else if (!fs.existsSync(buildPath)) {
+                done(Error("No build found - " + stderr + stdout));
+            } else {
+                if (cache.toolchainUpdate) {
+                    fs.writeFileSync(toolchainStamp, DateUtils.class.timestamp().toString());
                 }
-            });
-        } else {
-            cb(Error("Build already running"));
+                fs.copySync(buildPath, baseFirmwarePath);
+                configure(stdout);
+            }
+        });
+    }
+
+    /**
+     * Get the build workspace of an app for a content hash
+     *
+     * @param  {string} appId       An app identifier
+     * @param  {string} contentHash The shortened content hash
+     * @returns {string}             The workspace path, without trailing slash
+     */
+    workspacePath(appId, contentHash) {
+        return this.appConfiguration.cachePath + "iot-build-" + appId + "-" + contentHash;
+    }
+
+    /**
+     * Get the build workspaces of an app, latest first
+     *
+     * @param  {string} appId  An app identifier
+     * @param  {Array} [files=null] The cache folder entries, read if not set
+     * @returns {Array}         The workspace paths
+     */
+    workspaces(appId, files = null) {
+        const pattern = new RegExp("^iot-build-" + appId.replace(/[^a-zA-Z0-9]/g, "\\$&") + "-[0-9a-f]{12}$");
+        return (files ? files : fs.readdirSync(this.appConfiguration.cachePath))
+            .filter((file) => pattern.test(file))
+            .map((file) => this.appConfiguration.cachePath + file)
+            .sort((a, b) => fs.statSync(b).mtimeMs - fs.statSync(a).mtimeMs);
+    }
+
+    /**
+     * Move the latest workspace of an app to a new one, so that its compiled objects can be reused
+     *
+     * @param  {string} appId  An app identifier
+     * @param  {string} tmpDir The new workspace
+     */
+    reuseWorkspace(appId, tmpDir) {
+        if (fs.existsSync(tmpDir)) {
+            return;
+        }
+
+        try {
+            const previous = this.workspaces(appId);
+            if (previous.length > 0) {
+                Logger.info("Reusing IoT build workspace " + previous[0]);
+                fs.moveSync(previous[0], tmpDir);
+            }
+        } catch(e) {
+            Logger.warn("Could not reuse IoT build workspace : " + e.message);
         }
     }
 
     /**
-     * Write platformio ini file descriptor
+     * Get the toolchain part of the platformio descriptor : platform, board, framework and packages
      *
-     * @param  {string} folder The folder where file should be written
      * @param  {string} appId  An app identifier
+     * @returns {string}       The platformio environment section
      */
-    writeDescriptor(folder, appId) {
+    toolchainDescriptor(appId) {
         let iniContent = "";
         iniContent += "[env:" + this.iotApps[appId].board + "]\n";
         iniContent += "platform = " + this.iotApps[appId].platform + "\n";
@@ -370,6 +931,28 @@ class IotManager {
         iniContent += "platform_packages =\n";
         iniContent += "        framework-arduinoespressif8266 @ https://github.com/esp8266/Arduino.git#2843a5a\n";
         iniContent += "        toolchain-xtensa @ ~2.100100.200706\n";
+
+        return iniContent;
+    }
+
+    /**
+     * Get the stamp file written once `platformio update` succeeded for a toolchain
+     *
+     * @param  {string} appId  An app identifier
+     * @returns {string}       The stamp file path
+     */
+    toolchainStampPath(appId) {
+        return this.appConfiguration.cachePath + "iot-toolchain-" + crypto.createHash("md5").update(this.toolchainDescriptor(appId)).digest("hex").substr(0, 12) + ".stamp";
+    }
+
+    /**
+     * Write platformio ini file descriptor
+     *
+     * @param  {string} folder The folder where file should be written
+     * @param  {string} appId  An app identifier
+     */
+    writeDescriptor(folder, appId) {
+        let iniContent = this.toolchainDescriptor(appId);
         iniContent += "\n";
         iniContent += "[platformio]\n";
         iniContent += "lib_dir = ./" + GLOBAL_LIB_FOLDER + "\n";
@@ -522,6 +1105,7 @@ class IotManager {
 
                             self.iots = self.confManager.setData(CONF_MANAGER_KEY, apiRequest.data, self.iots, self.comparator);
                             self.registerIotsListForm();
+                            self.prebuildFirmwares(apiRequest.data.iotApp);
 
                             resolve(new APIResponse.class(true, {success:true, id:apiRequest.data.id, iot: "toto"}));
                         } else {
@@ -552,15 +1136,15 @@ class IotManager {
                 if (iot) {
                     if (self.getIotApp(iot.iotApp)) {
                         this.iotApps[iot.iotApp].builds[apiRequest.data.id] = null;
-                        this.build(apiRequest.data.id, iot.iotApp, true, iot, (error, details) => {
+                        const job = this.build(apiRequest.data.id, iot.iotApp, true, iot, (error, details) => {
                             this.iotApps[iot.iotApp].builds[apiRequest.data.id] = details;
                             if (!error) {
-                                this.iotApps[iot.iotApp].builds[apiRequest.data.id] = {success:true, details:details.stdout, firmwareBuilt:((details && details.firmwarePath) ? true : false)};
+                                this.iotApps[iot.iotApp].builds[apiRequest.data.id] = {success:true, details:details.stdout, firmwareBuilt:((details && details.firmwarePath) ? true : false), cache:details.cache};
                             } else {
-                                this.iotApps[iot.iotApp].builds[apiRequest.data.id] = {success:false, error:error.message, firmwareBuilt:((details && details.firmwarePath) ? true : false)};
+                                this.iotApps[iot.iotApp].builds[apiRequest.data.id] = {success:false, error:error.message, firmwareBuilt:((details && details.firmwarePath) ? true : false), cache:(details ? details.cache : null)};
                             }
                         });
-                        resolve(new APIResponse.class(true, {success:true}));
+                        resolve(new APIResponse.class(true, {success:true, job:job}));
                     } else {
                         reject(new APIResponse.class(false, {}, 8128, "Unexisting iot app found"));
                     }
@@ -571,10 +1155,10 @@ class IotManager {
         } else if (apiRequest.route.startsWith(IOT_MANAGER_FLASH_STATUS_BASE)) {
             return new Promise((resolve, reject) => {
                 const iot = this.getIot(apiRequest.data.id);
-                if (iot && iot.iotApp && this.iotApps[iot.iotApp].builds[apiRequest.data.id]) {
-                    resolve(new APIResponse.class(true, Object.assign(this.iotApps[iot.iotApp].builds[apiRequest.data.id], {upgradeUrl:this.iotApps[iot.iotApp].upgradeUrls[apiRequest.data.id]})));
-                } else if (this.isBuilding) {
-                    resolve(new APIResponse.class(true, {building:true}));
+                if (iot && this.isBuilding(apiRequest.data.id)) {
+                    resolve(new APIResponse.class(true, {building:true, job:this.getBuildJob(apiRequest.data.id), queueLength:this.buildJobs.length, workers:this.buildWorkers, cacheStatistics:this.buildCacheStatistics}));
+                } else if (iot && iot.iotApp && this.iotApps[iot.iotApp].builds[apiRequest.data.id]) {
+                    resolve(new APIResponse.class(true, Object.assign(this.iotApps[iot.iotApp].builds[apiRequest.data.id], {upgradeUrl:this.iotApps[iot.iotApp].upgradeUrls[apiRequest.data.id], job:this.getBuildJob(apiRequest.data.id), cacheStatistics:this.buildCacheStatistics})));
                 } else {
                     reject(new APIResponse.class(false, {}, 8127, "No build"));
                 }
@@ -584,7 +1168,8 @@ class IotManager {
                 const iot = self.getIot(apiRequest.data.id);
                 if (iot) {
                     if (this.iotApps[iot.iotApp].firmwareBuildPath[apiRequest.data.id]) {
-                        const md5Hash = md5File.sync(this.iotApps[iot.iotApp].firmwareBuildPath[apiRequest.data.id]);
+                        const artifact = this.firmwareArtifact(this.iotApps[iot.iotApp].firmwareBuildPath[apiRequest.data.id]);
+                        const md5Hash = artifact ? artifact.md5 : md5File.sync(this.iotApps[iot.iotApp].firmwareBuildPath[apiRequest.data.id]);
                         apiRequest.res.setHeader("Content-type", "application/octet-stream");
                         apiRequest.res.setHeader("Content-disposition", "attachment; filename=firmware-" + apiRequest.data.id + "-md5-" + md5Hash + ".bin");
                         const filestream = fs.createReadStream(this.iotApps[iot.iotApp].firmwareBuildPath[apiRequest.data.id]);
@@ -613,10 +1198,11 @@ class IotManager {
     /**
      * Get the global build status
      *
-     * @returns {boolean} Returns `true` if a build is already running, `false` otherwise
+     * @param  {string} [id=null] An iot identifier, to get the status of its builds only
+     * @returns {boolean} Returns `true` if a build is queued or running, `false` otherwise
      */
-    isBuilding() {
-        return this.isBuildingApp;
+    isBuilding(id = null) {
+        return this.buildJobs.filter((job) => (id === null || job.iotId.toString() === id.toString())).length > 0;
     }
 
     /**
@@ -65,6 +65,7 @@ const INTERNAL_PLUGINS = [
     "openweather-pressure-sensor",
     "openweather-wind-sensor",
     "esp8266",
+    "esp8266-sensors",
     "esp8266-dht22",
     "trash-reminder",
     "sms",
@@ -99,10 +99,21 @@ class IotAPI {
      * @param  {string}   appId         An app identifier
      * @param  {Boolean}  [flash=false] `true` if USB flash sequence should be done after build, `false` otherwise
      * @param  {Object}   [config=null] A configuration injected to firmware
-     * @param  {Function} cb            A callback `(error, result) => {}` called when firmware / flash is done. The result object contains 2 properties, `firmwarePath` for the firmware, `stdout` for the results
+     * @param  {Function} cb            A callback `(error, result) => {}` called when firmware / flash is done. The result object contains 4 properties, `firmwarePath` for the firmware, `md5` for its hash, `stdout` for the results and `cache` for the build cache usage
+     * @returns {Object}                The build job status. Builds are queued, an identical build already queued or running is not built twice.
      */
     build(id, appId, flash = false, config = null, cb) {
-        PrivateProperties.oprivate(this).iotManager.build(id, appId, flash, config, cb);
+        return PrivateProperties.oprivate(this).iotManager.build(id, appId, flash, config, cb);
+    }
+
+    /**
+     * Get the firmware built for the current configuration of an IoT, from the firmware artifact store
+     *
+     * @param  {number} id An IoT identifier
+     * @returns {Object}    An object with `path`, `md5` and `size` properties, `null` if the firmware is not built yet
+     */
+    getFirmware(id) {
+        return PrivateProperties.oprivate(this).iotManager.getFirmware(id);
     }
 
     /**
@@ -127,10 +138,11 @@ class IotAPI {
     /**
      * Get the global build status
      *
-     * @returns {Boolean} Returns `true` if a build is already running, `false` otherwise
+     * @param  {number} [id=null] An IoT identifier, to get the status of its builds only
+     * @returns {Boolean} Returns `true` if a build is queued or running, `false` otherwise
      */
-    isBuilding() {
-        return PrivateProperties.oprivate(this).iotManager.isBuilding();
+    isBuilding(id = null) {
+        return PrivateProperties.oprivate(this).iotManager.isBuilding(id);
     }
 
     /**
@@ -0,0 +1,133 @@
+/* eslint-env node, mocha */
+var chai = require("chai");
+var expect = chai.expect;
+var sinon = require("sinon");
+var GlobalMocks = require("./../../GlobalMocks");
+
+const SmartiesCore = require("../../../src/SmartiesCore").class;
+const core = new SmartiesCore();
+const plugin = core.pluginsManager.getPluginByIdentifier("esp8266", false);
+const EspIngestionService = require("../../../src/internal-plugins/esp8266/service.js")(plugin);
+
+const HOUR = 3600;
+
+/**
+ * Fake sensor
+ *
+ * @class
+ */
+class FakeSensor {
+    constructor(id, iotId, type, aggregationMode) {
+        this.id = id;
+        this.iotId = iotId;
+        this.type = type;
+        this.aggregationMode = aggregationMode;
+        this.values = [];
+    }
+
+    static constants() {
+        return {AGGREGATION_MODE_AVG:0, AGGREGATION_MODE_SUM:1, AGGREGATION_MODE_MIN:2, AGGREGATION_MODE_MAX:3, AGGREGATION_MODE_LAST:4, AGGREGATION_MODE_COUNT:5};
+    }
+
+    getIotIdentifier() {
+        return this.iotId;
+    }
+
+    setValue(value, vcc, cb, timestamp) {
+        this.values.push({value:value, vcc:vcc, timestamp:timestamp});
+        if (cb) {
+            cb(null);
+        }
+    }
+}
+
+describe("EspIngestionService", function() {
+    let sensors = {};
+
+    beforeEach(() => {
+        sensors = {};
+        sinon.stub(plugin.sensorAPI, "getSensors").callsFake(() => sensors);
+        sinon.stub(plugin.sensorAPI, "getSensor").callsFake((id) => sensors[id]);
+    });
+
+    afterEach(() => {
+        plugin.sensorAPI.getSensors.restore();
+        plugin.sensorAPI.getSensor.restore();
+    });
+
+    after(() => {
+        core.stop();
+    });
+
+    it("push should buffer values by sensor and hour", function() {
+        sensors[1] = new FakeSensor(1, 7, "TEMPERATURE", FakeSensor.constants().AGGREGATION_MODE_AVG);
+        sensors[2] = new FakeSensor(2, 7, "TEMPERATURE", FakeSensor.constants().AGGREGATION_MODE_MAX);
+        sensors[3] = new FakeSensor(3, 8, "TEMPERATURE", FakeSensor.constants().AGGREGATION_MODE_AVG);
+        const service = new EspIngestionService();
+        expect(service.push(7, "TEMPERATURE", 20, 3, 10 * HOUR + 10)).to.be.equal(2);
+        expect(service.push(7, "TEMPERATURE", 21, 3, 10 * HOUR + 20)).to.be.equal(2);
+        expect(service.push(7, "TEMPERATURE", 15, 3, 9 * HOUR + 10)).to.be.equal(2);
+        expect(service.push(9, "TEMPERATURE", 15, 3, 9 * HOUR + 10)).to.be.equal(0);
+        expect(Object.keys(service.buckets).sort()).to.be.deep.equal(["1/32400", "1/36000", "2/32400", "2/36000"]);
+        expect(service.buckets["1/36000"].values).to.be.deep.equal([20, 21]);
+        expect(service.buckets["1/36000"].timestamp).to.be.equal(10 * HOUR + 20);
+        expect(service.statistics.values).to.be.equal(3);
+    });
+
+    it("combine should aggregate values as the sensor does, avg keeping the last one", function() {
+        const service = new EspIngestionService();
+        const values = [3, 1, 4, 2];
+        expect(service.combine(new FakeSensor(1, 7, "FOO", FakeSensor.constants().AGGREGATION_MODE_SUM), values)).to.be.deep.equal([10]);
+        expect(service.combine(new FakeSensor(1, 7, "FOO", FakeSensor.constants().AGGREGATION_MODE_MIN), values)).to.be.deep.equal([1]);
+        expect(service.combine(new FakeSensor(1, 7, "FOO", FakeSensor.constants().AGGREGATION_MODE_MAX), values)).to.be.deep.equal([4]);
+        expect(service.combine(new FakeSensor(1, 7, "FOO", FakeSensor.constants().AGGREGATION_MODE_COUNT), values)).to.be.deep.equal([3, 1, 4, 2]);
+        expect(service.combine(new FakeSensor(1, 7, "FOO", FakeSensor.constants().AGGREGATION_MODE_AVG), values)).to.be.deep.equal([2]);
+    });
+
+    it("index should be rebuilt when sensors are reloaded", function() {
+        sensors[1] = new FakeSensor(1, 7, "TEMPERATURE", FakeSensor.constants().AGGREGATION_MODE_AVG);
+        const service = new EspIngestionService();
+        expect(service.getSensorIds(7, "TEMPERATURE")).to.be.deep.equal([1]);
+        sensors = {2:new FakeSensor(2, 7, "TEMPERATURE", FakeSensor.constants().AGGREGATION_MODE_AVG)};
+        expect(service.getSensorIds(7, "TEMPERATURE")).to.be.deep.equal([1]);
+        core.eventBus.emit(plugin.sensorAPI.constants().EVENT_SENSORS_READY);
+        expect(service.index).to.be.null;
+        expect(service.getSensorIds(7, "TEMPERATURE")).to.be.deep.equal([2]);
+        expect(plugin.sensorAPI.getSensors.calledTwice).to.be.true;
+    });
+
+    it("flush should write each bucket once and count values one after the other", function() {
+        sensors[1] = new FakeSensor(1, 7, "TEMPERATURE", FakeSensor.constants().AGGREGATION_MODE_AVG);
+        sensors[2] = new FakeSensor(2, 7, "DOOR", FakeSensor.constants().AGGREGATION_MODE_COUNT);
+        const service = new EspIngestionService();
+        service.push(7, "TEMPERATURE", 20, 3, 10 * HOUR + 10);
+        service.push(7, "TEMPERATURE", 22, 2.9, 10 * HOUR + 20);
+        service.push(7, "DOOR", 1, null, 10 * HOUR + 10);
+        service.push(7, "DOOR", 1, null, 10 * HOUR + 20);
+        service.push(7, "DOOR", 1, null, 10 * HOUR + 30);
+        service.flush();
+        expect(sensors[1].values).to.be.deep.equal([{value:22, vcc:2.9, timestamp:10 * HOUR + 20}]);
+        expect(sensors[2].values.length).to.be.equal(3);
+        expect(service.buckets).to.be.empty;
+        expect(service.statistics).to.be.deep.equal({values:5, writes:4, flushes:1});
+        service.flush();
+        expect(service.statistics.flushes).to.be.equal(1);
+    });
+
+    it("flush should wait for the sensor callback before the next count value", function() {
+        sensors[1] = new FakeSensor(1, 7, "DOOR", FakeSensor.constants().AGGREGATION_MODE_COUNT);
+        const callbacks = [];
+        sinon.stub(sensors[1], "setValue").callsFake((value, vcc, cb) => {
+            callbacks.push(cb);
+        });
+        const service = new EspIngestionService();
+        service.push(7, "DOOR", 1, null, 10 * HOUR + 10);
+        service.push(7, "DOOR", 1, null, 10 * HOUR + 20);
+        service.flush();
+        expect(sensors[1].setValue.calledOnce).to.be.true;
+        callbacks[0](null);
+        expect(sensors[1].setValue.calledTwice).to.be.true;
+        callbacks[1](null);
+        expect(service.statistics.writes).to.be.equal(2);
+    });
+});
@@ -198,29 +198,56 @@ describe("IotManager", function() {
         formManager.addAdditionalFields.restore();
     });
 
+    /**
+     * Fake firmware image with an empty configuration region between two code areas
+     *
+     * @returns {Buffer} The image
+     */
+    function fakeFirmware() {
+        const region = Buffer.alloc(152 + 2048);
+        region.write("SMARTIES-CONFIG!");
+        return Buffer.concat([Buffer.alloc(100, 0xA5), region, Buffer.alloc(50, 0x5A)]);
+    }
+
+    /**
+     * Read back the configuration of a patched image
+     *
+     * @param  {Buffer} image The image
+     * @returns {object}       The configuration
+     */
+    function firmwareConfiguration(image) {
+        const offset = image.indexOf("SMARTIES-CONFIG!");
+        const length = image.readUInt32LE(offset + 16);
+        return JSON.parse(image.slice(offset + 152, offset + 152 + length).toString("utf8"));
+    }
+
     it("build app should execute all steps", function(done) {
         const iotManager = new IotManager.class(appConfiguration, webServices, installationManager, formManager, environmentManager, confManager, translateManager, messageManager);
         const fs = require("fs-extra");
+        let patched = null;
         sinon.stub(fs, "existsSync").callsFake((path) => {
-            return true;
+            return (path !== "/foobar/iot-base-fooapp-0123456789ab.bin" && path.indexOf("iot-firmwares") === -1);
         });
         sinon.stub(fs, "ensureDirSync").callsFake((dir) => {});
         sinon.stub(fs, "copySync").callsFake((src, dest) => {});
+        sinon.stub(fs, "removeSync").callsFake((path) => {});
+        sinon.stub(iotManager, "contentHash").callsFake((appId) => {
+            return "0123456789abcdef";
+        });
         sinon.stub(fs, "readFileSync").callsFake((file) => {
-            return "foo = \"%config%\";"
+            return fakeFirmware();
         });
         sinon.stub(DateUtils.class, "timestamp").callsFake(() => {return 1234;});
         sinon.stub(fs, "writeFileSync").callsFake((file, content) => {
-            eval(content);
-            const parsed = JSON.parse(foo);
-            expect(parsed.port).to.be.not.null;
-            expect(parsed.ip).to.be.not.null;
+            patched = content;
+            const parsed = firmwareConfiguration(content);
             expect(parsed.version).to.be.not.equal(7);
             expect(parsed.options).to.be.not.null;
             expect(parsed.options.foo).to.be.equal("bar");
-            expect(parsed.options.foobar).to.be.equal("barfoo");
+            expect(parsed.foobar).to.be.equal("barfoo");
         });
         sinon.stub(iotManager, "writeDescriptor").callsFake((tmpDir, appId) => {});
+        sinon.stub(iotManager, "writeConfigurationHeader").callsFake((tmpDir, appId) => {});
         sinon.stub(installationManager, "executeCommand").callsFake((command, wait, cb) => {
             cb(null, command);
         });
@@ -228,15 +255,26 @@ describe("IotManager", function() {
         iotManager.registerLib("/tmp/foobar", "foolib", 2, {}, IotLibForm);
         iotManager.registerApp("/tmp/foobar", "fooapp", "Foo Bar", 5, "fooPlatform", "barBoard", "foobarFramework", ["foolib"], {foo:"bar"}, {}, IotAppForm);
         iotManager.build("fooiot", "fooapp", false, {foobar:"barfoo"}, (error, result) => {
-            expect(fs.ensureDirSync.calledOnce).to.be.true;
-            expect(fs.copySync.callCount).to.be.equal(5);
+            expect(error).to.be.null;
+            expect(fs.ensureDirSync.calledTwice).to.be.true;
+            expect(fs.copySync.callCount).to.be.equal(6);
+            expect(fs.copySync.lastCall.args[0]).to.be.equal("/foobar/iot-build-fooapp-0123456789ab/.pio/build/barBoard/firmware.bin");
+            expect(fs.copySync.lastCall.args[1]).to.be.equal("/foobar/iot-base-fooapp-0123456789ab.bin");
+            expect(fs.removeSync.callCount).to.be.equal(4);
             expect(fs.readFileSync.calledOnce).to.be.true;
+            expect(fs.readFileSync.firstCall.args[0]).to.be.equal("/foobar/iot-base-fooapp-0123456789ab.bin");
             expect(iotManager.writeDescriptor.calledOnce).to.be.true;
+            expect(iotManager.writeConfigurationHeader.calledOnce).to.be.true;
             expect(installationManager.executeCommand.calledOnce).to.be.true;
             expect(fs.writeFileSync.calledOnce).to.be.true;
-            expect(Object.keys(result).length).to.be.equal(2);
-            expect(result.firmwarePath).to.be.equal("/foobar/iot-flash-1234-fooapp/.pio/build/barBoard/firmware.bin");
-            expect(result.stdout).to.be.equal("cd /foobar/iot-flash-1234-fooapp/; platformio update; platformio run -e barBoard");
+            expect(fs.writeFileSync.firstCall.args[0]).to.match(/^\/foobar\/iot-firmwares\/fooapp-\d+-0123456789ab-[0-9a-f]{12}\.bin$/);
+            expect(Object.keys(result).length).to.be.equal(4);
+            expect(result.firmwarePath).to.be.equal(fs.writeFileSync.firstCall.args[0]);
+            expect(result.md5).to.be.equal(require("crypto").createHash("md5").update(patched).digest("hex"));
+            expect(result.stdout).to.be.equal("cd /foobar/iot-build-fooapp-0123456789ab/; platformio run -e barBoard");
+            expect(result.cache.hit).to.be.false;
+            expect(result.cache.toolchainUpdate).to.be.false;
+            expect(iotManager.buildCacheStatistics).to.be.deep.equal({hits:0, misses:1, toolchainUpdates:0});
             done();
         });
 
@@ -244,14 +282,400 @@ describe("IotManager", function() {
         fs.existsSync.restore();
         fs.ensureDirSync.restore();
         fs.copySync.restore();
+        fs.removeSync.restore();
         fs.readFileSync.restore();
         fs.writeFileSync.restore();
+        iotManager.contentHash.restore();
         iotManager.writeDescriptor.restore();
+        iotManager.writeConfigurationHeader.restore();
         installationManager.executeCommand.restore();
         DateUtils.class.timestamp.restore();
 
     });
 
+    it("build app should only patch an already built firmware", function(done) {
+        const iotManager = new IotManager.class(appConfiguration, webServices, installationManager, formManager, environmentManager, confManager, translateManager, messageManager);
+        const fs = require("fs-extra");
+        sinon.stub(fs, "existsSync").callsFake((path) => {
+            return (path.indexOf("iot-firmwares") === -1);
+        });
+        sinon.stub(fs, "ensureDirSync").callsFake((dir) => {});
+        sinon.stub(fs, "copySync").callsFake((src, dest) => {});
+        sinon.stub(iotManager, "contentHash").callsFake((appId) => {
+            return "0123456789abcdef";
+        });
+        sinon.stub(fs, "readFileSync").callsFake((file) => {
+            return fakeFirmware();
+        });
+        sinon.stub(fs, "writeFileSync").callsFake((file, content) => {
+            expect(firmwareConfiguration(content).foobar).to.be.equal("barfoo");
+        });
+        sinon.stub(installationManager, "executeCommand").callsFake((command, wait, cb) => {
+            cb(null, command);
+        });
+
+        iotManager.registerLib("/tmp/foobar", "foolib", 2, {}, IotLibForm);
+        iotManager.registerApp("/tmp/foobar", "fooapp", "Foo Bar", 5, "fooPlatform", "barBoard", "foobarFramework", ["foolib"], {foo:"bar"}, {}, IotAppForm);
+        iotManager.build("fooiot", "fooapp", true, {foobar:"barfoo"}, (error, result) => {
+            expect(error).to.be.null;
+            expect(fs.writeFileSync.calledOnce).to.be.true;
+            expect(fs.copySync.calledOnce).to.be.true;
+            expect(fs.copySync.firstCall.args[1]).to.be.equal("/foobar/iot-build-fooapp-0123456789ab/.pio/build/barBoard/firmware.bin");
+            expect(installationManager.executeCommand.calledOnce).to.be.true;
+            expect(result.stdout).to.be.equal("cd /foobar/iot-build-fooapp-0123456789ab/; platformio run -e barBoard -t nobuild -t upload");
+            expect(result.cache.hit).to.be.true;
+            expect(iotManager.buildCacheStatistics.hits).to.be.equal(1);
+            expect(iotManager.isBuilding()).to.be.false;
+            done();
+        });
+
+        fs.existsSync.restore();
+        fs.ensureDirSync.restore();
+        fs.copySync.restore();
+        fs.readFileSync.restore();
+        fs.writeFileSync.restore();
+        iotManager.contentHash.restore();
+        installationManager.executeCommand.restore();
+    });
+
+    it("build app should update platformio only when the toolchain changed", function(done) {
+        const iotManager = new IotManager.class(appConfiguration, webServices, installationManager, formManager, environmentManager, confManager, translateManager, messageManager);
+        const fs = require("fs-extra");
+        const stamps = [];
+        sinon.stub(fs, "existsSync").callsFake((path) => {
+            return (path !== "/foobar/iot-base-fooapp-0123456789ab.bin" && path.indexOf("iot-toolchain-") === -1 && path.indexOf("iot-firmwares") === -1);
+        });
+        sinon.stub(fs, "ensureDirSync").callsFake((dir) => {});
+        sinon.stub(fs, "copySync").callsFake((src, dest) => {});
+        sinon.stub(fs, "removeSync").callsFake((path) => {});
+        sinon.stub(iotManager, "contentHash").callsFake((appId) => {
+            return "0123456789abcdef";
+        });
+        sinon.stub(fs, "readFileSync").callsFake((file) => {
+            return fakeFirmware();
+        });
+        sinon.stub(fs, "writeFileSync").callsFake((file, content) => {
+            if (file.indexOf("iot-toolchain-") !== -1) {
+                stamps.push(file);
+            }
+        });
+        sinon.stub(iotManager, "writeDescriptor").callsFake((tmpDir, appId) => {});
+        sinon.stub(iotManager, "writeConfigurationHeader").callsFake((tmpDir, appId) => {});
+        sinon.stub(installationManager, "executeCommand").callsFake((command, wait, cb) => {
+            cb(null, command);
+        });
+
+        iotManager.registerLib("/tmp/foobar", "foolib", 2, {}, IotLibForm);
+        iotManager.registerApp("/tmp/foobar", "fooapp", "Foo Bar", 5, "fooPlatform", "barBoard", "foobarFramework", ["foolib"], {foo:"bar"}, {}, IotAppForm);
+        iotManager.build("fooiot", "fooapp", false, {foobar:"barfoo"}, (error, result) => {
+            expect(error).to.be.null;
+            expect(result.stdout).to.be.equal("cd /foobar/iot-build-fooapp-0123456789ab/; platformio update; platformio run -e barBoard");
+            expect(result.cache.toolchainUpdate).to.be.true;
+            expect(stamps).to.be.deep.equal([iotManager.toolchainStampPath("fooapp")]);
+            expect(iotManager.buildCacheStatistics.toolchainUpdates).to.be.equal(1);
+            done();
+        });
+
+        fs.existsSync.restore();
+        fs.ensureDirSync.restore();
+        fs.copySync.restore();
+        fs.removeSync.restore();
+        fs.readFileSync.restore();
+        fs.writeFileSync.restore();
+        iotManager.contentHash.restore();
+        iotManager.writeDescriptor.restore();
+        iotManager.writeConfigurationHeader.restore();
+        installationManager.executeCommand.restore();
+    });
+
+    it("build app should queue builds and deduplicate identical ones", function() {
+        const iotManager = new IotManager.class(appConfiguration, webServices, installationManager, formManager, environmentManager, confManager, translateManager, messageManager);
+        const fs = require("fs-extra");
+        const commands = [];
+        const results = [];
+        sinon.stub(fs, "existsSync").callsFake((path) => {
+            return (path.indexOf("iot-firmwares") === -1);
+        });
+        sinon.stub(fs, "ensureDirSync").callsFake((dir) => {});
+        sinon.stub(fs, "copySync").callsFake((src, dest) => {});
+        sinon.stub(fs, "readFileSync").callsFake((file) => {
+            return fakeFirmware();
+        });
+        sinon.stub(fs, "writeFileSync").callsFake((file, content) => {});
+        sinon.stub(installationManager, "executeCommand").callsFake((command, wait, cb) => {
+            commands.push(cb);
+        });
+
+        iotManager.buildWorkers = 2;
+        iotManager.registerLib("/tmp/foobar", "foolib", 2, {}, IotLibForm);
+        iotManager.registerApp("/tmp/foobar", "fooapp", "Foo Bar", 5, "fooPlatform", "barBoard", "foobarFramework", ["foolib"], {foo:"bar"}, {}, IotAppForm);
+        iotManager.registerApp("/tmp/foobar", "barapp", "Bar Foo", 5, "fooPlatform", "barBoard", "foobarFramework", ["foolib"], {foo:"bar"}, {}, IotAppForm);
+        const first = iotManager.build("1", "fooapp", true, {id:1}, (error, result) => results.push("1a"));
+        const duplicate = iotManager.build("1", "fooapp", true, {id:1}, (error, result) => results.push("1b"));
+        const sameApp = iotManager.build("2", "fooapp", true, {id:2}, (error, result) => results.push("2"));
+        const otherApp = iotManager.build("3", "barapp", true, {id:3}, (error, result) => results.push("3"));
+
+        expect(duplicate.id).to.be.equal(first.id);
+        expect(iotManager.buildJobs.length).to.be.equal(3);
+        // One build per app at a time, within the worker count
+        expect(commands.length).to.be.equal(2);
+        expect(iotManager.getBuildJob("1").status).to.be.equal("running");
+        expect(iotManager.getBuildJob("1").step).to.be.equal("uploading");
+        expect(iotManager.getBuildJob("2").status).to.be.equal("queued");
+        expect(iotManager.getBuildJob("2").position).to.be.equal(1);
+        expect(iotManager.getBuildJob("3").status).to.be.equal("running");
+        expect(iotManager.isBuilding("2")).to.be.true;
+
+        commands.shift()(null, "");
+        expect(results).to.be.deep.equal(["1a", "1b"]);
+        expect(iotManager.getBuildJob("1").status).to.be.equal("done");
+        expect(iotManager.getBuildJob("1").progress).to.be.equal(100);
+        expect(iotManager.getBuildJob("2").status).to.be.equal("running");
+        expect(iotManager.isBuilding("1")).to.be.false;
+
+        commands.shift()(Error("Upload failed"), "", "");
+        commands.shift()(null, "");
+        expect(results).to.be.deep.equal(["1a", "1b", "3", "2"]);
+        expect(iotManager.getBuildJob("3").status).to.be.equal("failed");
+        expect(iotManager.getBuildJob("3").error).to.be.equal("Upload failed");
+        expect(iotManager.isBuilding()).to.be.false;
+        expect(sameApp.id).to.be.not.equal(otherApp.id);
+
+        fs.existsSync.restore();
+        fs.ensureDirSync.restore();
+        fs.copySync.restore();
+        fs.readFileSync.restore();
+        fs.writeFileSync.restore();
+        installationManager.executeCommand.restore();
+    });
+
+    it("build app should run toolchain updates alone", function() {
+        const iotManager = new IotManager.class(appConfiguration, webServices, installationManager, formManager, environmentManager, confManager, translateManager, messageManager);
+        const fs = require("fs-extra");
+        const commands = [];
+        let stamped = false;
+        sinon.stub(fs, "existsSync").callsFake((path) => {
+            if (path.indexOf("iot-toolchain-") !== -1) {
+                return stamped;
+            }
+            return (path.indexOf("iot-base-") === -1 && path.indexOf("iot-firmwares") === -1);
+        });
+        sinon.stub(fs, "ensureDirSync").callsFake((dir) => {});
+        sinon.stub(fs, "copySync").callsFake((src, dest) => {});
+        sinon.stub(fs, "removeSync").callsFake((path) => {});
+        sinon.stub(fs, "readFileSync").callsFake((file) => {
+            return fakeFirmware();
+        });
+        sinon.stub(fs, "writeFileSync").callsFake((file, content) => {
+            if (file.indexOf("iot-toolchain-") !== -1) {
+                stamped = true;
+            }
+        });
+        sinon.stub(iotManager, "writeDescriptor").callsFake((folder, appId) => {});
+        sinon.stub(iotManager, "writeConfigurationHeader").callsFake((folder, appId) => {});
+        sinon.stub(installationManager, "executeCommand").callsFake((command, wait, cb) => {
+            commands.push({command:command, cb:cb});
+        });
+
+        iotManager.buildWorkers = 2;
+        iotManager.registerLib("/tmp/foobar", "foolib", 2, {}, IotLibForm);
+        iotManager.registerApp("/tmp/foobar", "fooapp", "Foo Bar", 5, "fooPlatform", "barBoard", "foobarFramework", ["foolib"], {foo:"bar"}, {}, IotAppForm);
+        iotManager.registerApp("/tmp/foobar", "barapp", "Bar Foo", 5, "fooPlatform", "barBoard", "foobarFramework", ["foolib"], {foo:"bar"}, {}, IotAppForm);
+        iotManager.build("1", "fooapp", false, {id:1});
+        iotManager.build("2", "barapp", false, {id:2});
+
+        // The second build waits for the toolchain update of the first one
+        expect(commands.length).to.be.equal(1);
+        expect(commands[0].command).to.contain("platformio update");
+        expect(iotManager.getBuildJob("2").status).to.be.equal("queued");
+
+        commands.shift().cb(null, "", "");
+        expect(commands.length).to.be.equal(1);
+        expect(commands[0].command).to.not.contain("platformio update");
+
+        fs.existsSync.restore();
+        fs.ensureDirSync.restore();
+        fs.copySync.restore();
+        fs.removeSync.restore();
+        fs.readFileSync.restore();
+        fs.writeFileSync.restore();
+        iotManager.writeDescriptor.restore();
+        iotManager.writeConfigurationHeader.restore();
+        installationManager.executeCommand.restore();
+    });
+
+    it("build app should reuse firmwares of the artifact store", function() {
+        const iotManager = new IotManager.class(appConfiguration, webServices, installationManager, formManager, environmentManager, confManager, translateManager, messageManager);
+        const fs = require("fs-extra");
+        const written = {};
+        const results = [];
+        sinon.stub(fs, "existsSync").callsFake((path) => {
+            return (path.indexOf("iot-firmwares") === -1 || written[path] !== undefined);
+        });
+        sinon.stub(fs, "ensureDirSync").callsFake((dir) => {});
+        sinon.stub(fs, "readFileSync").callsFake((file) => {
+            return fakeFirmware();
+        });
+        sinon.stub(fs, "writeFileSync").callsFake((file, content) => {
+            written[file] = content;
+        });
+        sinon.stub(iotManager, "contentHash").callsFake((appId) => {
+            return "0123456789abcdef";
+        });
+        sinon.stub(iotManager, "getIot").callsFake((id) => {
+            return {id:id, iotApp:"fooapp", foobar:"barfoo"};
+        });
+
+        iotManager.registerLib("/tmp/foobar", "foolib", 2, {}, IotLibForm);
+        iotManager.registerApp("/tmp/foobar", "fooapp", "Foo Bar", 5, "fooPlatform", "barBoard", "foobarFramework", ["foolib"], {foo:"bar"}, {}, IotAppForm);
+        expect(iotManager.getFirmware(42)).to.be.null;
+        iotManager.build(42, "fooapp", false, iotManager.getIot(42), (error, result) => results.push(result));
+        iotManager.build(42, "fooapp", false, iotManager.getIot(42), (error, result) => results.push(result));
+        iotManager.build(43, "fooapp", false, iotManager.getIot(43), (error, result) => results.push(result));
+
+        // The second build of the same configuration is served from the store
+        expect(fs.readFileSync.calledTwice).to.be.true;
+        expect(Object.keys(written).length).to.be.equal(2);
+        expect(results[1].firmwarePath).to.be.equal(results[0].firmwarePath);
+        expect(results[1].md5).to.be.equal(results[0].md5);
+        expect(results[2].firmwarePath).to.be.not.equal(results[0].firmwarePath);
+
+        const firmware = iotManager.getFirmware(42);
+        expect(firmware.path).to.be.equal(results[0].firmwarePath);
+        expect(firmware.md5).to.be.equal(require("crypto").createHash("md5").update(written[firmware.path]).digest("hex"));
+        expect(firmware.size).to.be.equal(written[firmware.path].length);
+
+        fs.existsSync.restore();
+        fs.ensureDirSync.restore();
+        fs.readFileSync.restore();
+        fs.writeFileSync.restore();
+        iotManager.contentHash.restore();
+        iotManager.getIot.restore();
+    });
+
+    it("pruneBuildCache should remove entries of other versions and contents", function() {
+        const iotManager = new IotManager.class(appConfiguration, webServices, installationManager, formManager, environmentManager, confManager, translateManager, messageManager);
+        const fs = require("fs-extra");
+        sinon.stub(fs, "existsSync").callsFake((path) => {
+            return true;
+        });
+        sinon.stub(fs, "readdirSync").callsFake((folder) => {
+            if (folder.indexOf("iot-firmwares") !== -1) {
+                return ["fooapp-7-0123456789ab-aaaaaaaaaaaa.bin", "fooapp-7-bbbbbbbbbbbb-aaaaaaaaaaaa.bin", "fooapp-6-0123456789ab-aaaaaaaaaaaa.bin", "fooapp-bar-7-bbbbbbbbbbbb-aaaaaaaaaaaa.bin"];
+            }
+            return ["iot-base-fooapp-0123456789ab.bin", "iot-base-fooapp-bbbbbbbbbbbb.bin", "iot-base-fooapp-bar-bbbbbbbbbbbb.bin", "iot-build-fooapp-cccccccccccc", "iot-build-fooapp-dddddddddddd", "iot-build-fooapp-bar-cccccccccccc"];
+        });
+        sinon.stub(fs, "statSync").callsFake((path) => {
+            return {mtimeMs:(path.indexOf("dddddddddddd") !== -1) ? 2000 : 1000};
+        });
+        sinon.stub(fs, "removeSync").callsFake((path) => {});
+        sinon.stub(iotManager, "contentHash").callsFake((appId) => {
+            return "0123456789abcdef";
+        });
+
+        iotManager.registerLib("/tmp/foobar", "foolib", 2, {}, IotLibForm);
+        iotManager.registerApp("/tmp/foobar", "fooapp", "Foo Bar", 5, "fooPlatform", "barBoard", "foobarFramework", ["foolib"], {foo:"bar"}, {}, IotAppForm);
+        iotManager.pruneBuildCache("fooapp");
+
+        // The latest workspace is kept for the next build
+        const removed = fs.removeSync.getCalls().map((call) => call.args[0].substr(call.args[0].lastIndexOf("/") + 1));
+        expect(removed).to.have.members(["fooapp-7-bbbbbbbbbbbb-aaaaaaaaaaaa.bin", "fooapp-6-0123456789ab-aaaaaaaaaaaa.bin", "iot-base-fooapp-bbbbbbbbbbbb.bin", "iot-build-fooapp-cccccccccccc"]);
+
+        fs.existsSync.restore();
+        fs.readdirSync.restore();
+        fs.statSync.restore();
+        fs.removeSync.restore();
+        iotManager.contentHash.restore();
+    });
+
+    it("patchFirmware should write a checksummed configuration without changing the image XOR", function() {
+        const iotManager = new IotManager.class(appConfiguration, webServices, installationManager, formManager, environmentManager, confManager, translateManager, messageManager);
+        const xor = (buffer) => buffer.reduce((value, byte) => value ^ byte, 0);
+        const image = fakeFirmware();
+        const initialXor = xor(image);
+        const initialLength = image.length;
+
+        iotManager.patchFirmware(image, {id:42, ssid:"foo", passphrase:"bar"}, JSON.stringify({id:42, ssid:"foo"}));
+        expect(image.length).to.be.equal(initialLength);
+        expect(xor(image)).to.be.equal(initialXor);
+        expect(firmwareConfiguration(image)).to.be.deep.equal({id:42, ssid:"foo"});
+        const offset = image.indexOf("SMARTIES-CONFIG!");
+        // Fixed size settings : id (20 bytes), ssid (36 bytes), passphrase (68 bytes)
+        expect(image.toString("utf8", offset + 28, offset + 30)).to.be.equal("42");
+        expect(image[offset + 30]).to.be.equal(0);
+        expect(image.toString("utf8", offset + 48, offset + 51)).to.be.equal("foo");
+        expect(image.toString("utf8", offset + 84, offset + 87)).to.be.equal("bar");
+        const data = image.slice(offset + 28, offset + 152 + image.readUInt32LE(offset + 16));
+        expect(image.readUInt32LE(offset + 20)).to.be.equal(iotManager.configurationChecksum(data));
+        // FNV-1a reference value
+        expect(iotManager.configurationChecksum(Buffer.from("a"))).to.be.equal(0xe40c292c);
+
+        // Patching again replaces the previous configuration
+        iotManager.patchFirmware(image, {id:1}, JSON.stringify({id:1}));
+        expect(xor(image)).to.be.equal(initialXor);
+        expect(firmwareConfiguration(image)).to.be.deep.equal({id:1});
+        expect(image[offset + 48]).to.be.equal(0);
+
+        expect(() => iotManager.patchFirmware(Buffer.alloc(100), {}, "{}")).to.throw();
+        expect(() => iotManager.patchFirmware(fakeFirmware(), {}, "x".repeat(2049))).to.throw();
+        expect(() => iotManager.patchFirmware(fakeFirmware(), {ssid:"x".repeat(36)}, "{}")).to.throw();
+    });
+
+    it("configurationHeader should define the app constants", function() {
+        const iotManager = new IotManager.class(appConfiguration, webServices, installationManager, formManager, environmentManager, confManager, translateManager, messageManager);
+        const fs = require("fs-extra");
+        sinon.stub(fs, "existsSync").callsFake((path) => {
+            return true;
+        });
+        sinon.stub(environmentManager, "getLocalAPIUrl").callsFake(() => {
+            return "http://192.168.0.2:8100/api/";
+        });
+        iotManager.registerLib("/tmp/foobar", "foolib", 2, {}, IotLibForm);
+        iotManager.registerApp("/tmp/foobar", "fooapp", "Foo Bar", 5, "fooPlatform", "barBoard", "foobarFramework", ["foolib"], {poweredMode:0, timer:1200}, {}, IotAppForm);
+
+        const header = iotManager.configurationHeader("fooapp");
+        expect(header).to.have.string("#define SMARTIES_CONFIG_HEADER\n");
+        expect(header).to.have.string("constexpr char SMARTIES_IOT_APP[] = \"fooapp\";\n");
+        expect(header).to.have.string("constexpr char SMARTIES_API_URL[] = \"http://192.168.0.2:8100/api/\";\n");
+        expect(header).to.have.string("constexpr int SMARTIES_VERSION = " + iotManager.getVersion("fooapp") + ";\n");
+        expect(header).to.have.string("constexpr int SMARTIES_POWERED_MODE = 0;\n");
+        expect(header).to.have.string("constexpr long SMARTIES_TIMER = 1200;\n");
+
+        environmentManager.getLocalAPIUrl.restore();
+        fs.existsSync.restore();
+    });
+
+    it("contentHash should change only when sources change", function() {
+        const iotManager = new IotManager.class(appConfiguration, webServices, installationManager, formManager, environmentManager, confManager, translateManager, messageManager);
+        const fs = require("fs-extra");
+        const base = "/tmp/iot-content-hash-test";
+        fs.removeSync(base);
+        ["lib/lib", "lib/global_lib", "app/src", "app/lib/driver", "app/global_lib"].forEach((folder) => {
+            fs.ensureDirSync(base + "/" + folder);
+        });
+        fs.writeFileSync(base + "/lib/lib/foo.h", "#define FOO 1");
+        fs.writeFileSync(base + "/app/src/main.cpp", "foo = \"%config%\";");
+        fs.writeFileSync(base + "/app/lib/driver/driver.cpp", "int bar;");
+
+        iotManager.registerLib(base + "/lib", "foolib", 2, {}, IotLibForm);
+        iotManager.registerApp(base + "/app", "fooapp", "Foo Bar", 5, "fooPlatform", "barBoard", "foobarFramework", ["foolib"], {foo:"bar"}, {}, IotAppForm);
+        const hash = iotManager.contentHash("fooapp");
+        expect(hash).to.match(/^[0-9a-f]{32}$/);
+        expect(iotManager.contentHash("fooapp")).to.be.equal(hash);
+
+        // Same sources registered again give the same workspace
+        fs.writeFileSync(base + "/lib/lib/foo.h", "#define FOO 1");
+        iotManager.registerLib(base + "/lib", "foolib", 2, {}, IotLibForm);
+        expect(iotManager.contentHash("fooapp")).to.be.equal(hash);
+
+        // A library change gives a new one
+        fs.writeFileSync(base + "/lib/lib/foo.h", "#define FOO 2");
+        iotManager.registerLib(base + "/lib", "foolib", 3, {}, IotLibForm);
+        expect(iotManager.contentHash("fooapp")).to.be.not.equal(hash);
+
+        fs.removeSync(base);
+    });
+
     it("generate descriptor should be correct", function(done) {
         const iotManager = new IotManager.class(appConfiguration, webServices, installationManager, formManager, environmentManager, confManager, translateManager, messageManager);
         const fs = require("fs-extra");